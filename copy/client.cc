@@ -19,6 +19,7 @@
 
 }}} */
 #include "client.h"
+#include "client_parser_impl.h"
 
 using namespace Memory;
 
@@ -29,12 +30,16 @@ using namespace Memory;
 #include <boost/log/sources/record_ostream.hpp>
 //#include <boost/log/attributes/named_scope.hpp>
 #include <boost/system/error_code.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <functional>
 using namespace std;
 
+#include <ixxx/ixxx.h>
+
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
 
@@ -59,13 +64,23 @@ namespace IMAP {
         maildir_(opts_.maildir),
         tmp_dir_(maildir_.tmp_dir_fd()),
         parser_(buffer_proxy_, tag_buffer_, *this),
+        partial_file_(opts_.journal_file + ".partial"),
         mailbox_(opts_.mailbox),
         fetch_timer_(client_, lg_),
-        header_printer_(opts_, buffer_, lg_)
+        header_printer_(opts_, buffer_, lg_),
+        idle_timer_(client_.io_service()),
+        expunge_timer_(client_.io_service())
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
+      set_pipeline_depth(opts_.pipeline);
+      set_metrics(&registry_);
+      app_.set_metrics(&registry_);
+      maildir_.set_fsync_histogram(&registry_.fsync);
+      maildir_.set_batch_size(opts_.commit_batch);
       buffer_proxy_.set(&buffer_);
       read_journal();
+      read_sync_state();
+      read_partial_journal();
       do_signal_wait();
       app_.async_start([this](){
             //state_ = State::ESTABLISHED;
@@ -77,47 +92,149 @@ namespace IMAP {
     {
       try {
         write_journal();
+        // the progress is already recorded in the partial journal
+        if (partial_fd_ > -1)
+          ixxx::posix::close(partial_fd_);
       } catch (...) {
         // don't throw exceptions in destructor ...
       }
     }
+    size_t Client::messages() const
+    {
+      return fetch_timer_.messages();
+    }
+    Metrics::Registry Client::metrics() const
+    {
+      Metrics::Registry r(registry_);
+      r.bytes_read     = client_.bytes_read();
+      r.bytes_written  = client_.bytes_written();
+      r.bytes_inflated = client_.bytes_inflated();
+      return r;
+    }
+    bool Client::finished() const
+    {
+      return state_ == State::LOGGED_OUT;
+    }
 
     void Client::read_journal()
     {
       if (fs::exists(opts_.journal_file)) {
         Journal journal;
-        BOOST_LOG_SEV(lg_, Log::MSG) << "Reading journal " << opts_.journal_file << " ...";
+        LOG_SEV(lg_, Log::MSG) << "Reading journal " << opts_.journal_file << " ...";
         journal.read(opts_.journal_file);
         uidvalidity_ = journal.uidvalidity_;
         uids_ = journal.uids_;
         mailbox_ = journal.mailbox_;
         need_cleanup_ = true;
-        fs::remove(opts_.journal_file);
+        if (opts_.append_journal) {
+          // compact it - it is removed when the cleanup is finished
+          Journal compacted(journal.mailbox_, journal.uidvalidity_, uids_);
+          journal_writer_.open(opts_.journal_file, compacted);
+        } else {
+          fs::remove(opts_.journal_file);
+        }
       }
     }
     void Client::write_journal()
     {
+      // only UIDs of durable messages may be expunged next time
+      commit_deliveries();
+      if (opts_.append_journal)
+        // already up to date
+        return;
       if (uids_.empty())
         return;
       if (!opts_.del)
         return;
-      BOOST_LOG_SEV(lg_, Log::MSG) << "Writing journal " << opts_.journal_file << " ...";
-      Journal journal(opts_.mailbox, uidvalidity_, uids_);
+      LOG_SEV(lg_, Log::MSG) << "Writing journal " << opts_.journal_file << " ...";
+      Journal journal(mailbox_, uidvalidity_, uids_);
       journal.write(opts_.journal_file);
     }
 
+    void Client::read_sync_state()
+    {
+      if (!opts_.incremental)
+        return;
+      if (fs::exists(opts_.sync_file)) {
+        LOG_SEV(lg_, Log::DEBUG) << "Reading sync state " << opts_.sync_file << " ...";
+        sync_state_.read(opts_.sync_file);
+      }
+    }
+    void Client::write_sync_state()
+    {
+      if (!opts_.incremental)
+        return;
+      Sync_State::Mailbox &m = sync_state_.mailboxes_[mailbox_];
+      if (m.uidvalidity_ != uidvalidity_)
+        m = Sync_State::Mailbox();
+      m.uidvalidity_ = uidvalidity_;
+      // messages can't show up later with a UID smaller than UIDNEXT
+      uint32_t last = std::max(uidnext_ ? uidnext_ - 1 : 0u, max_uid_);
+      if (last > m.last_uid_)
+        m.last_uid_ = last;
+      m.highestmodseq_ = highestmodseq_;
+      LOG_SEV(lg_, Log::MSG) << "Writing sync state " << opts_.sync_file
+        << " (last UID: " << m.last_uid_ << ", HIGHESTMODSEQ: "
+        << m.highestmodseq_ << ") ...";
+      sync_state_.write(opts_.sync_file);
+    }
+
+    // Makes the messages of the current batch durable - only then
+    // their UIDs are eligible for deletion on the server.
+    //
+    // The maildir commit and the journal append are two separate
+    // durability points: when the process is killed between them, the
+    // batch is delivered but not journaled, thus, it is downloaded
+    // (and delivered) again by the next run. Nothing is lost or
+    // expunged prematurely - but recovery isn't exact, duplicates of
+    // at most one batch are possible.
+    void Client::commit_deliveries()
+    {
+      if (uncommitted_uids_.empty())
+        return;
+      LOG_SEV(lg_, Log::DEBUG) << "Committing " << maildir_.uncommitted()
+        << " messages (" << uncommitted_uids_.size() << " UIDs)";
+      maildir_.commit();
+      if (opts_.append_journal && opts_.del) {
+        if (!journal_writer_.is_open()) {
+          LOG_SEV(lg_, Log::DEBUG) << "Creating journal " << opts_.journal_file;
+          Sequence_Set empty;
+          journal_writer_.open(opts_.journal_file,
+              Journal(mailbox_, uidvalidity_, empty));
+        }
+        Sequence_Set batch;
+        for (auto uid : uncommitted_uids_)
+          batch.push(uid);
+        journal_writer_.append(batch.ranges());
+      }
+      for (auto uid : uncommitted_uids_)
+        uids_.push(uid);
+      uncommitted_uids_.clear();
+    }
+
+    void Client::read_partial_journal()
+    {
+      if (!opts_.partial_threshold)
+        return;
+      if (fs::exists(partial_file_)) {
+        resume_.read(partial_file_);
+        LOG_SEV(lg_, Log::MSG) << "Found partially downloaded message "
+          "(UID " << resume_.uid_ << ", " << resume_.offset_ << " octets)";
+      }
+    }
+
     void Client::do_signal_wait()
     {
       signals_.async_wait([this]( const boost::system::error_code &ec, int signal_number)
           {
-            BOOST_LOG_FUNCTION();
+            LOG_FUNCTION();
             if (ec) {
               if (ec.value() == boost::system::errc::operation_canceled) {
               } else {
                 THROW_ERROR(ec);
               }
             } else {
-              BOOST_LOG_SEV(lg_, Log::ERROR) << "Got signal: " << signal_number;
+              LOG_SEV(lg_, Log::ERROR) << "Got signal: " << signal_number;
               if (signaled_) {
                 ostringstream o;
                 o << "Got a signal (" << signal_number
@@ -134,7 +251,7 @@ namespace IMAP {
 
     void Client::async_login_capabilities(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       auto cap_fn = [this, fn](){
         cond_async_capabilities(fn);
       };
@@ -143,54 +260,363 @@ namespace IMAP {
 
     void Client::async_cleanup(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       auto finish_fn = [this, fn](){
-        uids_.clear();
         mailbox_ = opts_.mailbox;
-        BOOST_LOG_SEV(lg_, Log::MSG) << "Deleting messages from last time ... finished";
+        LOG_SEV(lg_, Log::MSG) << "Deleting messages from last time ... finished";
         fn();
       };
-      auto expunge_fn = [this, finish_fn](){
-       async_uid_or_simple_expunge(finish_fn);
+      // not pipelined with the SELECT because the UIDs are only
+      // valid when the UIDVALIDITY doesn't change
+      auto purge_fn = [this, finish_fn](){
+        async_purge(finish_fn);
       };
-      auto store_fn = [this, expunge_fn](){
-        async_store(expunge_fn);
+      async_select(purge_fn);
+    }
+
+    // STORE \Deleted and (UID) EXPUNGE - with pipelining both
+    // commands are sent at once, the server executes them in order.
+    // The UIDs are kept until the expunge is confirmed, thus, they
+    // end up in the journal if something goes wrong before.
+    void Client::async_purge(std::function<void(void)> fn)
+    {
+      LOG_FUNCTION();
+      if (uids_.empty()) {
+        journal_writer_.remove();
+        fn();
+        return;
+      }
+      auto finish_fn = [this, fn](){
+        uids_.clear();
+        journal_writer_.remove();
+        fn();
       };
-      async_select(store_fn);
+      if (pipeline_depth() > 1) {
+        async_store([](){});
+        async_uid_or_simple_expunge(finish_fn);
+      } else {
+        auto expunge_fn = [this, finish_fn](){
+          async_uid_or_simple_expunge(finish_fn);
+        };
+        async_store(expunge_fn);
+      }
     }
 
     // Boost ASIO stackless coroutine in combination
     // with classical std::bind()s to supply the completion handler
     void Client::do_download()
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       reenter (download_coroutine_) {
         yield async_select(bind(&Client::do_download, this));
-        if (exists_) {
+        if (!exists_) {
+          LOG_SEV(lg_, Log::MSG) << "Mailbox " << opts_.mailbox
+            << " is empty.";
+        } else if (compute_uid_range()) {
           BOOST_LOG(lg_) << "Fetching into " << opts_.maildir << " ...";
           fetch_timer_.start();
           yield async_fetch(bind(&Client::do_download, this));
           fetch_timer_.stop();
+          commit_deliveries();
+          write_sync_state();
           if (opts_.del) {
-            yield async_store(bind(&Client::do_download, this));
-            yield async_uid_or_simple_expunge(bind(&Client::do_download, this));
+            if (pipeline_depth() > 1)
+              // LOGOUT doesn't have to wait for the purge either
+              async_purge([](){});
+            else
+              yield async_purge(bind(&Client::do_download, this));
+          } else {
+            uids_.clear();
           }
-        } else {
-          BOOST_LOG_SEV(lg_, Log::MSG) << "Mailbox " << opts_.mailbox
-            << " is empty.";
         }
-        uids_.clear();
         yield async_logout(bind(&Client::do_download, this));
         do_quit();
       }
     }
 
+    // Daemon mode: download what exists, then IDLE until the server
+    // announces new messages (untagged EXISTS) and fetch them. The
+    // expunge of fetched messages is batched via a timer. Errors end
+    // the session - main() then reconnects.
+    void Client::do_daemon()
+    {
+      LOG_FUNCTION();
+      reenter (daemon_coroutine_) {
+        yield async_select(bind(&Client::do_daemon, this));
+        watching_ = true;
+        if (exists_ && compute_uid_range()) {
+          BOOST_LOG(lg_) << "Fetching into " << opts_.maildir << " ...";
+          fetch_timer_.start();
+          yield async_fetch(bind(&Client::do_daemon, this));
+          fetch_timer_.stop();
+          delivered();
+        }
+        known_uid_ = std::max(max_uid_, uidnext_ ? uidnext_ - 1 : 0u);
+        for (;;) {
+          if (new_messages_) {
+            new_messages_ = false;
+            uid_range_ = make_pair(known_uid_ + 1,
+                numeric_limits<uint32_t>::max());
+            fetch_timer_.start();
+            yield async_fetch_by_size(bind(&Client::do_daemon, this));
+            fetch_timer_.stop();
+            delivered();
+            known_uid_ = std::max(known_uid_, max_uid_);
+          }
+          if (expunge_due_) {
+            expunge_due_ = false;
+            yield async_purge(bind(&Client::do_daemon, this));
+          }
+          yield async_wait_for_news(bind(&Client::do_daemon, this));
+        }
+      }
+    }
+
+    // Sync mode: LIST the mailboxes and get their UIDNEXT/UIDVALIDITY
+    // values (RFC5819 LIST-STATUS or pipelined STATUS commands) - only
+    // the mailboxes that changed since the last run are selected and
+    // downloaded into the corresponding Maildir++ subfolders.
+    void Client::do_sync()
+    {
+      LOG_FUNCTION();
+      reenter (sync_coroutine_) {
+        yield async_list_folders(bind(&Client::do_sync, this));
+        if (!has_list_status()) {
+          yield async_status_folders(bind(&Client::do_sync, this));
+        }
+        select_changed_folders();
+        fetch_timer_.start();
+        for (folder_pos_ = 0; folder_pos_ < changed_folders_.size();
+            ++folder_pos_) {
+          enter_folder(changed_folders_[folder_pos_]);
+          yield async_select(bind(&Client::do_sync, this));
+          if (exists_ && compute_uid_range()) {
+            BOOST_LOG(lg_) << "Fetching " << mailbox_ << " ...";
+            yield async_fetch(bind(&Client::do_sync, this));
+            commit_deliveries();
+            write_sync_state();
+            if (opts_.del) {
+              yield async_purge(bind(&Client::do_sync, this));
+            } else {
+              uids_.clear();
+            }
+          } else {
+            // such that it is skipped next time
+            write_sync_state();
+          }
+        }
+        fetch_timer_.stop();
+        yield async_logout(bind(&Client::do_sync, this));
+        do_quit();
+      }
+    }
+
+    static const vector<IMAP::Status_Attribute> sync_status_atts = {
+      IMAP::Status_Attribute::MESSAGES,
+      IMAP::Status_Attribute::UIDNEXT,
+      IMAP::Status_Attribute::UIDVALIDITY
+    };
+
+    bool Client::has_list_status() const
+    {
+      return capabilities_.find(
+          IMAP::Server::Response::Capability::LIST_STATUS)
+        != capabilities_.end();
+    }
+
+    void Client::async_list_folders(std::function<void(void)> fn)
+    {
+      folders_.clear();
+      if (has_list_status())
+        IMAP::Client::Base::async_list(opts_.list_reference,
+            opts_.list_mailbox, sync_status_atts, fn);
+      else
+        IMAP::Client::Base::async_list(opts_.list_reference,
+            opts_.list_mailbox, fn);
+    }
+
+    // minimal pipeline depth for the STATUS commands
+    static const unsigned status_window = 64;
+
+    // All STATUS commands are issued at once, i.e. checking hundreds
+    // of mailboxes only takes a few round trips.
+    void Client::async_status_folders(std::function<void(void)> fn)
+    {
+      LOG_FUNCTION();
+      unsigned depth = pipeline_depth();
+      status_in_flight_ = folders_.size();
+      if (!status_in_flight_) {
+        fn();
+        return;
+      }
+      set_pipeline_depth(std::max(depth, status_window));
+      auto done_fn = [this, fn, depth](){
+        if (--status_in_flight_)
+          return;
+        set_pipeline_depth(depth);
+        fn();
+      };
+      for (auto &f : folders_)
+        IMAP::Client::Base::async_status(f.first, sync_status_atts, done_fn);
+    }
+
+    void Client::select_changed_folders()
+    {
+      changed_folders_.clear();
+      for (auto &f : folders_) {
+        const Folder &x = f.second;
+        if (x.has_status) {
+          if (!x.messages)
+            continue;
+          auto i = sync_state_.mailboxes_.find(f.first);
+          if (   i != sync_state_.mailboxes_.end()
+              && i->second.uidvalidity_ == x.uidvalidity
+              && x.uidnext && x.uidnext <= i->second.last_uid_ + 1)
+            continue;
+        }
+        changed_folders_.push_back(f.first);
+      }
+      LOG_SEV(lg_, Log::MSG) << changed_folders_.size() << " of "
+        << folders_.size() << " mailboxes changed since the last run";
+    }
+
+    // Maildir++ folder name: INBOX is the top-level maildir, the
+    // hierarchy delimiter is mapped to '.' (and a literal '.' to '_')
+    static string maildir_folder(const string &mailbox, char delimiter)
+    {
+      if (boost::algorithm::iequals(mailbox, "INBOX"))
+        return string();
+      string r(mailbox);
+      // e.g. Courier's INBOX.Sent
+      if (   delimiter && r.size() > 6 && r[5] == delimiter
+          && boost::algorithm::istarts_with(r, "INBOX"))
+        r.erase(0, 6);
+      for (auto &c : r) {
+        if (c == delimiter)
+          c = '.';
+        else if (c == '.' || c == '/')
+          c = '_';
+      }
+      return r;
+    }
+
+    void Client::enter_folder(const std::string &name)
+    {
+      mailbox_ = name;
+      string folder(maildir_folder(name, folders_[name].delimiter));
+      LOG_SEV(lg_, Log::DEBUG) << "Mailbox " << name
+        << " -> Maildir++ folder ." << folder;
+      maildir_.select_folder(folder);
+      exists_        = 0;
+      recent_        = 0;
+      uidnext_       = 0;
+      highestmodseq_ = 0;
+      max_uid_       = 0;
+      uid_range_     = make_pair(0u, 0u);
+    }
+
+    void Client::delivered()
+    {
+      commit_deliveries();
+      write_sync_state();
+      if (!opts_.del)
+        uids_.clear();
+      else if (!uids_.empty())
+        start_expunge_timer();
+    }
+    void Client::record_delivery(uint64_t size)
+    {
+      registry_.message_size.add(size);
+      registry_.delivery_latency.add(
+          Metrics::micros(Metrics::Clock::now() - fetch_start_));
+      ++registry_.messages;
+    }
+
+    bool Client::has_idle() const
+    {
+      return capabilities_.find(IMAP::Server::Response::Capability::IDLE)
+        != capabilities_.end();
+    }
+
+    // IDLE (RFC2177) until something happens - or poll with NOOP
+    // if the server doesn't support it
+    void Client::async_wait_for_news(std::function<void(void)> fn)
+    {
+      LOG_FUNCTION();
+      state_ = State::IDLING;
+      if (!has_idle()) {
+        idle_timer_.expires_from_now(std::chrono::seconds(opts_.poll_interval));
+        idle_timer_.async_wait([this, fn](const boost::system::error_code &ec)
+            {
+              if (ec) {
+                if (ec.value() == boost::asio::error::operation_aborted)
+                  return;
+                THROW_ERROR(ec);
+              }
+              async_noop([this, fn](){
+                  state_ = State::SELECTED_MAILBOX;
+                  fn();
+                });
+            });
+        return;
+      }
+      got_continuation_ = false;
+      wake_pending_ = false;
+      // RFC2177: servers may log out clients that idle for 30 minutes
+      idle_timer_.expires_from_now(std::chrono::seconds(opts_.idle_interval));
+      idle_timer_.async_wait([this](const boost::system::error_code &ec)
+          {
+            if (ec) {
+              if (ec.value() == boost::asio::error::operation_aborted)
+                return;
+              THROW_ERROR(ec);
+            }
+            LOG_SEV(lg_, Log::DEBUG) << "Re-issuing IDLE";
+            wake_up();
+          });
+      async_idle([this, fn](){
+          idle_timer_.cancel();
+          state_ = State::SELECTED_MAILBOX;
+          fn();
+        });
+    }
+
+    // finishes the IDLE command
+    void Client::wake_up()
+    {
+      if (state_ != State::IDLING || !has_idle() || wake_pending_)
+        return;
+      wake_pending_ = true;
+      if (got_continuation_)
+        idle_done();
+    }
+
+    void Client::start_expunge_timer()
+    {
+      if (expunge_timer_running_ || expunge_due_)
+        return;
+      expunge_timer_running_ = true;
+      expunge_timer_.expires_from_now(
+          std::chrono::seconds(opts_.expunge_interval));
+      expunge_timer_.async_wait([this](const boost::system::error_code &ec)
+          {
+            expunge_timer_running_ = false;
+            if (ec) {
+              if (ec.value() == boost::asio::error::operation_aborted)
+                return;
+              THROW_ERROR(ec);
+            }
+            expunge_due_ = true;
+            wake_up();
+          });
+    }
+
     // Boost ASIO stackless coroutine and as variation:
     // completion-handler is specified as C++11 lambda
     // (less characters to type than using std::bind() ...)
     void Client::do_fetch_header()
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       reenter (fetch_header_coroutine_) {
         yield async_select      ([this](){do_fetch_header();});
         yield async_fetch_header([this](){do_fetch_header();});
@@ -215,7 +641,7 @@ namespace IMAP {
     // coroutine object -> sizeof(int)                     :  4 byte
     void Client::do_list()
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       auto finish_fn = [this](){
         do_quit();
       };
@@ -235,7 +661,7 @@ namespace IMAP {
       login_timer_.async_wait([this](
           const boost::system::error_code &ec)
         {
-          BOOST_LOG_FUNCTION();
+          LOG_FUNCTION();
           if (ec && ec.value() != boost::system::errc::operation_canceled) {
             THROW_ERROR(ec);
           } else {
@@ -248,10 +674,39 @@ namespace IMAP {
     }
     void Client::do_post_login()
     {
-      if (need_cleanup_)
-        async_cleanup(std::bind(&Client::do_task, this));
-      else
-        do_task();
+      auto task_fn = [this](){
+        if (need_cleanup_)
+          async_cleanup(std::bind(&Client::do_task, this));
+        else
+          do_task();
+      };
+      cond_async_compress(task_fn);
+    }
+
+    // Nothing else must be in flight when compression is enabled, i.e.
+    // even with pipelining the next command waits for the tagged OK.
+    void Client::cond_async_compress(std::function<void(void)> fn)
+    {
+      LOG_FUNCTION();
+      if (!opts_.compress) {
+        fn();
+        return;
+      }
+      using namespace IMAP::Server::Response;
+      if (capabilities_.find(Capability::COMPRESS_eq_DEFLATE)
+          == capabilities_.end()) {
+        LOG_SEV(lg_, Log::WARN) << "Server doesn't support "
+          "COMPRESS=DEFLATE - continuing without compression";
+        fn();
+        return;
+      }
+      async_compress([this, fn](){
+          // the server compresses right after the CRLF of the tagged
+          // OK, i.e. the rest of the current read is already compressed
+          parser_.stop();
+          client_.enable_compression();
+          fn();
+          });
     }
 
     void Client::do_task()
@@ -266,6 +721,12 @@ namespace IMAP {
         case Task::LIST:
           do_list();
           break;
+        case Task::DAEMON:
+          do_daemon();
+          break;
+        case Task::SYNC:
+          do_sync();
+          break;
         default:
           ;
       }
@@ -284,13 +745,13 @@ namespace IMAP {
 
     void Client::async_login(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       using namespace IMAP::Server::Response;
       if (capabilities_.find(Capability::IMAP4rev1) == capabilities_.end())
         THROW_MSG("Server has not IMAP4rev1 capability");
       if (capabilities_.find(Capability::LOGINDISABLED) != capabilities_.end())
         THROW_MSG("Cannot login because server has LOGINDISABLED");
-      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Clearing capabilities";
+      LOG_SEV(lg_, Log::DEBUG) << "Clearing capabilities";
       capabilities_.clear();
       exists_ = 0;
       recent_ = 0;
@@ -300,32 +761,324 @@ namespace IMAP {
       IMAP::Client::Base::async_login(opts_.username, opts_.password, fn);
     }
 
+    bool Client::use_condstore() const
+    {
+      return opts_.incremental && capabilities_.find(
+          IMAP::Server::Response::Capability::CONDSTORE) != capabilities_.end();
+    }
+
     void Client::async_select(std::function<void(void)> fn)
     {
-      IMAP::Client::Base::async_select(mailbox_, fn);
+      // with CONDSTORE the server returns HIGHESTMODSEQ
+      IMAP::Client::Base::async_select(mailbox_, fn, use_condstore());
     }
 
-    void Client::async_fetch(std::function<void(void)> fn)
+    // Computes which UIDs to fetch - if everything should be fetched
+    // uid_range_ isn't set.
+    //
+    // When fetching incrementally, only UIDs greater than the
+    // last fetched one are requested - and nothing at all if
+    // the HIGHESTMODSEQ/UIDNEXT values show that nothing is new.
+    //
+    // When downloading with several connections, each connection
+    // fetches a disjoint UID range. The ranges are derived from
+    // the UIDNEXT value that is returned on SELECT - thus, the
+    // connections don't have to coordinate with each other.
+    //
+    // Returns false if there is nothing to fetch - the reason is logged.
+    bool Client::compute_uid_range()
     {
-      vector<pair<uint32_t, uint32_t> > set = {
-        {1, numeric_limits<uint32_t>::max()}
-      };
+      LOG_FUNCTION();
+      uint32_t first = 1;
+      if (opts_.incremental) {
+        auto i = sync_state_.mailboxes_.find(mailbox_);
+        if (i != sync_state_.mailboxes_.end()
+            && i->second.uidvalidity_ == uidvalidity_) {
+          const Sync_State::Mailbox &m = i->second;
+          if (   (highestmodseq_ && highestmodseq_ == m.highestmodseq_)
+              || (uidnext_ && uidnext_ <= m.last_uid_ + 1)) {
+            LOG_SEV(lg_, Log::MSG) << "No new messages in " << mailbox_
+              << " since the last run.";
+            return false;
+          }
+          if (uidnext_)
+            first = m.last_uid_ + 1;
+          else
+            LOG_SEV(lg_, Log::WARN) << "Server didn't send UIDNEXT - "
+              "fetching everything";
+        }
+      }
+      if (first == 1 && opts_.connections < 2)
+        return true;
+      if (!uidnext_) {
+        if (opts_.connection) {
+          LOG_SEV(lg_, Log::WARN) << "Server didn't send UIDNEXT - "
+            "connection " << opts_.connection << " has nothing to do";
+          return false;
+        }
+        LOG_SEV(lg_, Log::WARN) << "Server didn't send UIDNEXT - "
+          "fetching everything with the first connection";
+        return true;
+      }
+      uint32_t n = uidnext_ - first;
+      uint32_t chunk = n / opts_.connections + (n % opts_.connections ? 1 : 0);
+      uint64_t lo = uint64_t(chunk) * opts_.connection + first;
+      uint64_t hi = lo + chunk - 1;
+      if (hi > uidnext_ - 1)
+        hi = uidnext_ - 1;
+      if (lo > hi) {
+        LOG_SEV(lg_, Log::MSG) << "Nothing to fetch for connection "
+          << opts_.connection << " - its UID range is empty.";
+        return false;
+      }
+      uid_range_ = make_pair(uint32_t(lo), uint32_t(hi));
+      BOOST_LOG(lg_) << "Connection " << opts_.connection << " fetches UIDs "
+        << uid_range_.first << ':' << uid_range_.second;
+      return true;
+    }
 
-      using namespace IMAP::Client;
-      vector<Fetch_Attribute> atts;
-      atts.emplace_back(Fetch::UID);
-      atts.emplace_back(Fetch::FLAGS);
+    static void add_header_fields(vector<IMAP::Client::Fetch_Attribute> &atts)
+    {
       vector<string> fields;
       fields.emplace_back("date");
       fields.emplace_back("from");
       fields.emplace_back("subject");
       // BODY_PEEK - same as BODY but don't set \seen flag ...
-      atts.emplace_back(Fetch::BODY_PEEK,
+      atts.emplace_back(IMAP::Client::Fetch::BODY_PEEK,
           IMAP::Section_Attribute(IMAP::Section::HEADER_FIELDS, std::move(fields)));
+    }
+
+    void Client::async_fetch(std::function<void(void)> fn)
+    {
+      if (opts_.partial_threshold) {
+        async_fetch_by_size(fn);
+        return;
+      }
+      using namespace IMAP::Client;
+      vector<Fetch_Attribute> atts;
+      atts.emplace_back(Fetch::UID);
+      atts.emplace_back(Fetch::FLAGS);
+      add_header_fields(atts);
       atts.emplace_back(Fetch::BODY_PEEK);
 
       state_ = State::FETCHING;
-      IMAP::Client::Base::async_fetch(set, atts, fn);
+      async_fetch_range(atts, fn);
+    }
+
+    void Client::async_fetch_range(
+        const std::vector<IMAP::Client::Fetch_Attribute> &atts,
+        std::function<void(void)> fn)
+    {
+      if (uid_range_.first) {
+        // an explicit upper bound because n:* would include the
+        // last message even if its UID is smaller than n
+        //
+        // no CHANGEDSINCE modifier: the range only contains messages
+        // that are new since the last run, i.e. it wouldn't filter
+        // anything and just add a MODSEQ item to each response
+        vector<pair<uint32_t, uint32_t> > uid_set = { uid_range_ };
+        IMAP::Client::Base::async_uid_fetch(uid_set, atts, fn);
+      } else {
+        vector<pair<uint32_t, uint32_t> > set = {
+          {1, numeric_limits<uint32_t>::max()}
+        };
+        IMAP::Client::Base::async_fetch(set, atts, fn);
+      }
+    }
+
+    // First the UIDs and sizes, then the messages - the large ones
+    // (if enabled) in chunks
+    void Client::async_fetch_by_size(std::function<void(void)> fn)
+    {
+      async_fetch_sizes([this, fn](){
+          async_fetch_small([this, fn](){
+              async_fetch_large(fn);
+            });
+        });
+    }
+
+    // Large messages are fetched in chunks (BODY.PEEK[]<offset.length>)
+    // that are appended to the tmp file - thus, an interrupted download
+    // can be continued. For that the sizes are fetched first.
+    void Client::async_fetch_sizes(std::function<void(void)> fn)
+    {
+      using namespace IMAP::Client;
+      vector<Fetch_Attribute> atts;
+      atts.emplace_back(Fetch::UID);
+      atts.emplace_back(Fetch::RFC822_SIZE);
+
+      small_uids_.clear();
+      large_.clear();
+      large_pos_ = 0;
+      state_ = State::FETCHING_SIZES;
+      async_fetch_range(atts, fn);
+    }
+
+    void Client::async_fetch_small(std::function<void(void)> fn)
+    {
+      if (small_uids_.empty()) {
+        fn();
+        return;
+      }
+      using namespace IMAP::Client;
+      vector<Fetch_Attribute> atts;
+      atts.emplace_back(Fetch::UID);
+      atts.emplace_back(Fetch::FLAGS);
+      add_header_fields(atts);
+      atts.emplace_back(Fetch::BODY_PEEK);
+
+      state_ = State::FETCHING;
+      IMAP::Client::Base::async_uid_fetch(small_uids_.ranges(), atts, fn);
+    }
+
+    // one chunk per command, the completion handler requests the next one
+    void Client::async_fetch_large(std::function<void(void)> fn)
+    {
+      LOG_FUNCTION();
+      if (large_pos_ == large_.size()) {
+        remove_resume();
+        fn();
+        return;
+      }
+      if (partial_fd_ < 0)
+        start_partial();
+      uint32_t uid  = large_[large_pos_].first;
+      uint32_t size = large_[large_pos_].second;
+      partial_length_ = std::min<uint32_t>(opts_.partial_chunk, size - partial_.offset_);
+
+      using namespace IMAP::Client;
+      vector<Fetch_Attribute> atts;
+      atts.emplace_back(Fetch::UID);
+      atts.emplace_back(Fetch::FLAGS);
+      if (!partial_.offset_)
+        add_header_fields(atts);
+      atts.emplace_back(Fetch::BODY_PEEK, IMAP::Section_Attribute(),
+          partial_.offset_, partial_length_);
+
+      vector<pair<uint32_t, uint32_t> > set = { {uid, uid} };
+      partial_received_ = false;
+      state_ = State::FETCHING;
+      IMAP::Client::Base::async_uid_fetch(set, atts, [this, fn](){
+          if (!partial_received_)
+            abandon_partial();
+          async_fetch_large(fn);
+        });
+    }
+
+    void Client::start_partial()
+    {
+      uint32_t uid  = large_[large_pos_].first;
+      uint32_t size = large_[large_pos_].second;
+      partial_ = Partial_Journal();
+      if (resume_.uid_ == uid) {
+        string path(maildir_.tmp_path(resume_.tmp_name_));
+        if (   resume_.mailbox_ == mailbox_
+            && resume_.uidvalidity_ == uidvalidity_
+            && resume_.offset_ < size
+            && fs::exists(path) && fs::file_size(path) >= resume_.size_) {
+          LOG_SEV(lg_, Log::MSG) << "Resuming download of UID " << uid
+            << " at octet " << resume_.offset_ << " of " << size;
+          // drop data that was written after the last record
+          fs::resize_file(path, resume_.size_);
+          partial_ = resume_;
+          maildir_.resume_tmp_name(partial_.tmp_name_);
+          resume_ = Partial_Journal();
+        } else {
+          remove_resume();
+        }
+      }
+      if (partial_.tmp_name_.empty()) {
+        partial_.mailbox_     = mailbox_;
+        partial_.uidvalidity_ = uidvalidity_;
+        partial_.uid_         = uid;
+        maildir_.create_tmp_name(partial_.tmp_name_);
+        LOG_SEV(lg_, Log::DEBUG) << "Fetching UID " << uid << " ("
+          << size << " octets) in chunks";
+      }
+      partial_fd_ = ixxx::posix::open(maildir_.tmp_path(partial_.tmp_name_),
+          O_WRONLY | O_CREAT | O_APPEND, 0666);
+      fetch_start_ = Metrics::Clock::now();
+    }
+
+    void Client::append_chunk()
+    {
+      partial_received_ = true;
+      const char *b = chunk_buffer_.begin();
+      const char *e = chunk_buffer_.end();
+      // the parser converts CRLF to LF (a bare LF is a syntax error),
+      // thus, each LF corresponds to 2 octets on the server
+      uint64_t octets = (e - b) + std::count(b, e, '\n');
+      uint32_t size = large_[large_pos_].second;
+      bool done = partial_.offset_ + octets >= size || octets < partial_length_;
+      if (!done && b != e && *(e-1) == '\r') {
+        // possibly the first half of a CRLF - is fetched again with
+        // the next chunk
+        --e;
+        --octets;
+      }
+      for (const char *p = b; p != e; )
+        p += ixxx::posix::write(partial_fd_, p, e - p);
+      partial_.offset_ += octets;
+      partial_.size_   += e - b;
+      // the data has to be durable before the partial journal claims
+      // it - otherwise a resume after a crash could skip octets that
+      // never made it to the disk
+      sync_partial();
+      if (done)
+        finish_partial();
+      else
+        partial_.write(partial_file_);
+    }
+
+    void Client::sync_partial()
+    {
+      auto start = Metrics::Clock::now();
+      ixxx::posix::fsync(partial_fd_);
+      registry_.fsync.add(Metrics::micros(Metrics::Clock::now() - start));
+    }
+
+    void Client::finish_partial()
+    {
+      // already synced by append_chunk()
+      ixxx::posix::close(partial_fd_);
+      partial_fd_ = -1;
+      if (flags_.empty()) {
+        maildir_.move_to_new();
+      } else  {
+        LOG_SEV(lg_, Log::DEBUG) << "Using maildir flags: " << flags_;
+        maildir_.move_to_cur(flags_);
+      }
+      record_delivery(partial_.size_);
+      fetch_timer_.increase_messages();
+      fs::remove(partial_file_);
+      partial_ = Partial_Journal();
+      ++large_pos_;
+    }
+
+    // e.g. when the message was expunged in the meantime
+    void Client::abandon_partial()
+    {
+      LOG_SEV(lg_, Log::WARN) << "Server didn't return a chunk of UID "
+        << large_[large_pos_].first << " - skipping it";
+      ixxx::posix::close(partial_fd_);
+      partial_fd_ = -1;
+      fs::remove(maildir_.tmp_path(partial_.tmp_name_));
+      maildir_.clear();
+      fs::remove(partial_file_);
+      partial_ = Partial_Journal();
+      ++large_pos_;
+    }
+
+    void Client::remove_resume()
+    {
+      if (resume_.tmp_name_.empty())
+        return;
+      LOG_SEV(lg_, Log::MSG) << "Removing stale partial download of UID "
+        << resume_.uid_;
+      fs::remove(maildir_.tmp_path(resume_.tmp_name_));
+      if (partial_fd_ < 0)
+        fs::remove(partial_file_);
+      resume_ = Partial_Journal();
     }
 
     void Client::async_fetch_header(std::function<void(void)> fn)
@@ -356,17 +1109,15 @@ namespace IMAP {
 
     void Client::async_store(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
-      vector<pair<uint32_t, uint32_t> > set;
-      uids_.copy(set);
+      LOG_FUNCTION();
       vector<IMAP::Flag> flags;
       flags.emplace_back(IMAP::Flag::DELETED);
-      IMAP::Client::Base::async_store(set, flags, fn);
+      IMAP::Client::Base::async_store(uids_.ranges(), flags, fn);
     }
 
     bool Client::has_uidplus() const
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       auto i = capabilities_.find(IMAP::Server::Response::Capability::UIDPLUS);
       BOOST_LOG(lg_) << "Has UIDPLUS capability: " << (i != capabilities_.end());
       return i != capabilities_.end();
@@ -374,7 +1125,7 @@ namespace IMAP {
 
     void Client::async_uid_or_simple_expunge(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       if (has_uidplus())
         async_uid_expunge(fn);
       else
@@ -383,21 +1134,19 @@ namespace IMAP {
 
     void Client::async_uid_expunge(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
-      vector<pair<uint32_t, uint32_t> > set;
-      uids_.copy(set);
-      IMAP::Client::Base::async_uid_expunge(set, fn);
+      LOG_FUNCTION();
+      IMAP::Client::Base::async_uid_expunge(uids_.ranges(), fn);
     }
 
 
     void Client::do_read()
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       client_.async_read_some([this](
             const boost::system::error_code &ec,
             size_t size)
           {
-            BOOST_LOG_FUNCTION();
+            LOG_FUNCTION();
             if (ec) {
               if (          state_ == State::LOGGED_OUT
                   && (
@@ -416,14 +1165,19 @@ namespace IMAP {
                      )
                 )
               {
-                //BOOST_LOG_SEV(lg_, Log::DEBUG) << "do_read() -> do_shutdown()";
+                //LOG_SEV(lg_, Log::DEBUG) << "do_read() -> do_shutdown()";
                 //do_shutdown();
               } else {
-                BOOST_LOG_SEV(lg_, Log::DEBUG) << "do_read() fail: " << ec.message();
+                LOG_SEV(lg_, Log::DEBUG) << "do_read() fail: " << ec.message();
                 THROW_ERROR(ec);
               }
             } else {
-              parser_.read(client_.input().data(), client_. input().data() + size);
+              auto start = Metrics::Clock::now();
+              const char *b = client_.input().data();
+              const char *rest = parser_.read(b, b + size);
+              registry_.parse.add(Metrics::nanos(Metrics::Clock::now() - start));
+              if (rest != b + size)
+                client_.set_compressed_input(rest, b + size);
               if (state_ != State::LOGGED_OUT) // && client_.is_open())
                 do_read();
             }
@@ -437,9 +1191,11 @@ namespace IMAP {
 
     void Client::do_quit()
     {
-      BOOST_LOG_FUNCTION();
-      BOOST_LOG_SEV(lg_, Log::DEBUG) << "do_quit()";
+      LOG_FUNCTION();
+      LOG_SEV(lg_, Log::DEBUG) << "do_quit()";
       state_ = State::LOGGED_OUT;
+      idle_timer_.cancel();
+      expunge_timer_.cancel();
       app_.async_finish([this](){
             signals_.cancel();
           });
@@ -448,8 +1204,8 @@ namespace IMAP {
 
     void Client::imap_status_code_capability_begin()
     {
-      BOOST_LOG_FUNCTION();
-      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Clearing capabilities";
+      LOG_FUNCTION();
+      LOG_SEV(lg_, Log::DEBUG) << "Clearing capabilities";
       capabilities_.clear();
     }
     void Client::imap_capability_begin()
@@ -457,49 +1213,86 @@ namespace IMAP {
     }
     void Client::imap_capability(IMAP::Server::Response::Capability capability)
     {
-      BOOST_LOG_FUNCTION();
-      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Got capability: " << capability;
+      LOG_FUNCTION();
+      LOG_SEV(lg_, Log::DEBUG) << "Got capability: " << capability;
       capabilities_.insert(capability);
     }
     void Client::imap_status_code_capability_end()
     {
-      BOOST_LOG_FUNCTION();
-      BOOST_LOG_SEV(lg_, Log::DEBUG) << "finished retrieving capabilties";
+      LOG_FUNCTION();
+      LOG_SEV(lg_, Log::DEBUG) << "finished retrieving capabilties";
       login_timer_.cancel();
     }
     void Client::imap_data_exists(uint32_t number)
     {
-      BOOST_LOG_FUNCTION();
-      BOOST_LOG(lg_) << "Mailbox " << opts_.mailbox << " contains " << number
+      LOG_FUNCTION();
+      BOOST_LOG(lg_) << "Mailbox " << mailbox_ << " contains " << number
         << " messages";
+      if (watching_ && number > exists_) {
+        new_messages_ = true;
+        wake_up();
+      }
       exists_ = number;
     }
+    void Client::imap_data_expunge(uint32_t)
+    {
+      if (exists_)
+        --exists_;
+    }
+    void Client::imap_continue_req()
+    {
+      if (state_ != State::IDLING)
+        return;
+      got_continuation_ = true;
+      if (wake_pending_)
+        idle_done();
+    }
     void Client::imap_data_recent(uint32_t number)
     {
-      BOOST_LOG_FUNCTION();
-      BOOST_LOG(lg_) << "Mailbox " << opts_.mailbox << " has " << number
+      LOG_FUNCTION();
+      BOOST_LOG(lg_) << "Mailbox " << mailbox_ << " has " << number
         << " RECENT messages";
       recent_ = number;
     }
     void Client::imap_status_code_uidvalidity(uint32_t n)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       BOOST_LOG(lg_) << "UIDVALIDITY: " << n;
       if (uidvalidity_ != n) {
-        BOOST_LOG_SEV(lg_, Log::DEBUG) << "Replacing UIDVALIDITY "
+        LOG_SEV(lg_, Log::DEBUG) << "Replacing UIDVALIDITY "
           << uidvalidity_ << " with " << n;
         uids_.clear();
       }
       uidvalidity_ = n;
     }
 
+    void Client::imap_status_code_uidnext(uint32_t n)
+    {
+      LOG_FUNCTION();
+      BOOST_LOG(lg_) << "UIDNEXT: " << n;
+      uidnext_ = n;
+    }
+
+    void Client::imap_status_code_highestmodseq(uint64_t n)
+    {
+      LOG_FUNCTION();
+      BOOST_LOG(lg_) << "HIGHESTMODSEQ: " << n;
+      highestmodseq_ = n;
+    }
+
     void Client::imap_data_fetch_begin(uint32_t number)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       flags_.clear();
-      if (state_ == State::FETCHING) {
+      if (state_ == State::FETCHING_SIZES) {
+        last_uid_ = 0;
+        last_size_ = 0;
+      } else if (state_ == State::FETCHING) {
         BOOST_LOG(lg_) << "Fetching message: " << number;
         last_uid_ = 0;
+        // a chunked message is timed since start_partial()
+        if (partial_fd_ < 0)
+          fetch_start_ = Metrics::Clock::now();
         if (opts_.simulate_error == fetch_timer_.messages() + 1) {
           ostringstream o;
           o << "Simulated error after fetched message: " << fetch_timer_.messages();
@@ -509,9 +1302,41 @@ namespace IMAP {
     }
     void Client::imap_data_fetch_end()
     {
+      // e.g. flag updates of other clients
+      if (state_ == State::IDLING)
+        return;
       if (!last_uid_)
         THROW_MSG("Did not retrieve any UID");
-      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Storing UID: " << last_uid_;
+      if (state_ == State::FETCHING_SIZES) {
+        if (last_uid_ < uid_range_.first)
+          // n:* includes the last message even if its UID is smaller
+          return;
+        if (!opts_.partial_threshold || last_size_ <= opts_.partial_threshold)
+          small_uids_.push(last_uid_);
+        else if (last_uid_ == resume_.uid_)
+          // continue with it such that the partial journal is free again
+          large_.emplace(large_.begin(), last_uid_, last_size_);
+        else
+          large_.emplace_back(last_uid_, last_size_);
+        return;
+      }
+      if (partial_fd_ > -1)
+        // not complete, yet
+        return;
+      if (last_uid_ > max_uid_)
+        max_uid_ = last_uid_;
+      // the append journal is also written per batch
+      if (opts_.commit_batch > 1 || opts_.append_journal) {
+        auto now = chrono::steady_clock::now();
+        if (uncommitted_uids_.empty())
+          batch_start_ = now;
+        uncommitted_uids_.push_back(last_uid_);
+        if (   uncommitted_uids_.size() >= opts_.commit_batch
+            || now - batch_start_ >= chrono::milliseconds(opts_.commit_interval))
+          commit_deliveries();
+        return;
+      }
+      LOG_SEV(lg_, Log::DEBUG) << "Storing UID: " << last_uid_;
       uids_.push(last_uid_);
     }
     void Client::imap_section_empty()
@@ -525,28 +1350,44 @@ namespace IMAP {
     void Client::imap_body_section_inner()
     {
       if (state_ == State::FETCHING) {
-        if (full_body_) {
-          string filename;
-          maildir_.create_tmp_name(filename);
-          Buffer::File f(tmp_dir_, filename);
-          file_buffer_ = std::move(f);
-          buffer_proxy_.set(&file_buffer_);
+        if (full_body_ && partial_fd_ > -1) {
+          buffer_proxy_.set(&chunk_buffer_);
+        } else if (full_body_) {
+          maildir_.create_tmp_name(tmp_name_);
+          if (opts_.commit_batch > 1) {
+            // synced by the next maildir commit
+            tmp_file_ = Tmp_File(maildir_.tmp_dir_fd(), tmp_name_);
+            buffer_proxy_.set(&tmp_file_);
+          } else {
+            Buffer::File f(tmp_dir_, tmp_name_);
+            file_buffer_ = std::move(f);
+            buffer_proxy_.set(&file_buffer_);
+          }
         }
       }
     }
     void Client::imap_body_section_end()
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       if (state_ == State::FETCHING) {
-        if (full_body_) {
+        if (full_body_ && partial_fd_ > -1) {
           buffer_proxy_.set(&buffer_);
-          file_buffer_.close();
+          full_body_ = false;
+          append_chunk();
+        } else if (full_body_) {
+          buffer_proxy_.set(&buffer_);
+          if (opts_.commit_batch > 1)
+            tmp_file_.close();
+          else
+            file_buffer_.close();
+          uint64_t size = fs::file_size(maildir_.tmp_path(tmp_name_));
           if (flags_.empty()) {
             maildir_.move_to_new();
           } else  {
-            BOOST_LOG_SEV(lg_, Log::DEBUG) << "Using maildir flags: " << flags_;
+            LOG_SEV(lg_, Log::DEBUG) << "Using maildir flags: " << flags_;
             maildir_.move_to_cur(flags_);
           }
+          record_delivery(size);
           full_body_ = false;
           fetch_timer_.increase_messages();
         } else {
@@ -578,36 +1419,92 @@ namespace IMAP {
     }
     void Client::imap_uid(uint32_t number)
     {
-      BOOST_LOG_FUNCTION();
-      if (state_ == State::FETCHING) {
-        BOOST_LOG_SEV(lg_, Log::DEBUG) << "UID: " << number;
+      LOG_FUNCTION();
+      if (state_ == State::FETCHING || state_ == State::FETCHING_SIZES) {
+        LOG_SEV(lg_, Log::DEBUG) << "UID: " << number;
         last_uid_ = number;
       }
     }
+    void Client::imap_rfc822_size(uint32_t number)
+    {
+      if (state_ == State::FETCHING_SIZES)
+        last_size_ = number;
+    }
 
     void Client::imap_list_begin()
     {
       oflags_.clear();
+      list_delimiter_ = 0;
+      list_noselect_ = false;
+    }
+    void Client::imap_list_sflag(IMAP::Server::Response::SFlag f)
+    {
+      if (f == IMAP::Server::Response::SFlag::NOSELECT)
+        list_noselect_ = true;
+    }
+    void Client::imap_list_delimiter(char c)
+    {
+      list_delimiter_ = c;
     }
     void Client::imap_list_mailbox()
     {
       using namespace IMAP::Server::Response;
       if (buffer_.empty()) {
-        BOOST_LOG_SEV(lg_, Log::MSG) << "NIL-Mailbox";
+        LOG_SEV(lg_, Log::MSG) << "NIL-Mailbox";
         return;
       }
       string m(buffer_.begin(), buffer_.end());
+      if (opts_.task == Task::SYNC) {
+        if (list_noselect_) {
+          LOG_SEV(lg_, Log::DEBUG) << "Skipping \\Noselect mailbox " << m;
+          return;
+        }
+        folders_[m].delimiter = list_delimiter_;
+        return;
+      }
       char x = ' ';
       if (oflags_.find(OFlag::HASCHILDREN) != oflags_.end())
         x = '+';
       else if (oflags_.find(OFlag::HASNOCHILDREN) != oflags_.end())
           x = '|';
-      BOOST_LOG_SEV(lg_, Log::MSG) << "Mailbox: -" << x << ' ' << m;
+      LOG_SEV(lg_, Log::MSG) << "Mailbox: -" << x << ' ' << m;
     }
     void Client::imap_list_oflag(IMAP::Server::Response::OFlag o)
     {
       oflags_.insert(o);
     }
+    void Client::imap_status_att(IMAP::Status_Attribute a, uint32_t n)
+    {
+      switch (a) {
+        case IMAP::Status_Attribute::MESSAGES:
+          status_.messages = n;
+          break;
+        case IMAP::Status_Attribute::UIDNEXT:
+          status_.uidnext = n;
+          break;
+        case IMAP::Status_Attribute::UIDVALIDITY:
+          status_.uidvalidity = n;
+          break;
+        default:
+          ;
+      }
+    }
+    void Client::imap_status_end()
+    {
+      string m(buffer_.begin(), buffer_.end());
+      auto i = folders_.find(m);
+      if (i != folders_.end()) {
+        LOG_SEV(lg_, Log::DEBUG) << "Status of " << m << ": MESSAGES "
+          << status_.messages << " UIDNEXT " << status_.uidnext
+          << " UIDVALIDITY " << status_.uidvalidity;
+        status_.delimiter = i->second.delimiter;
+        status_.has_status = true;
+        i->second = status_;
+      }
+      status_ = Folder();
+    }
 
   }
 }
+
+template class IMAP::Client::Basic_Parser<IMAP::Copy::Client>;
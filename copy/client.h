@@ -26,6 +26,9 @@
 #include <copy/state.h>
 #include <copy/fetch_timer.h>
 #include <copy/header_printer.h>
+#include <copy/sync_state.h>
+#include <copy/journal.h>
+#include <copy/tmp_file.h>
 
 #include <net/tcp_client.h>
 #include <net/client_application.h>
@@ -33,26 +36,33 @@
 #include <imap/client_writer.h>
 #include <imap/client_base.h>
 #include <log/log.h>
+#include <metrics/metrics.h>
 #include <maildir/maildir.h>
 #include <buffer/buffer.h>
 #include <buffer/file.h>
 #include <sequence_set.h>
 
 #include <string>
+#include <map>
 #include <unordered_set>
 #include <chrono>
 #include <vector>
 #include <functional>
+#include <utility>
 
 #include <boost/asio/basic_waitable_timer.hpp>
 
 namespace IMAP {
   namespace Copy {
     class Options;
-    class Client : public IMAP::Client::Base {
+    // final, such that the parser dispatches the callbacks statically
+    class Client final : public IMAP::Client::Base {
       private:
+        friend class IMAP::Client::Basic_Parser<Client>;
         boost::asio::coroutine  download_coroutine_;
         boost::asio::coroutine  fetch_header_coroutine_;
+        boost::asio::coroutine  daemon_coroutine_;
+        boost::asio::coroutine  sync_coroutine_;
         boost::log::sources::severity_logger<Log::Severity> &lg_;
         const Options          &opts_;
         Net::Client::Base      &client_;
@@ -65,7 +75,9 @@ namespace IMAP {
         Maildir                 maildir_;
         Memory::Dir             tmp_dir_;
         Memory::Buffer::File    file_buffer_;
-        IMAP::Client::Parser    parser_;
+        // group commit: without fsync on close
+        Tmp_File                tmp_file_;
+        IMAP::Client::Basic_Parser<Client> parser_;
 
         bool          need_cleanup_ {false};
         State         state_        {State::DISCONNECTED };
@@ -73,8 +85,34 @@ namespace IMAP {
         unsigned      exists_      {0};
         unsigned      recent_      {0};
         unsigned      uidvalidity_ {0};
+        uint32_t      uidnext_     {0};
+        uint64_t      highestmodseq_ {0};
+        // highest UID fetched in this session
+        uint32_t      max_uid_     {0};
+        Sync_State    sync_state_;
+        Journal_Writer journal_writer_;
+        // UID range this connection downloads (when using several connections)
+        std::pair<uint32_t, uint32_t> uid_range_ {0, 0};
         uint32_t      last_uid_    {0};
         Sequence_Set  uids_;
+        // group commit: UIDs of delivered but not yet durable messages
+        std::vector<uint32_t> uncommitted_uids_;
+        std::chrono::time_point<std::chrono::steady_clock> batch_start_;
+        // chunked fetching of large messages
+        std::string   partial_file_;
+        uint32_t      last_size_   {0};
+        Sequence_Set  small_uids_;
+        // (UID, RFC822.SIZE) of the messages above the threshold
+        std::vector<std::pair<uint32_t, uint32_t> > large_;
+        size_t        large_pos_   {0};
+        // progress of the current large message
+        Partial_Journal partial_;
+        // left over by an interrupted run
+        Partial_Journal resume_;
+        int           partial_fd_  {-1};
+        uint32_t      partial_length_ {0};
+        bool          partial_received_ {false};
+        Memory::Buffer::Vector chunk_buffer_;
         std::unordered_set<IMAP::Server::Response::Capability> capabilities_;
         bool          full_body_   {false};
         std::string   flags_;
@@ -84,8 +122,62 @@ namespace IMAP {
         Fetch_Timer    fetch_timer_;
         Header_Printer header_printer_;
 
+        Metrics::Registry registry_;
+        // of the message that is currently fetched
+        Metrics::Clock::time_point fetch_start_;
+        std::string   tmp_name_;
+
+        // daemon mode
+        boost::asio::basic_waitable_timer<std::chrono::steady_clock> idle_timer_;
+        boost::asio::basic_waitable_timer<std::chrono::steady_clock> expunge_timer_;
+        // EXISTS responses are only interesting after the initial SELECT
+        bool          watching_     {false};
+        bool          new_messages_ {false};
+        bool          expunge_due_  {false};
+        bool          expunge_timer_running_ {false};
+        // the server sent the continuation request of IDLE
+        bool          got_continuation_ {false};
+        // DONE is sent (or sent on the continuation request)
+        bool          wake_pending_ {false};
+        // highest UID that is already downloaded or older than the session
+        uint32_t      known_uid_    {0};
+
+        // sync mode
+        struct Folder {
+          char     delimiter   {0};
+          uint32_t messages    {0};
+          uint32_t uidnext     {0};
+          uint32_t uidvalidity {0};
+          bool     has_status  {false};
+        };
+        std::map<std::string, Folder> folders_;
+        std::vector<std::string> changed_folders_;
+        size_t        folder_pos_   {0};
+        // of the LIST/STATUS response that is parsed
+        char          list_delimiter_ {0};
+        bool          list_noselect_  {false};
+        Folder        status_;
+        unsigned      status_in_flight_ {0};
+
         void read_journal();
         void write_journal();
+        void read_sync_state();
+        void write_sync_state();
+        void commit_deliveries();
+        void read_partial_journal();
+        void start_partial();
+        void append_chunk();
+        void sync_partial();
+        void finish_partial();
+        void abandon_partial();
+        void remove_resume();
+        bool use_condstore() const;
+        bool has_idle() const;
+        bool has_list_status() const;
+        void delivered();
+        void record_delivery(uint64_t size);
+        void start_expunge_timer();
+        void wake_up();
 
         void do_signal_wait();
 
@@ -93,24 +185,40 @@ namespace IMAP {
         void write_command(vector<char> &cmd);
 
         bool has_uidplus() const;
+        bool compute_uid_range();
 
         // specialized download client functions
         void do_pre_login();
         void do_post_login();
+        void cond_async_compress(std::function<void(void)> fn);
         void async_login_capabilities(std::function<void(void)> fn);
         void cond_async_capabilities(std::function<void(void)> fn);
         void async_login(std::function<void(void)> fn);
         void async_select(std::function<void(void)> fn);
         void async_fetch_header(std::function<void(void)> fn);
         void async_fetch(std::function<void(void)> fn);
+        void async_fetch_range(const std::vector<IMAP::Client::Fetch_Attribute> &atts,
+            std::function<void(void)> fn);
+        void async_fetch_by_size(std::function<void(void)> fn);
+        void async_fetch_sizes(std::function<void(void)> fn);
+        void async_fetch_small(std::function<void(void)> fn);
+        void async_fetch_large(std::function<void(void)> fn);
         void async_list(std::function<void(void)> fn);
         void async_store(std::function<void(void)> fn);
         void async_uid_or_simple_expunge(std::function<void(void)> fn);
         void async_uid_expunge(std::function<void(void)> fn);
         void async_cleanup(std::function<void(void)> fn);
+        void async_purge(std::function<void(void)> fn);
+        void async_wait_for_news(std::function<void(void)> fn);
+        void async_list_folders(std::function<void(void)> fn);
+        void async_status_folders(std::function<void(void)> fn);
+        void select_changed_folders();
+        void enter_folder(const std::string &name);
         void do_list();
         void do_fetch_header();
         void do_download();
+        void do_daemon();
+        void do_sync();
         void do_task();
         void do_quit();
       public:
@@ -118,15 +226,24 @@ namespace IMAP {
             Net::Client::Base &net_client,
             boost::log::sources::severity_logger< Log::Severity > &lg);
         ~Client();
+        // number of fetched messages
+        size_t messages() const;
+        // snapshot, including the transferred bytes
+        Metrics::Registry metrics() const;
+        bool finished() const;
 
       protected:
+        void imap_continue_req() override;
         void imap_status_code_capability_begin() override;
         void imap_capability_begin() override;
         void imap_capability(IMAP::Server::Response::Capability capability) override;
         void imap_status_code_capability_end() override;
         void imap_data_exists(uint32_t number) override;
         void imap_data_recent(uint32_t number) override;
+        void imap_data_expunge(uint32_t number) override;
         void imap_status_code_uidvalidity(uint32_t n) override;
+        void imap_status_code_uidnext(uint32_t n) override;
+        void imap_status_code_highestmodseq(uint64_t n) override;
 
         void imap_data_fetch_begin(uint32_t number) override;
         void imap_data_fetch_end() override;
@@ -135,10 +252,15 @@ namespace IMAP {
         void imap_body_section_end() override;
         void imap_flag(Flag flag) override;
         void imap_uid(uint32_t number) override;
+        void imap_rfc822_size(uint32_t number) override;
 
         void imap_list_begin() override;
+        void imap_list_sflag(IMAP::Server::Response::SFlag f) override;
         void imap_list_oflag(IMAP::Server::Response::OFlag o) override;
+        void imap_list_delimiter(char c) override;
         void imap_list_mailbox() override;
+        void imap_status_att(IMAP::Status_Attribute a, uint32_t n) override;
+        void imap_status_end() override;
 
 
     };
@@ -23,6 +23,8 @@
 #include <net/client.h>
 #include <exception.h>
 
+#include <sstream>
+
 #include <boost/log/sources/record_ostream.hpp>
 //#include <boost/log/attributes/named_scope.hpp>
 
@@ -49,15 +51,24 @@ namespace IMAP {
         (fetch_stop - start_);
       size_t b = client_.bytes_read() - bytes_start_;
       double r = (double(b)*1024.0)/(double(d.count())*1000.0);
-      BOOST_LOG_SEV(lg_, Log::MSG) << "Fetched " << messages_
-        << " messages (" << b << " bytes) in " << double(d.count())/1000.0
-        << " s (@ " << r << " KiB/s)";
+      if (client_.compression_enabled()) {
+        size_t u = client_.bytes_inflated() - inflated_start_;
+        LOG_SEV(lg_, Log::MSG) << "Fetched " << messages_
+          << " messages (" << b << " bytes, " << u << " bytes uncompressed, "
+          << "ratio " << (b ? double(u)/double(b) : 0.0) << ") in "
+          << double(d.count())/1000.0 << " s (@ " << r << " KiB/s)";
+      } else {
+        LOG_SEV(lg_, Log::MSG) << "Fetched " << messages_
+          << " messages (" << b << " bytes) in " << double(d.count())/1000.0
+          << " s (@ " << r << " KiB/s)";
+      }
     }
 
     void Fetch_Timer::start()
     {
       start_ = chrono::steady_clock::now();
       bytes_start_ = client_.bytes_read();
+      inflated_start_ = client_.bytes_inflated();
       stopped_ = false;
 
       resume();
@@ -68,7 +79,7 @@ namespace IMAP {
       timer_.expires_from_now(std::chrono::seconds(1));
       timer_.async_wait([this](const boost::system::error_code &ec)
           {
-            BOOST_LOG_FUNCTION();
+            LOG_FUNCTION();
             if (stopped_)
               return;
             if (ec) {
@@ -85,8 +96,19 @@ namespace IMAP {
     {
       stopped_ = true;
       print();
+      print_read_sizes();
       timer_.cancel();
     }
+    void Fetch_Timer::print_read_sizes()
+    {
+      ostringstream o;
+      const Net::Client::Read_Histogram &h = client_.read_histogram();
+      for (size_t i = 0; i < h.size(); ++i)
+        if (h[i])
+          o << ' ' << (size_t(1) << i) << ':' << h[i];
+      LOG_SEV(lg_, Log::DEBUG) << "Read sizes (>= bytes:reads):"
+        << o.str() << " - read buffer: " << client_.read_buffer_size();
+    }
     void Fetch_Timer::increase_messages()
     {
       ++messages_;
@@ -40,6 +40,7 @@ namespace IMAP {
         std::chrono::time_point<std::chrono::steady_clock>           start_;
         boost::asio::basic_waitable_timer<std::chrono::steady_clock> timer_;
         size_t bytes_start_ {0};
+        size_t inflated_start_ {0};
         size_t messages_  {0};
         bool stopped_ {false};
       public:
@@ -51,6 +52,7 @@ namespace IMAP {
         void resume();
         void stop();
         void print();
+        void print_read_sizes();
         void increase_messages();
         size_t messages() const;
     };
@@ -25,6 +25,7 @@
 //#include <boost/log/attributes/named_scope.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
 
+#include <algorithm>
 #include <iomanip>
 #include <stdexcept>
 
@@ -42,15 +43,33 @@ namespace IMAP {
         lg_(lg),
         opts_(opts),
         buffer_(buffer),
-        header_decoder_(field_name_, field_body_, [this](){
-            string name(field_name_.begin(), field_name_.end());
-            string body(field_body_.begin(), field_body_.end());
-            fields_.emplace(boost::to_upper_copy(name), body);
-        })
+        header_decoder_(field_name_, field_body_, [this](){ add_field(); })
     {
       header_decoder_.set_ending_policy(MIME::Header::Decoder::Ending::LF);
     }
 
+    // as before with a std::map - the first occurrence of a field wins
+    void Header_Printer::add_field()
+    {
+      name_.assign(field_name_.begin(), field_name_.end());
+      boost::to_upper(name_);
+      if (find(name_.c_str()))
+        return;
+      if (size_ == fields_.size())
+        fields_.emplace_back();
+      Field &f = fields_[size_++];
+      f.name.swap(name_);
+      f.body.assign(field_body_.begin(), field_body_.end());
+    }
+
+    const Header_Printer::Field *Header_Printer::find(const char *name) const
+    {
+      for (size_t i = 0; i < size_; ++i)
+        if (fields_[i].name == name)
+          return &fields_[i];
+      return nullptr;
+    }
+
     void Header_Printer::print()
     {
       if (    opts_.task != Task::FETCH_HEADER
@@ -64,19 +83,24 @@ namespace IMAP {
           || static_cast<Log::Severity>(opts_.file_severity)
                  >= Log::Severity::DEBUG) {
         string s(buffer_.begin(), buffer_.end());
-        BOOST_LOG_SEV(lg_, Log::DEBUG) << "Header: |" << s << "|";
+        LOG_SEV(lg_, Log::DEBUG) << "Header: |" << s << "|";
       }
       header_decoder_.clear();
-      fields_.clear();
+      size_ = 0;
       try {
         header_decoder_.read(buffer_.begin(), buffer_.end());
         header_decoder_.verify_finished();
       } catch (const std::runtime_error &e) {
-        BOOST_LOG_SEV(lg_, Log::ERROR) << e.what();
+        LOG_SEV(lg_, Log::ERROR) << e.what();
       }
-      for (auto &i : fields_) {
-        BOOST_LOG_SEV(lg_, Log::INFO)
-          << setw(10) << left << i.first << ' ' << i.second;
+      order_.resize(size_);
+      for (size_t i = 0; i < size_; ++i)
+        order_[i] = i;
+      sort(order_.begin(), order_.end(), [this](size_t a, size_t b) {
+          return fields_[a].name < fields_[b].name; });
+      for (auto i : order_) {
+        LOG_SEV(lg_, Log::INFO)
+          << setw(10) << left << fields_[i].name << ' ' << fields_[i].body;
       }
       pretty_print();
     }
@@ -86,15 +110,15 @@ namespace IMAP {
       int j = 0;
       line_.clear();
       for (auto f : { "SUBJECT", "FROM", "DATE" } ) {
-        auto i = fields_.find(f);
-        if (i == fields_.end())
+        auto i = find(f);
+        if (!i)
           continue;
-        line_.append((*i).second);
+        line_.append(i->body);
         if (j+1 < 3)
           line_.append(" / ");
         ++j;
       }
-      BOOST_LOG_SEV(lg_, Log::MSG) << line_;
+      LOG_SEV(lg_, Log::MSG) << line_;
     }
 
 
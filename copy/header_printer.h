@@ -25,8 +25,8 @@
 #include <buffer/buffer.h>
 #include <mime/header_decoder.h>
 
-#include <map>
 #include <string>
+#include <vector>
 
 namespace IMAP {
   namespace Copy {
@@ -39,12 +39,24 @@ namespace IMAP {
 
         const Memory::Buffer::Vector &buffer_;
 
+        struct Field {
+          std::string name;
+          std::string body;
+        };
+
         MIME::Header::Decoder  header_decoder_;
         Memory::Buffer::Vector field_name_;
         Memory::Buffer::Vector field_body_;
-        std::map<std::string, std::string> fields_;
+        // reused between headers, such that decoding a header usually
+        // doesn't allocate - the first size_ entries are valid
+        std::vector<Field>     fields_;
+        size_t                 size_ {0};
+        std::vector<size_t>    order_;
+        std::string            name_;
         std::string line_;
 
+        void add_field();
+        const Field *find(const char *name) const;
         void pretty_print();
       public:
         Header_Printer(
@@ -28,9 +28,19 @@
 #include <boost/serialization/version.hpp>
 #include <boost/serialization/tracking.hpp>
 
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+#include <algorithm>
 #include <fstream>
+#include <iterator>
+#include <stdexcept>
 using namespace std;
 
+#include <ixxx/ixxx.h>
+using namespace ixxx;
+
 #include "sequence_set.h"
 
 namespace boost {
@@ -48,6 +58,25 @@ namespace boost {
 }
 BOOST_CLASS_TRACKING(IMAP::Copy::Journal, boost::serialization::track_never)
 
+namespace boost {
+  namespace serialization {
+
+    template<class Archive>
+      void serialize(Archive & a, IMAP::Copy::Partial_Journal &d,
+          const unsigned int /* version */)
+      {
+        a & d.mailbox_;
+        a & d.uidvalidity_;
+        a & d.uid_;
+        a & d.tmp_name_;
+        a & d.offset_;
+        a & d.size_;
+      }
+
+  }
+}
+BOOST_CLASS_TRACKING(IMAP::Copy::Partial_Journal, boost::serialization::track_never)
+
 namespace IMAP {
   namespace Copy {
 
@@ -56,14 +85,102 @@ namespace IMAP {
         mailbox_(mailbox),
         uidvalidity_(uidvalidity)
     {
-      set.copy(uids_);
+      uids_ = set.ranges();
     }
     Journal::Journal()
     {
     }
 
+    static const char binary_magic[] = "IMAPDLJ1";
+    static const size_t magic_size = sizeof(binary_magic) - 1;
+
+    static void put_u32(vector<char> &v, uint32_t x)
+    {
+      for (unsigned i = 0; i < 4; ++i)
+        v.push_back(char((x >> (8 * i)) & 0xff));
+    }
+    static uint32_t get_u32(const char *p)
+    {
+      uint32_t r = 0;
+      for (unsigned i = 0; i < 4; ++i)
+        r |= uint32_t(static_cast<unsigned char>(p[i])) << (8 * i);
+      return r;
+    }
+    static uint32_t crc32(const char *begin, const char *end)
+    {
+      boost::crc_32_type crc;
+      crc.process_block(begin, end);
+      return crc.checksum();
+    }
+    // each record is: first UID, last UID, CRC-32 of both
+    static void put_record(vector<char> &v, const pair<uint32_t, uint32_t> &r)
+    {
+      size_t off = v.size();
+      put_u32(v, r.first);
+      put_u32(v, r.second);
+      put_u32(v, crc32(v.data() + off, v.data() + v.size()));
+    }
+    // write() may return early, e.g. when interrupted by a signal
+    static void write_all(int fd, const vector<char> &v)
+    {
+      for (const char *p = v.data(), *e = p + v.size(); p != e; )
+        p += posix::write(fd, p, e - p);
+    }
+    // makes a rename into the directory of filename durable
+    static void sync_parent_dir(const string &filename)
+    {
+      fs::path dir(fs::path(filename).parent_path());
+      int fd = posix::open(dir.empty() ? string(".") : dir.string(), O_RDONLY);
+      try {
+        posix::fsync(fd);
+      } catch (...) {
+        posix::close(fd);
+        throw;
+      }
+      posix::close(fd);
+    }
+
+    static void read_binary(Journal &j, const vector<char> &v)
+    {
+      const char *p = v.data() + magic_size;
+      const char *end = v.data() + v.size();
+      // header: UIDVALIDITY, mailbox length, mailbox, CRC-32
+      if (end - p < 8)
+        throw std::runtime_error("journal header is truncated");
+      const char *header = p;
+      j.uidvalidity_ = get_u32(p);
+      uint32_t n = get_u32(p + 4);
+      p += 8;
+      if (size_t(end - p) < size_t(n) + 4)
+        throw std::runtime_error("journal header is truncated");
+      j.mailbox_.assign(p, p + n);
+      p += n;
+      if (get_u32(p) != crc32(header, p))
+        throw std::runtime_error("journal header checksum mismatch");
+      p += 4;
+      j.uids_.clear();
+      for (; end - p >= 12; p += 12) {
+        if (get_u32(p + 8) != crc32(p, p + 8))
+          // torn write
+          break;
+        j.uids_.emplace_back(get_u32(p), get_u32(p + 4));
+      }
+    }
+
     void Journal::read(const std::string &filename)
     {
+      {
+        ifstream f(filename, ifstream::in | ifstream::binary);
+        if (!f)
+          throw std::runtime_error("Could not open journal: " + filename);
+        vector<char> v((istreambuf_iterator<char>(f)),
+            istreambuf_iterator<char>());
+        if (v.size() >= magic_size
+            && equal(binary_magic, binary_magic + magic_size, v.begin())) {
+          read_binary(*this, v);
+          return;
+        }
+      }
       ifstream f;
       f.exceptions(ifstream::failbit | ifstream::badbit );
       f.open(filename, ifstream::in | ifstream::binary);
@@ -86,6 +203,96 @@ namespace IMAP {
       a << *this;
     }
 
+    void Partial_Journal::read(const std::string &filename)
+    {
+      ifstream f;
+      f.exceptions(ifstream::failbit | ifstream::badbit );
+      f.open(filename, ifstream::in | ifstream::binary);
+      boost::archive::text_iarchive a(f);
+      a >> *this;
+    }
+    void Partial_Journal::write(const std::string &filename) const
+    {
+      // written after each chunk - the rename makes sure that
+      // the last complete record survives an interruption
+      string tmp(filename + ".tmp");
+      {
+        ofstream f;
+        f.exceptions(ofstream::failbit | ofstream::badbit );
+        f.open(tmp, ofstream::out | ofstream::binary);
+        boost::archive::text_oarchive a(f);
+        a << *this;
+      }
+      fs::rename(tmp, filename);
+    }
+
+    Journal_Writer::Journal_Writer()
+    {
+    }
+    Journal_Writer::~Journal_Writer()
+    {
+      try {
+        if (fd_ != -1)
+          posix::close(fd_);
+      } catch (const std::exception &) {
+      }
+    }
+    void Journal_Writer::open(const std::string &filename, const Journal &journal)
+    {
+      if (fd_ != -1) {
+        posix::close(fd_);
+        fd_ = -1;
+      }
+      filename_ = filename;
+      vector<char> v(binary_magic, binary_magic + magic_size);
+      put_u32(v, journal.uidvalidity_);
+      put_u32(v, journal.mailbox_.size());
+      v.insert(v.end(), journal.mailbox_.begin(), journal.mailbox_.end());
+      put_u32(v, crc32(v.data() + magic_size, v.data() + v.size()));
+      for (auto &r : journal.uids_)
+        put_record(v, r);
+
+      string tmp(filename_ + ".tmp");
+      int fd = posix::open(tmp, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+      try {
+        write_all(fd, v);
+        posix::fsync(fd);
+      } catch (...) {
+        posix::close(fd);
+        throw;
+      }
+      posix::close(fd);
+      fs::rename(tmp, filename_);
+      sync_parent_dir(filename_);
+      fd_ = posix::open(filename_, O_WRONLY | O_APPEND);
+    }
+    bool Journal_Writer::is_open() const
+    {
+      return fd_ != -1;
+    }
+    void Journal_Writer::append(
+        const std::vector<std::pair<uint32_t, uint32_t> > &uids)
+    {
+      if (fd_ == -1)
+        throw logic_error("journal isn't open");
+      if (uids.empty())
+        return;
+      vector<char> v;
+      v.reserve(uids.size() * 12);
+      for (auto &r : uids)
+        put_record(v, r);
+      write_all(fd_, v);
+      posix::fsync(fd_);
+    }
+    void Journal_Writer::remove()
+    {
+      if (fd_ == -1)
+        return;
+      posix::close(fd_);
+      fd_ = -1;
+      fs::remove(filename_);
+    }
+
 
   }
 }
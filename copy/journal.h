@@ -38,10 +38,53 @@ namespace IMAP {
 
       Journal();
       Journal(const std::string &mailbox, uint32_t uidvalidity, const Sequence_Set &set);
+      // reads the text archive or the binary format (cf. Journal_Writer)
       void read(const std::string &filename);
       void write(const std::string &filename);
     };
 
+    // Progress of a large message that is fetched in chunks (cf.
+    // Options::partial_threshold) - an interrupted download is
+    // continued at offset_ by the next run.
+    struct Partial_Journal {
+      std::string mailbox_;
+      uint32_t uidvalidity_ {0};
+      uint32_t uid_         {0};
+      // file name in the maildir tmp directory
+      std::string tmp_name_;
+      // next octet to fetch from the server
+      uint32_t offset_      {0};
+      // size of the tmp file that corresponds to offset_
+      uint64_t size_        {0};
+
+      void read(const std::string &filename);
+      void write(const std::string &filename) const;
+    };
+
+    // Append-only binary journal: a header (mailbox, UIDVALIDITY)
+    // followed by UID range records that are appended and fsynced as
+    // messages become durable. Header and records are protected by a
+    // CRC-32 - a torn record at the end (e.g. after a SIGKILL) is
+    // ignored when reading.
+    class Journal_Writer {
+      private:
+        std::string filename_;
+        int         fd_ {-1};
+      public:
+        Journal_Writer();
+        ~Journal_Writer();
+        Journal_Writer(const Journal_Writer &) = delete;
+        Journal_Writer &operator=(const Journal_Writer &) = delete;
+
+        // atomically replaces filename with the (compacted) content of
+        // journal and keeps it open for appending
+        void open(const std::string &filename, const Journal &journal);
+        bool is_open() const;
+        void append(const std::vector<std::pair<uint32_t, uint32_t> > &uids);
+        // closes and removes the file
+        void remove();
+    };
+
   }
 }
 
@@ -21,19 +21,255 @@
 #include "client.h"
 #include "options.h"
 #include <log/log.h>
+#include <metrics/metrics.h>
 
 using namespace IMAP::Copy;
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include <utility>
 #include <exception>
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <atomic>
 using namespace std;
 
+#include <boost/asio/basic_waitable_timer.hpp>
 #include <boost/log/sources/record_ostream.hpp>
 #include <boost/exception/diagnostic_information.hpp>
 #include <boost/log/support/exception.hpp>
 
+// Accounts with the same CA configuration share one SSL context. It is
+// configured exactly once, when it is created, since the clients of other
+// worker threads may already handshake with it.
+class Setup {
+  private:
+    mutex mutex_;
+    map<string, unique_ptr<boost::asio::ssl::context> > contexts_;
+  public:
+    boost::asio::ssl::context &context(const Options &opts)
+    {
+      string key(opts.ca_file + '\0' + opts.ca_path + '\0'
+          + (opts.fingerprint.empty() ? "ca" : "fp") + (opts.tls1 ? "1" : "0"));
+      lock_guard<mutex> lock(mutex_);
+      auto &c = contexts_[key];
+      if (!c) {
+        unique_ptr<boost::asio::ssl::context> t(new boost::asio::ssl::context(
+              boost::asio::ssl::context::sslv23));
+        opts.apply(*t);
+        c = std::move(t);
+      }
+      return *c;
+    }
+};
+
+struct Summary {
+  string account;
+  size_t messages {0};
+  size_t bytes    {0};
+  double seconds  {0};
+  string error;
+  // accumulated over reconnects
+  Metrics::Registry metrics;
+};
+
+static void run(const Options &opts, Setup &setup,
+    boost::log::sources::severity_logger<Log::Severity> &lg,
+    Summary &summary, Metrics::Exporter *exporter)
+{
+  boost::asio::io_service io_service;
+
+  // deque because the clients keep references to their options
+  deque<Options> conn_opts;
+  vector<unique_ptr<Net::Client::Base> > net_clients;
+  vector<unique_ptr<IMAP::Copy::Client> > clients;
+  for (unsigned i = 0; i < opts.connections; ++i) {
+    conn_opts.push_back(opts.for_connection(i));
+    Options &o = conn_opts.back();
+    unique_ptr<Net::Client::Base> net_client;
+    if (o.use_ssl) {
+      unique_ptr<Net::Client::Base> c(
+          new Net::TCP::SSL::Client::Base(io_service, setup.context(o), o, lg));
+      net_client = std::move(c);
+    } else {
+      unique_ptr<Net::Client::Base> c(
+          new Net::TCP::Client::Base(io_service, o, lg));
+      net_client = std::move(c);
+    }
+    net_clients.push_back(std::move(net_client));
+    clients.emplace_back(new IMAP::Copy::Client(o, *net_clients.back(), lg));
+  }
+
+  auto snapshot = [&summary, &clients]() {
+    Metrics::Registry r(summary.metrics);
+    for (auto &c : clients)
+      r.merge(c->metrics());
+    return r;
+  };
+  auto collect = [&summary, &net_clients, &clients, &snapshot, exporter]() {
+    for (auto &c : clients)
+      summary.messages += c->messages();
+    for (auto &c : net_clients)
+      summary.bytes += c->bytes_read();
+    summary.metrics = snapshot();
+    if (exporter)
+      exporter->update(summary.account, summary.metrics);
+  };
+  auto finished = [&clients]() {
+    return all_of(clients.begin(), clients.end(),
+        [](const unique_ptr<IMAP::Copy::Client> &c) { return c->finished(); });
+  };
+  boost::asio::basic_waitable_timer<chrono::steady_clock>
+    metrics_timer(io_service);
+  function<void(void)> export_metrics = [&]() {
+    metrics_timer.expires_from_now(chrono::seconds(opts.metrics_interval));
+    metrics_timer.async_wait([&](const boost::system::error_code &ec) {
+        if (ec)
+          return;
+        exporter->update(summary.account, snapshot());
+        exporter->write();
+        export_metrics();
+      });
+  };
+  try {
+    if (exporter && opts.metrics_interval) {
+      export_metrics();
+      // the pending timer would delay the exit otherwise
+      while (io_service.run_one())
+        if (finished())
+          metrics_timer.cancel();
+    } else {
+      io_service.run();
+    }
+  } catch (...) {
+    collect();
+    throw;
+  }
+  collect();
+}
+
+static void log_exception(const exception &e,
+    boost::log::sources::severity_logger<Log::Severity> &lg)
+{
+  LOG_SEV(lg, Log::ERROR) << e.what();
+
+  auto tfu = boost::get_error_info<boost::throw_function>(e);
+  auto tfi = boost::get_error_info<boost::throw_file>(e);
+  auto tl  = boost::get_error_info<boost::throw_line>(e);
+  LOG_SEV(lg, Log::DEBUG) << "in "
+    << (tfu?*tfu:"") << " (" << (tfi?*tfi:"") << ':' << (tl?*tl:0) << ")"
+    ;
+  auto si = boost::get_error_info<boost::log::current_scope_info>(e);
+  if (si)
+    LOG_SEV(lg, Log::DEBUG) << "Scope stack: " << *si;
+
+  //LOG_SEV(lg, Log::ERROR) << boost::diagnostic_information(e);
+}
+
+// daemon mode: reconnect delay in seconds, doubled after each failure
+static const unsigned backoff_min = 1;
+static const unsigned backoff_max = 300;
+
+// returns false on error
+static bool run_account(const Options &opts, Setup &setup,
+    boost::log::sources::severity_logger<Log::Severity> &lg,
+    Summary &summary, Metrics::Exporter *exporter)
+{
+  auto begin = chrono::steady_clock::now();
+  unsigned backoff = backoff_min;
+  for (;;) {
+    auto start = chrono::steady_clock::now();
+    try {
+      run(opts, setup, lg, summary, exporter);
+      break;
+    } catch (const exception &e) {
+      log_exception(e, lg);
+      summary.error = e.what();
+      if (opts.task != Task::DAEMON) {
+        summary.seconds = chrono::duration<double>(
+            chrono::steady_clock::now() - begin).count();
+        return false;
+      }
+    }
+    // a session that was up for a while counts as success
+    if (chrono::steady_clock::now() - start > chrono::seconds(backoff_max))
+      backoff = backoff_min;
+    LOG_SEV(lg, Log::MSG) << "Reconnecting in " << backoff << " s ...";
+    this_thread::sleep_for(chrono::seconds(backoff));
+    backoff = min(2 * backoff, backoff_max);
+  }
+  summary.error.clear();
+  summary.seconds = chrono::duration<double>(
+      chrono::steady_clock::now() - begin).count();
+  return true;
+}
+
+// Each worker thread processes one account at a time with its own
+// io_service - thus, the handlers of a client never run concurrently.
+static bool run_accounts(int argc, char **argv, const Options &opts,
+    boost::log::sources::severity_logger<Log::Severity> &lg,
+    Metrics::Exporter *exporter)
+{
+  vector<string> accounts(opts.account_names());
+  vector<Summary> summaries(accounts.size());
+  Setup setup;
+  atomic<size_t> next {0};
+
+  auto worker = [&]() {
+    // logger sources aren't thread-safe, the sinks are
+    boost::log::sources::severity_logger<Log::Severity> wlg(lg);
+    for (;;) {
+      size_t i = next++;
+      if (i >= accounts.size())
+        break;
+      Summary &s = summaries[i];
+      s.account = accounts[i];
+      try {
+        Options o(argc, argv, accounts[i]);
+        LOG_SEV(wlg, Log::MSG) << "Account " << s.account
+          << ": starting (" << o.username << '@' << o.host << ')';
+        run_account(o, setup, wlg, s, exporter);
+      } catch (const exception &e) {
+        log_exception(e, wlg);
+        s.error = e.what();
+      }
+    }
+  };
+  unsigned n = min(size_t(opts.concurrency), accounts.size());
+  LOG_SEV(lg, Log::MSG) << "Processing " << accounts.size()
+    << " accounts (concurrency: " << n << ')';
+  vector<thread> threads;
+  for (unsigned i = 0; i < n; ++i)
+    threads.emplace_back(worker);
+  for (auto &t : threads)
+    t.join();
+  if (exporter)
+    exporter->write();
+
+  size_t failed = 0, messages = 0, bytes = 0;
+  for (auto &s : summaries) {
+    if (s.error.empty())
+      LOG_SEV(lg, Log::MSG) << "Account " << s.account << ": "
+        << s.messages << " messages, " << s.bytes << " bytes in "
+        << s.seconds << " s";
+    else
+      LOG_SEV(lg, Log::ERROR) << "Account " << s.account
+        << ": failed after " << s.messages << " messages - " << s.error;
+    failed += !s.error.empty();
+    messages += s.messages;
+    bytes += s.bytes;
+  }
+  LOG_SEV(lg, Log::MSG) << "Total: " << accounts.size() << " accounts ("
+    << failed << " failed), " << messages << " messages, " << bytes
+    << " bytes";
+  return !failed;
+}
+
 int main(int argc, char **argv)
 {
   try {
@@ -42,48 +278,28 @@ int main(int argc, char **argv)
     boost::log::sources::severity_logger<Log::Severity> lg(Log::create(
             static_cast<Log::Severity>(opts.severity),
             static_cast<Log::Severity>(opts.file_severity),
-            opts.logfile));
+            opts.logfile, opts.log_async));
 
-    try {
-      BOOST_LOG(lg) << "Startup.";
-      BOOST_LOG(lg) << "Username: |" << opts.username << "|";
-      BOOST_LOG_SEV(lg, Log::INSANE) << "Password: |" << opts.password << "|";
-      BOOST_LOG(lg) << "Parsing options ... done";
-
-      boost::asio::io_service io_service;
-      boost::asio::ssl::context context(boost::asio::ssl::context::sslv23);
-
-      unique_ptr<Net::Client::Base> net_client;
-      if (opts.use_ssl) {
-        unique_ptr<Net::Client::Base> c(
-            new Net::TCP::SSL::Client::Base(io_service, context, opts, lg));
-        net_client = std::move(c);
-      } else {
-        unique_ptr<Net::Client::Base> c(
-            new Net::TCP::Client::Base(io_service, opts, lg));
-        net_client = std::move(c);
-      }
-      IMAP::Copy::Client client(opts, *net_client, lg);
-
-      io_service.run();
-    } catch (const exception &e) {
-      BOOST_LOG_SEV(lg, Log::ERROR) << e.what();
-
-      auto tfu = boost::get_error_info<boost::throw_function>(e);
-      auto tfi = boost::get_error_info<boost::throw_file>(e);
-      auto tl  = boost::get_error_info<boost::throw_line>(e);
-      BOOST_LOG_SEV(lg, Log::DEBUG) << "in "
-        << (tfu?*tfu:"") << " (" << (tfi?*tfi:"") << ':' << (tl?*tl:0) << ")"
-        ;
-      auto si = boost::get_error_info<boost::log::current_scope_info>(e);
-      if (si)
-        BOOST_LOG_SEV(lg, Log::DEBUG) << "Scope stack: " << *si;
-
-      //BOOST_LOG_SEV(lg, Log::ERROR) << boost::diagnostic_information(e);
+    BOOST_LOG(lg) << "Startup.";
+    unique_ptr<Metrics::Exporter> exporter;
+    if (!opts.metrics_file.empty())
+      exporter.reset(new Metrics::Exporter(opts.metrics_file));
+    if (opts.multi_account())
+      return run_accounts(argc, argv, opts, lg, exporter.get()) ? 0 : 1;
+    BOOST_LOG(lg) << "Username: |" << opts.username << "|";
+    LOG_SEV(lg, Log::INSANE) << "Password: |" << opts.password << "|";
+    BOOST_LOG(lg) << "Parsing options ... done";
 
+    Setup setup;
+    Summary summary;
+    summary.account = opts.account.empty() ? string("default") : opts.account;
+    bool ok = run_account(opts, setup, lg, summary, exporter.get());
+    if (exporter)
+      exporter->write();
+    if (!ok)
       return 1;
-    }
   } catch (const exception &e) {
+    Log::flush();
     cerr << "Error: " << e.what() << '\n';
     return 1;
   }
@@ -66,9 +66,15 @@ namespace OPT {
   static const char CA_PATH[]        = "ca_path"       ;
   static const char CERT_HOST[]      = "cert_host"     ;
   static const char TLS1[]           = "tls1"          ;
+  static const char TLS_RESUME[]     = "tls_resume"    ;
+  static const char SESSION_CACHE[]  = "tls_session"   ;
 
   static const char TRACEFILE[]      = "trace"         ;
+  static const char TRACE_FORMAT[]   = "trace_format"  ;
   static const char LOGFILE[]        = "log"           ;
+  static const char LOG_ASYNC[]      = "log_async"     ;
+  static const char METRICS[]        = "metrics"       ;
+  static const char METRICS_INTERVAL[] = "metrics_interval";
 //  static const char SEVERITY[]       = "verbose"       ;
   static const char SEVERITY_S[]     = "verbose,v"     ;
   static const char FILE_SEVERITY[]  = "log_v"         ;
@@ -76,6 +82,9 @@ namespace OPT {
   static const char CONFIGFILE[]     = "config"        ;
 
   static const char ACCOUNT[]        = "account"       ;
+  static const char ACCOUNTS[]       = "accounts"      ;
+  static const char ALL_ACCOUNTS[]   = "all_accounts"  ;
+  static const char CONCURRENCY[]    = "concurrency"   ;
 //  static const char DELETE[]         = "delete"        ;
   static const char DELETE_S[]       = "delete,d"      ;
   static const char MAILBOX[]        = "mailbox"       ;
@@ -87,6 +96,22 @@ namespace OPT {
   static const char LIST[]           = "list"          ;
   static const char LIST_REFERENCE[] = "list_reference";
   static const char LIST_MAILBOX[]   = "list_mailbox"  ;
+  static const char CONNECTIONS[]    = "connections"   ;
+  static const char PIPELINE[]       = "pipeline"      ;
+  static const char INCREMENTAL[]    = "incremental"   ;
+  static const char SYNC_FILE[]      = "sync_state"    ;
+  static const char COMPRESS[]       = "compress"      ;
+  static const char COMMIT_BATCH[]   = "commit_batch"  ;
+  static const char COMMIT_INTERVAL[] = "commit_interval";
+  static const char APPEND_JOURNAL[] = "append_journal";
+  static const char PARTIAL_THRESHOLD[] = "partial_threshold";
+  static const char PARTIAL_CHUNK[]  = "partial_chunk" ;
+  static const char READ_BUFFER[]    = "read_buffer"   ;
+  static const char DAEMON[]         = "daemon"        ;
+  static const char SYNC[]           = "sync"          ;
+  static const char IDLE_INTERVAL[]  = "idle_interval" ;
+  static const char POLL_INTERVAL[]  = "poll_interval" ;
+  static const char EXPUNGE_INTERVAL[] = "expunge_interval";
 }
 
 namespace KEY {
@@ -107,11 +132,28 @@ namespace KEY {
   static const char CA_PATH[]       = "ca_path"       ;
   static const char CERT_HOST[]     = "cert_host"     ;
   static const char TLS1[]          = "tls1"          ;
+  static const char TLS_RESUME[]    = "tls_resume"    ;
+  static const char SESSION_CACHE[] = "tls_session"   ;
 
   static const char DELETE[]        = "delete"        ;
   static const char MAILBOX[]       = "mailbox"       ;
   static const char MAILDIR[]       = "maildir"       ;
   static const char JOURNAL_FILE[]   = "journal"       ;
+  static const char CONNECTIONS[]   = "connections"   ;
+  static const char PIPELINE[]      = "pipeline"      ;
+  static const char INCREMENTAL[]   = "incremental"   ;
+  static const char SYNC_FILE[]     = "sync_state"    ;
+  static const char COMPRESS[]      = "compress"      ;
+  static const char COMMIT_BATCH[]  = "commit_batch"  ;
+  static const char COMMIT_INTERVAL[] = "commit_interval";
+  static const char APPEND_JOURNAL[] = "append_journal";
+  static const char PARTIAL_THRESHOLD[] = "partial_threshold";
+  static const char PARTIAL_CHUNK[] = "partial_chunk" ;
+  static const char READ_BUFFER[]   = "read_buffer"   ;
+  static const char IDLE_INTERVAL[] = "idle_interval" ;
+  static const char SYNC[]          = "sync"          ;
+  static const char POLL_INTERVAL[] = "poll_interval" ;
+  static const char EXPUNGE_INTERVAL[] = "expunge_interval";
 
   static const unordered_set<const char*> set = {
     USERNAME,
@@ -130,11 +172,28 @@ namespace KEY {
     CA_PATH,
     CERT_HOST,
     TLS1,
+    TLS_RESUME,
+    SESSION_CACHE,
 
     DELETE,
     MAILBOX,
     MAILDIR,
-    JOURNAL_FILE
+    JOURNAL_FILE,
+    CONNECTIONS,
+    PIPELINE,
+    INCREMENTAL,
+    SYNC_FILE,
+    COMPRESS,
+    COMMIT_BATCH,
+    COMMIT_INTERVAL,
+    APPEND_JOURNAL,
+    PARTIAL_THRESHOLD,
+    PARTIAL_CHUNK,
+    READ_BUFFER,
+    IDLE_INTERVAL,
+    SYNC,
+    POLL_INTERVAL,
+    EXPUNGE_INTERVAL
   };
 }
 
@@ -156,6 +215,22 @@ namespace IMAP {
         ;
     }
 
+    static vector<string> split_accounts(const string &s)
+    {
+      vector<string> r;
+      size_t b = 0;
+      for (;;) {
+        size_t e = s.find(',', b);
+        string a(s.substr(b, e == string::npos ? e : e - b));
+        if (!a.empty())
+          r.push_back(std::move(a));
+        if (e == string::npos)
+          break;
+        b = e + 1;
+      }
+      return r;
+    }
+
     class Options_Priv : public Options {
       private:
         void add_general_opts(po::options_description &general_group);
@@ -170,6 +245,14 @@ namespace IMAP {
 
 
     Options::Options(int argc, char **argv)
+    {
+      init(argc, argv, nullptr);
+    }
+    Options::Options(int argc, char **argv, const std::string &account)
+    {
+      init(argc, argv, &account);
+    }
+    void Options::init(int argc, char **argv, const std::string *account_name)
     {
       po::options_description hidden_group;
       //hidden_group.add_options()
@@ -199,10 +282,33 @@ namespace IMAP {
       }
       if (vm.count(OPT::CONFIGFILE))
         configfile = vm[OPT::CONFIGFILE].as<string>();
-      if (vm.count(OPT::ACCOUNT))
-        account = vm[OPT::ACCOUNT].as<string>();
+      if (account_name) {
+        account = *account_name;
+      } else {
+        if (vm.count(OPT::ACCOUNT))
+          account = vm[OPT::ACCOUNT].as<string>();
+        if (vm.count(OPT::ACCOUNTS) || (vm.count(OPT::ALL_ACCOUNTS)
+              && vm[OPT::ALL_ACCOUNTS].as<bool>())) {
+          // the accounts are loaded one by one via Options(argc, argv, account)
+          check_configfile();
+          po::notify(vm);
+          if (vm.count(OPT::ACCOUNTS))
+            accounts = split_accounts(vm[OPT::ACCOUNTS].as<string>());
+          if (!multi_account())
+            throw runtime_error("No accounts selected");
+          if (!concurrency)
+            throw runtime_error("Concurrency must be at least 1");
+          return;
+        }
+      }
       load();
       po::notify(vm);
+      if (account_name) {
+        all_accounts = false;
+        // the trace files of the accounts would clash otherwise
+        if (!tracefile.empty())
+          tracefile += "." + account;
+      }
 
       fix();
       verify();
@@ -238,8 +344,21 @@ namespace IMAP {
         (OPT::HELP_S, "this help screen")
         (OPT::TRACEFILE, po::value<string>(&tracefile)->default_value(""),
            "trace file for capturing send/received messages")
+        (OPT::TRACE_FORMAT, po::value<Trace::Format>(&trace_format)
+           ->default_value(Trace::Format::TEXT),
+           "trace file format: text, binary or deflate - binary traces "
+           "are converted with `replay TRACE --convert OUT text`")
         (OPT::LOGFILE, po::value<string>(&logfile)->default_value(""),
            "also write log messages to a file")
+        (OPT::LOG_ASYNC, po::value<bool>(&log_async)
+           ->default_value(false, "false")
+           ->implicit_value(true, "true"),
+           "format and write log messages in a background thread")
+        (OPT::METRICS, po::value<string>(&metrics_file)->default_value(""),
+           "write latency histograms and counters as JSON to a file at exit")
+        (OPT::METRICS_INTERVAL, po::value<unsigned>(&metrics_interval)
+           ->default_value(0, "only at exit"),
+           "also write the metrics file every n seconds")
         (OPT::SEVERITY_S,
          po::value<unsigned>(&severity)
            ->default_value(4)
@@ -268,6 +387,10 @@ namespace IMAP {
            //->default_value("", "imaps or imap"),
            , "remote service name or port - usually imaps=993 (SSL) and imap=143"
            " (default: imaps or imap)")
+        (OPT::READ_BUFFER, po::value<unsigned>(&read_buffer_max)
+           //->default_value(262144),
+           , "maximal size of the read buffer in bytes - it grows while "
+             "reads fill it completely (default: 262144)")
         ;
     }
     void Options_Priv::add_ssl_opts(po::options_description &ssl_group)
@@ -303,6 +426,14 @@ namespace IMAP {
            ->implicit_value(true, "true"),
            "enable/disable use of TLSv1 - disabling means that only TLSv1.1/TLSv1.2 "
            "are allowed. (default: true)")
+        (OPT::TLS_RESUME, po::value<bool>(&tls_resume)
+           //->default_value(true, "true")
+           ->implicit_value(true, "true"),
+           "resume the TLS session of the previous run - saves a full "
+           "handshake (default: true)")
+        (OPT::SESSION_CACHE, po::value<string>(&session_cache)
+         ->default_value("", "$HOME/.config/"  + string(ID::argv0) + "/$ACCOUNT.tls"),
+           "where the TLS session is cached for resumption")
         ;
     }
     void Options_Priv::add_test_opts(po::options_description &test_group)
@@ -319,6 +450,16 @@ namespace IMAP {
       imap_group.add_options()
         (OPT::ACCOUNT, po::value<string>(&account)->default_value("default"),
            "account name - is used to find section in configuration file")
+        (OPT::ACCOUNTS, po::value<string>()->value_name("LIST"),
+           "comma separated list of accounts that are processed "
+           "concurrently in this process")
+        (OPT::ALL_ACCOUNTS, po::value<bool>(&all_accounts)
+           //->default_value(false, "false")
+           ->implicit_value(true, "true"),
+           "process all accounts of the configuration file (default: false)")
+        (OPT::CONCURRENCY, po::value<unsigned>(&concurrency)
+           ->default_value(4),
+           "maximal number of accounts that are processed at the same time")
         (OPT::CONFIGFILE,
            po::value<string>(&configfile)
            ->default_value("", "$HOME/.config/" + string(ID::argv0) + "/rc.json"),
@@ -355,11 +496,76 @@ namespace IMAP {
          ->default_value(false, "false")
          ->implicit_value(true, "true")
          , "execute IMAP LIST on the server (without fetching anything)")
+        (OPT::DAEMON, po::value<bool>(&daemon)
+         ->default_value(false, "false")
+         ->implicit_value(true, "true")
+         , "keep the session open and fetch new messages as soon as they "
+           "arrive (via IDLE) - reconnects on errors")
+        (OPT::SYNC, po::value<bool>(&sync)
+           //->default_value(false, "false")
+           ->implicit_value(true, "true"),
+           "download all mailboxes (matched by --list_mailbox) into Maildir++ "
+           "subfolders - only mailboxes whose UIDNEXT changed since the last "
+           "run are selected, implies --incremental (default: false)")
+        (OPT::IDLE_INTERVAL, po::value<unsigned>(&idle_interval)
+           //->default_value(1740),
+           , "daemon mode: re-issue IDLE after that many seconds "
+             "(default: 1740)")
+        (OPT::POLL_INTERVAL, po::value<unsigned>(&poll_interval)
+           //->default_value(60),
+           , "daemon mode: check for new messages (via NOOP) after that many "
+             "seconds if the server doesn't support IDLE (default: 60)")
+        (OPT::EXPUNGE_INTERVAL, po::value<unsigned>(&expunge_interval)
+           //->default_value(60),
+           , "daemon mode: expunge fetched messages in batches at most "
+             "every that many seconds (default: 60)")
         (OPT::LIST_REFERENCE, po::value<string>(&list_reference)
          , "LIST reference argument")
         (OPT::LIST_MAILBOX, po::value<string>(&list_mailbox)
-         ->default_value("%")
-         , "LIST mailbox argument")
+         //->default_value("%")
+         , "LIST mailbox argument (default: % - with --sync: *)")
+        (OPT::CONNECTIONS, po::value<unsigned>(&connections)
+           //->default_value(1),
+           , "number of parallel connections for downloading - each one fetches "
+             "a disjoint UID range (default: 1)")
+        (OPT::PIPELINE, po::value<unsigned>(&pipeline)
+           //->default_value(1),
+           , "maximal number of IMAP commands in flight - greater than 1 "
+             "saves round trips on high latency links (default: 1)")
+        (OPT::INCREMENTAL, po::value<bool>(&incremental)
+           //->default_value(false, "false")
+           ->implicit_value(true, "true"),
+           "only fetch messages that are new since the last run - uses "
+           "UIDNEXT and CONDSTORE (if available) (default: false)")
+        (OPT::SYNC_FILE, po::value<string>(&sync_file)
+         ->default_value("", "$HOME/.config/"  + string(ID::argv0) + "/$ACCOUNT.sync"),
+           "where the state for incremental fetching is stored")
+        (OPT::COMPRESS, po::value<bool>(&compress)
+           //->default_value(false, "false")
+           ->implicit_value(true, "true"),
+           "use COMPRESS=DEFLATE (RFC4978) if the server supports it "
+           "(default: false)")
+        (OPT::COMMIT_BATCH, po::value<unsigned>(&commit_batch)
+           //->default_value(1),
+           , "make delivered messages durable in batches of up to N messages "
+             "- i.e. one directory fsync per batch (default: 1)")
+        (OPT::COMMIT_INTERVAL, po::value<unsigned>(&commit_interval)
+           //->default_value(1000),
+           , "maximal age of a batch in milliseconds (default: 1000)")
+        (OPT::APPEND_JOURNAL, po::value<bool>(&append_journal)
+           //->default_value(false, "false")
+           ->implicit_value(true, "true"),
+           "append the UIDs of delivered messages to a binary journal as "
+           "soon as they are durable - instead of writing the journal "
+           "on exit (default: false)")
+        (OPT::PARTIAL_THRESHOLD, po::value<unsigned>(&partial_threshold)
+           //->default_value(0),
+           , "fetch messages larger than N bytes in chunks - an interrupted "
+             "download is resumed by the next run - 0 disables it "
+             "(default: 0)")
+        (OPT::PARTIAL_CHUNK, po::value<unsigned>(&partial_chunk)
+           //->default_value(4194304),
+           , "chunk size in bytes for partial fetches (default: 4194304)")
         ;
     }
 
@@ -387,10 +593,34 @@ namespace IMAP {
           << account << ".journal";
         journal_file = o.str();
       }
+      if (sync_file.empty()) {
+        fs::path p(journal_file);
+        p.remove_filename();
+        p /= account + ".sync";
+        sync_file = p.string();
+      }
+      if (!use_ssl || !tls_resume)
+        session_cache.clear();
+      else if (session_cache.empty()) {
+        fs::path p(journal_file);
+        p.remove_filename();
+        p /= account + ".tls";
+        session_cache = p.string();
+      }
       if (fetch_header_only)
         task = Task::FETCH_HEADER;
       if (list)
         task = Task::LIST;
+      if (daemon)
+        task = Task::DAEMON;
+      if (sync) {
+        task = Task::SYNC;
+        incremental = true;
+      }
+      if (list_mailbox.empty())
+        list_mailbox = task == Task::SYNC ? "*" : "%";
+      if (task != Task::DOWNLOAD)
+        connections = 1;
     }
     void Options::verify()
     {
@@ -398,6 +628,59 @@ namespace IMAP {
         throw runtime_error("No host specified on the command line/in the rc file");
       if (maildir.empty())
         throw runtime_error("No maildir specified on the command line/in the rc file");
+      if (!connections)
+        throw runtime_error("At least one connection is needed");
+      if (!pipeline)
+        throw runtime_error("Pipeline depth must be at least 1");
+      if (!commit_batch)
+        throw runtime_error("Commit batch size must be at least 1");
+      if (partial_chunk < 1024)
+        throw runtime_error("Partial chunk size must be at least 1024 bytes");
+      if (read_buffer_max < 4096)
+        throw runtime_error("Read buffer size must be at least 4096 bytes");
+      if (daemon && sync)
+        throw runtime_error("Daemon mode and sync mode are mutually exclusive");
+      if (daemon && connections > 1)
+        throw runtime_error("Daemon mode with several connections "
+            "is not supported");
+      if (!idle_interval || !poll_interval)
+        throw runtime_error("IDLE/poll interval must be at least 1 second");
+      if (incremental && connections > 1)
+        throw runtime_error("Incremental fetching with several connections "
+            "is not supported");
+    }
+    bool Options::multi_account() const
+    {
+      return all_accounts || !accounts.empty();
+    }
+    std::vector<std::string> Options::account_names() const
+    {
+      if (!all_accounts)
+        return accounts;
+      boost::property_tree::ptree pt;
+      boost::property_tree::json_parser::read_json(configfile, pt);
+      vector<string> r;
+      for (auto &i : pt) {
+        if (i.first.find("_comment") == 0)
+          continue;
+        r.push_back(i.first);
+      }
+      return r;
+    }
+    Options Options::for_connection(unsigned i) const
+    {
+      Options r(*this);
+      r.connection = i;
+      if (i) {
+        // each connection has its own journal (and trace) ...
+        string suffix("." + std::to_string(i));
+        r.journal_file += suffix;
+        if (!r.tracefile.empty())
+          r.tracefile += suffix;
+        if (!r.session_cache.empty())
+          r.session_cache += suffix;
+      }
+      return r;
     }
 
     static const char default_rc_file[] =
@@ -512,6 +795,7 @@ R"({
       local_port    = sub_tree.get<unsigned short> (KEY::LOCAL_PORT   , 0       );
       host          = sub_tree.get<string>         (KEY::HOST         , ""      );
       service       = sub_tree.get<string>         (KEY::SERVICE      , ""      );
+      read_buffer_max = sub_tree.get<unsigned>     (KEY::READ_BUFFER  , 262144  );
 
       use_ssl       = sub_tree.get<bool>           (KEY::SSL          , true    );
       fingerprint   = sub_tree.get<string>         (KEY::FINGERPRINT  , ""      );
@@ -521,11 +805,27 @@ R"({
       ca_path       = sub_tree.get<string>         (KEY::CA_PATH      , ""      );
       cert_host     = sub_tree.get<string>         (KEY::CERT_HOST    , ""      );
       tls1          = sub_tree.get<bool>           (KEY::TLS1         , true    );
+      tls_resume    = sub_tree.get<bool>           (KEY::TLS_RESUME   , true    );
+      session_cache = sub_tree.get<string>         (KEY::SESSION_CACHE, ""      );
 
       del           = sub_tree.get<bool>           (KEY::DELETE       , false   );
       mailbox       = sub_tree.get<string>         (KEY::MAILBOX      , "INBOX" );
       maildir       = sub_tree.get<string>         (KEY::MAILDIR      , ""      );
       journal_file  = sub_tree.get<string>         (KEY::JOURNAL_FILE , ""      );
+      connections   = sub_tree.get<unsigned>       (KEY::CONNECTIONS  , 1       );
+      pipeline      = sub_tree.get<unsigned>       (KEY::PIPELINE     , 1       );
+      incremental   = sub_tree.get<bool>           (KEY::INCREMENTAL  , false   );
+      sync_file     = sub_tree.get<string>         (KEY::SYNC_FILE    , ""      );
+      compress      = sub_tree.get<bool>           (KEY::COMPRESS     , false   );
+      commit_batch  = sub_tree.get<unsigned>       (KEY::COMMIT_BATCH , 1       );
+      commit_interval = sub_tree.get<unsigned>     (KEY::COMMIT_INTERVAL, 1000  );
+      append_journal = sub_tree.get<bool>          (KEY::APPEND_JOURNAL, false  );
+      partial_threshold = sub_tree.get<unsigned>   (KEY::PARTIAL_THRESHOLD, 0   );
+      partial_chunk = sub_tree.get<unsigned>       (KEY::PARTIAL_CHUNK, 4194304 );
+      sync          = sub_tree.get<bool>           (KEY::SYNC         , false   );
+      idle_interval = sub_tree.get<unsigned>       (KEY::IDLE_INTERVAL, 1740    );
+      poll_interval = sub_tree.get<unsigned>       (KEY::POLL_INTERVAL, 60      );
+      expunge_interval = sub_tree.get<unsigned>    (KEY::EXPUNGE_INTERVAL, 60   );
     }
     std::ostream &Options::print(std::ostream &o) const
     {
@@ -25,6 +25,7 @@
 
 #include <string>
 #include <ostream>
+#include <vector>
 
 namespace IMAP {
   namespace Copy {
@@ -33,21 +34,44 @@ namespace IMAP {
       DOWNLOAD,
       FETCH_HEADER,
       LIST,
+      // IDLE until new messages arrive
+      DAEMON,
+      // all mailboxes into Maildir++ subfolders
+      SYNC,
       LAST_
     };
     class Options : public Net::TCP::SSL::Client::Options {
+      private:
+        void init(int argc, char **argv, const std::string *account);
       public:
         Options();
         Options(int argc, char **argv);
+        // options of one account in multi-account mode - i.e. the
+        // command line overwrites the values from the rc file
+        Options(int argc, char **argv, const std::string &account);
         void fix();
         void verify();
         void check_configfile();
         void load();
+        Options for_connection(unsigned i) const;
+        bool multi_account() const;
+        // selected accounts or all accounts of the rc file
+        std::vector<std::string> account_names() const;
         std::ostream &print(std::ostream &o) const;
 
         std::string logfile;
+        bool        log_async      {false};
+        // JSON metrics export
+        std::string metrics_file;
+        unsigned    metrics_interval {0};
         bool        use_ssl        {true};
+        bool        tls_resume     {true};
         std::string account;
+        // multi-account mode
+        std::vector<std::string> accounts;
+        bool        all_accounts   {false};
+        // maximal number of accounts that are processed at the same time
+        unsigned    concurrency    {4};
         std::string configfile;
         std::string mailbox;
         std::string maildir;
@@ -57,10 +81,30 @@ namespace IMAP {
         unsigned    greeting_wait  {100};
         unsigned    simulate_error {0};
         std::string journal_file;
+        bool        append_journal {false};
         bool        fetch_header_only {true};
         bool        list           {true};
+        bool        daemon         {false};
+        bool        sync           {false};
+        // daemon mode, in seconds
+        unsigned    idle_interval  {1740};
+        unsigned    poll_interval  {60};
+        unsigned    expunge_interval {60};
         std::string list_reference;
         std::string list_mailbox;
+        unsigned    connections    {1};
+        unsigned    pipeline       {1};
+        bool        incremental    {false};
+        std::string sync_file;
+        bool        compress       {false};
+        // group commit of maildir deliveries
+        unsigned    commit_batch   {1};
+        unsigned    commit_interval {1000};
+        // chunked fetching of large messages (0 -> disabled)
+        unsigned    partial_threshold {0};
+        unsigned    partial_chunk  {4194304};
+        // index of the connection (when downloading with several connections)
+        unsigned    connection     {0};
 
         Task        task           {Task::DOWNLOAD};
 
@@ -34,10 +34,12 @@ namespace IMAP {
       LOGGED_IN,
       GOT_CAPABILITIES,
       SELECTED_MAILBOX,
+      FETCHING_SIZES,
       FETCHING,
       FETCHED,
       STORED,
       EXPUNGED,
+      IDLING,
       LOGGING_OUT,
       LOGGED_OUT,
       END,
@@ -0,0 +1,87 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "sync_state.h"
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/map.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/utility.hpp>
+#include <boost/serialization/tracking.hpp>
+
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+#include <fstream>
+using namespace std;
+
+namespace boost {
+  namespace serialization {
+
+    template<class Archive>
+      void serialize(Archive & a, IMAP::Copy::Sync_State::Mailbox &d,
+          const unsigned int /* version */)
+      {
+        a & d.uidvalidity_;
+        a & d.last_uid_;
+        a & d.highestmodseq_;
+      }
+    template<class Archive>
+      void serialize(Archive & a, IMAP::Copy::Sync_State &d,
+          const unsigned int /* version */)
+      {
+        a & d.mailboxes_;
+      }
+
+  }
+}
+BOOST_CLASS_TRACKING(IMAP::Copy::Sync_State, boost::serialization::track_never)
+BOOST_CLASS_TRACKING(IMAP::Copy::Sync_State::Mailbox,
+    boost::serialization::track_never)
+
+namespace IMAP {
+  namespace Copy {
+
+    void Sync_State::read(const std::string &filename)
+    {
+      ifstream f;
+      f.exceptions(ifstream::failbit | ifstream::badbit );
+      f.open(filename, ifstream::in | ifstream::binary);
+      boost::archive::text_iarchive a(f);
+      a >> *this;
+    }
+    void Sync_State::write(const std::string &filename) const
+    {
+      // write to a temporary file and rename it such that
+      // the old state survives an interrupted write
+      string tmp(filename + ".tmp");
+      {
+        ofstream f;
+        f.exceptions(ofstream::failbit | ofstream::badbit );
+        f.open(tmp, ofstream::out | ofstream::binary);
+        boost::archive::text_oarchive a(f);
+        a << *this;
+      }
+      fs::rename(tmp, filename);
+    }
+
+  }
+}
@@ -0,0 +1,50 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef IMAP_COPY_SYNC_STATE_H
+#define IMAP_COPY_SYNC_STATE_H
+
+#include <string>
+#include <map>
+#include <stdint.h>
+
+namespace IMAP {
+  namespace Copy {
+
+    // What was already downloaded from a mailbox - used for
+    // incremental fetching, i.e. without --delete
+    struct Sync_State {
+      struct Mailbox {
+        uint32_t uidvalidity_   {0};
+        // all messages with smaller or equal UIDs were fetched
+        uint32_t last_uid_      {0};
+        // RFC7162 CONDSTORE, 0 if the server doesn't support it
+        uint64_t highestmodseq_ {0};
+      };
+      std::map<std::string, Mailbox> mailboxes_;
+
+      void read(const std::string &filename);
+      void write(const std::string &filename) const;
+    };
+
+  }
+}
+
+#endif
@@ -0,0 +1,101 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "tmp_file.h"
+
+#include <ixxx/ixxx.h>
+
+#include <utility>
+
+#include <fcntl.h>
+
+namespace IMAP {
+  namespace Copy {
+
+    Tmp_File::Tmp_File()
+    {
+    }
+    Tmp_File::Tmp_File(int dir_fd, const std::string &filename)
+      :
+        fd_(ixxx::posix::openat(dir_fd, filename,
+              O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666))
+    {
+    }
+    Tmp_File::~Tmp_File()
+    {
+      try {
+        close();
+      } catch (...) {
+      }
+    }
+    Tmp_File::Tmp_File(Tmp_File &&o)
+      :
+        fd_(o.fd_),
+        begin_(o.begin_)
+    {
+      o.fd_ = -1;
+    }
+    Tmp_File &Tmp_File::operator=(Tmp_File &&o)
+    {
+      if (this != &o) {
+        close();
+        std::swap(fd_, o.fd_);
+        begin_ = o.begin_;
+      }
+      return *this;
+    }
+
+    void Tmp_File::write(const char *end)
+    {
+      for (const char *p = begin_; p != end; )
+        p += ixxx::posix::write(fd_, p, end - p);
+      begin_ = nullptr;
+    }
+    void Tmp_File::start(const char *begin)
+    {
+      begin_ = begin;
+    }
+    void Tmp_File::cont(const char *begin)
+    {
+      begin_ = begin;
+    }
+    void Tmp_File::stop(const char *end)
+    {
+      write(end);
+    }
+    void Tmp_File::finish(const char *end)
+    {
+      write(end);
+    }
+    void Tmp_File::clear()
+    {
+    }
+
+    void Tmp_File::close()
+    {
+      if (fd_ < 0)
+        return;
+      int fd = fd_;
+      fd_ = -1;
+      ixxx::posix::close(fd);
+    }
+
+  }
+}
@@ -0,0 +1,62 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef COPY_TMP_FILE_H
+#define COPY_TMP_FILE_H
+
+#include <buffer/buffer.h>
+
+#include <string>
+
+namespace IMAP {
+  namespace Copy {
+
+    // Writes the buffered data to a file in the maildir tmp directory,
+    // like Memory::Buffer::File, but close() doesn't fsync - with
+    // group commit the data is synced once per batch by
+    // Maildir::commit(), before the file is linked into new/cur.
+    class Tmp_File : public Memory::Buffer::Base {
+      private:
+        int         fd_    {-1};
+        const char *begin_ {nullptr};
+
+        void write(const char *end);
+      public:
+        Tmp_File();
+        Tmp_File(int dir_fd, const std::string &filename);
+        ~Tmp_File();
+        Tmp_File(const Tmp_File &) = delete;
+        Tmp_File &operator=(const Tmp_File &) = delete;
+        Tmp_File(Tmp_File &&o);
+        Tmp_File &operator=(Tmp_File &&o);
+
+        void start(const char *begin) override;
+        void cont(const char *begin) override;
+        void stop(const char *end) override;
+        void finish(const char *end) override;
+        void clear() override;
+
+        void close();
+    };
+
+  }
+}
+
+#endif
@@ -0,0 +1,295 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+
+// End-to-end download benchmark.
+//
+// Starts the example server with a synthetic mailbox in a thread and
+// lets the imapdl client download it into a fresh maildir (by default
+// under /dev/shm, thus, the disk is mostly out of the picture).
+// Reported (as JSON) are the wall time, the CPU time of the client
+// thread, the number of read/write syscalls, the context switches
+// and the peak RSS.
+//
+// Options that aren't known to this program are passed to imapdl,
+// e.g.:
+//
+//     $ ./bench_download --messages 10000 --latency 20 --pipeline 4
+//
+// The server certificate and DH parameters default to the ones
+// of the unittests.
+
+#include "server.h"
+
+#include <copy/client.h>
+#include <copy/options.h>
+#include <log/log.h>
+#include <net/ssl_util.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+  struct Bench_Options {
+    Server::Options server;
+    string dir;
+    string source_dir;
+    bool keep {false};
+    vector<string> imapdl_args;
+
+    Bench_Options(int argc, char **argv);
+  };
+
+  Bench_Options::Bench_Options(int argc, char **argv)
+  {
+    po::options_description desc("Options");
+    desc.add_options()
+      ("help,h", "this help screen")
+      ("messages", po::value<unsigned>(&server.synthetic.messages)
+         ->default_value(1000), "number of messages in the mailbox")
+      ("mean_size", po::value<unsigned>(&server.synthetic.mean_size)
+         ->default_value(8 * 1024), "mean message size in bytes")
+      ("large_every", po::value<unsigned>(&server.synthetic.large_every)
+         ->default_value(0), "make every n-th message large - 0 means none")
+      ("large_size", po::value<unsigned>(&server.synthetic.large_size)
+         ->default_value(4 * 1024 * 1024), "size of the large messages")
+      ("latency", po::value<unsigned>(&server.latency)->default_value(0),
+         "server side delay of each response in milliseconds")
+      ("bandwidth", po::value<unsigned>(&server.bandwidth)->default_value(0),
+         "server side bandwidth limit in bytes per second - 0 means unlimited")
+      ("port", po::value<unsigned>(&server.port)->default_value(6667),
+         "local port of the synthetic server")
+      ("tls", po::value<bool>(&server.use_ssl)->default_value(true, "true")
+         ->implicit_value(true, "true")->value_name("bool"),
+         "use TLS between client and server")
+      ("dir", po::value<string>(&dir)->default_value(""),
+         "directory for the maildir and the rc file "
+         "(default: /dev/shm or /tmp)")
+      ("srcdir", po::value<string>(&source_dir)->default_value("."),
+         "source directory - for the unittest certificate")
+      ("keep", po::bool_switch(&keep), "keep the downloaded maildir")
+      ;
+    po::variables_map vm;
+    po::parsed_options parsed = po::command_line_parser(argc, argv)
+      .options(desc).allow_unregistered().run();
+    po::store(parsed, vm);
+    if (vm.count("help")) {
+      cout << "call: " << *argv << " OPTION* [IMAPDL_OPTION*]\n"
+        << desc << '\n';
+      exit(0);
+    }
+    po::notify(vm);
+    imapdl_args = po::collect_unrecognized(parsed.options,
+        po::include_positional);
+
+    if (dir.empty())
+      dir = fs::is_directory("/dev/shm") ? "/dev/shm" : "/tmp";
+    server.use_synthetic = true;
+    server.cipher = Net::SSL::Cipher::default_list(
+        Net::SSL::Cipher::Class::FORWARD);
+    server.key     = source_dir + "/unittest/server.key";
+    server.cert    = source_dir + "/unittest/server.crt";
+    server.dhparam = source_dir + "/unittest/dh2048.pem";
+  }
+
+  // fingerprint of unittest/server.crt
+  static const char fingerprint[] = "ED77CA3CE8B917C3F081FEC35C316E17E7879D35";
+
+  static void write_rc(const string &filename, const Bench_Options &opts,
+      const string &maildir, const string &journal)
+  {
+    ofstream f(filename, ofstream::out | ofstream::trunc);
+    f.exceptions(ofstream::failbit | ofstream::badbit);
+    f << "{\n"
+      << "  \"bench\":\n"
+      << "  {\n"
+      << "    \"username\"    : \"bench\",\n"
+      << "    \"password\"    : \"bench\",\n"
+      << "    \"host\"        : \"localhost\",\n"
+      << "    \"port\"        : \"" << opts.server.port << "\",\n"
+      << "    \"fingerprint\" : \"" << fingerprint << "\",\n"
+      << "    \"maildir\"     : \"" << maildir << "\",\n"
+      << "    \"journal\"     : \"" << journal << "\"\n"
+      << "  }\n"
+      << "}\n";
+  }
+
+  struct Usage {
+    double   cpu_s    {0};
+    uint64_t syscr    {0};
+    uint64_t syscw    {0};
+    long     nvcsw    {0};
+    long     nivcsw   {0};
+  };
+
+  static Usage thread_usage()
+  {
+    Usage u;
+    struct rusage r;
+    if (!getrusage(RUSAGE_THREAD, &r)) {
+      u.cpu_s  = r.ru_utime.tv_sec + r.ru_utime.tv_usec / 1e6
+               + r.ru_stime.tv_sec + r.ru_stime.tv_usec / 1e6;
+      u.nvcsw  = r.ru_nvcsw;
+      u.nivcsw = r.ru_nivcsw;
+    }
+    ifstream f("/proc/thread-self/io");
+    string key;
+    uint64_t value;
+    while (f >> key >> value) {
+      if (key == "syscr:")
+        u.syscr = value;
+      else if (key == "syscw:")
+        u.syscw = value;
+    }
+    return u;
+  }
+
+  static long peak_rss_kb()
+  {
+    struct rusage r;
+    if (getrusage(RUSAGE_SELF, &r))
+      return 0;
+    return r.ru_maxrss;
+  }
+
+  static void count_maildir(const string &maildir,
+      uint64_t &messages, uint64_t &bytes)
+  {
+    messages = 0;
+    bytes = 0;
+    for (auto sub : { "/new", "/cur" }) {
+      fs::path p(maildir + sub);
+      if (!fs::is_directory(p))
+        continue;
+      for (fs::directory_iterator i(p), e; i != e; ++i) {
+        ++messages;
+        bytes += fs::file_size(i->path());
+      }
+    }
+  }
+
+  static void run_client(const Bench_Options &bench, const string &rc,
+      const string &maildir)
+  {
+    vector<string> args = { "imapdl", "--config", rc, "--account", "bench",
+      "--maildir", maildir, "--ssl", bench.server.use_ssl ? "yes" : "no",
+      "-v", "2" };
+    args.insert(args.end(), bench.imapdl_args.begin(),
+        bench.imapdl_args.end());
+    vector<char*> argv;
+    for (auto &a : args)
+      argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+
+    IMAP::Copy::Options opts(argv.size() - 1, argv.data());
+    boost::log::sources::severity_logger<Log::Severity> lg(Log::create(
+          static_cast<Log::Severity>(opts.severity),
+          static_cast<Log::Severity>(opts.file_severity),
+          opts.logfile, opts.log_async));
+    boost::asio::io_service io_service;
+    boost::asio::ssl::context context(boost::asio::ssl::context::sslv23);
+    unique_ptr<Net::Client::Base> net_client;
+    if (opts.use_ssl)
+      net_client.reset(new Net::TCP::SSL::Client::Base(io_service,
+            opts.apply(context), opts, lg));
+    else
+      net_client.reset(new Net::TCP::Client::Base(io_service, opts, lg));
+    IMAP::Copy::Client client(opts, *net_client, lg);
+    io_service.run();
+  }
+
+}
+
+int main(int argc, char **argv)
+{
+  try {
+    Bench_Options bench(argc, argv);
+
+    ostringstream id;
+    id << "imapdl-bench-" << getpid();
+    fs::path base(fs::path(bench.dir) / id.str());
+    fs::create_directories(base);
+    string maildir((base / "maildir").string());
+    string rc((base / "imapdl.rc").string());
+    write_rc(rc, bench, maildir, (base / "bench.journal").string());
+
+    ofstream server_log((base / "server.log").string());
+    boost::asio::io_service server_io;
+    Server::Main server(server_io, bench.server, server_log);
+    thread server_thread([&server_io]{ server_io.run(); });
+
+    Usage before = thread_usage();
+    auto start = chrono::steady_clock::now();
+    run_client(bench, rc, maildir);
+    auto stop = chrono::steady_clock::now();
+    Usage after = thread_usage();
+
+    server_io.stop();
+    server_thread.join();
+
+    uint64_t messages = 0, bytes = 0;
+    count_maildir(maildir, messages, bytes);
+    double wall_s = chrono::duration<double>(stop - start).count();
+
+    cout << "{\n"
+      << "  \"messages\": "        << messages << ",\n"
+      << "  \"bytes\": "           << bytes << ",\n"
+      << "  \"wall_s\": "          << wall_s << ",\n"
+      << "  \"client_cpu_s\": "    << after.cpu_s - before.cpu_s << ",\n"
+      << "  \"mb_per_s\": "        << (wall_s > 0 ? bytes / wall_s / 1e6 : 0)
+                                   << ",\n"
+      << "  \"syscalls_read\": "   << after.syscr - before.syscr << ",\n"
+      << "  \"syscalls_write\": "  << after.syscw - before.syscw << ",\n"
+      << "  \"ctx_switches_voluntary\": "   << after.nvcsw - before.nvcsw
+                                   << ",\n"
+      << "  \"ctx_switches_involuntary\": " << after.nivcsw - before.nivcsw
+                                   << ",\n"
+      << "  \"peak_rss_kb\": "     << peak_rss_kb() << "\n"
+      << "}\n";
+
+    if (!bench.keep)
+      fs::remove_all(base);
+    if (messages != bench.server.synthetic.messages) {
+      cerr << "Downloaded " << messages << " messages, expected "
+        << bench.server.synthetic.messages << '\n';
+      return 1;
+    }
+  } catch (const exception &e) {
+    cerr << "Error: " << e.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,202 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+
+// Benchmark for the Sequence_Set, i.e. building it from UIDs,
+// serializing it into an IMAP command and the set operations.
+//
+// Example:
+//
+//     $ ./bench_sequence_set --uids 1000000 --gap 100
+
+#include <sequence_set.h>
+#include <imap/client_writer.h>
+
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace Bench {
+
+  struct Options {
+    unsigned uids   {1000000};
+    // every n-th UID is missing (0 -> none)
+    unsigned gap    {100};
+    unsigned block  {1000};
+    unsigned repeat {5};
+
+    Options(int argc, char **argv);
+  };
+
+  Options::Options(int argc, char **argv)
+  {
+    po::options_description desc("Options");
+    desc.add_options()
+      ("help,h", "this help screen")
+      ("uids", po::value<unsigned>(&uids)->default_value(1000000),
+       "number of UIDs")
+      ("gap", po::value<unsigned>(&gap)->default_value(100),
+       "every n-th UID is missing (0 -> none)")
+      ("block", po::value<unsigned>(&block)->default_value(1000),
+       "UIDs are pushed in shuffled blocks of this size for the "
+       "unordered measurement")
+      ("repeat", po::value<unsigned>(&repeat)->default_value(5),
+       "repetitions per measurement - the fastest one is reported")
+      ;
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      cout << "Call: " << *argv << " [OPTION..]\n\n" << desc << '\n';
+      exit(0);
+    }
+    po::notify(vm);
+    if (!repeat)
+      throw runtime_error("repeat must be at least 1");
+    if (!block)
+      throw runtime_error("block must be at least 1");
+  }
+
+  static void print_head(ostream &o)
+  {
+    o << left << setw(20) << "operation" << right
+      << setw(12) << "uids" << setw(10) << "ranges"
+      << setw(12) << "ms" << setw(10) << "ns/uid" << '\n';
+  }
+
+  // fn returns the number of ranges of the result
+  static void run(ostream &o, const Options &opts, const string &name,
+      size_t uids, const function<size_t()> &fn)
+  {
+    double best = 0;
+    size_t ranges = 0;
+    for (unsigned r = 0; r < opts.repeat; ++r) {
+      auto start = chrono::steady_clock::now();
+      ranges = fn();
+      auto stop = chrono::steady_clock::now();
+      double s = chrono::duration<double>(stop - start).count();
+      if (!r || s < best)
+        best = s;
+    }
+    o << left << setw(20) << name << right
+      << setw(12) << uids << setw(10) << ranges
+      << fixed << setprecision(3) << setw(12) << best * 1e3
+      << setw(10) << (uids ? best * 1e9 / uids : 0) << '\n';
+  }
+
+}
+
+int main(int argc, char **argv)
+{
+  try {
+    using namespace Bench;
+    Options opts(argc, argv);
+
+    vector<uint32_t> ascending;
+    ascending.reserve(opts.uids);
+    for (uint32_t i = 1; ascending.size() < opts.uids; ++i)
+      if (!opts.gap || i % opts.gap)
+        ascending.push_back(i);
+    vector<uint32_t> shuffled;
+    {
+      vector<size_t> blocks;
+      for (size_t i = 0; i < ascending.size(); i += opts.block)
+        blocks.push_back(i);
+      mt19937 g(23);
+      shuffle(blocks.begin(), blocks.end(), g);
+      shuffled.reserve(ascending.size());
+      for (auto b : blocks)
+        for (size_t i = b; i < min(b + opts.block, ascending.size()); ++i)
+          shuffled.push_back(ascending[i]);
+    }
+
+    Sequence_Set set;
+    for (auto uid : ascending)
+      set.push(uid);
+    // half of it overlaps
+    Sequence_Set other;
+    for (auto uid : ascending)
+      other.push(uid + ascending.back() / 2);
+
+    print_head(cout);
+    run(cout, opts, "push ascending", ascending.size(), [&ascending]() {
+        Sequence_Set s;
+        for (auto uid : ascending)
+          s.push(uid);
+        return s.size();
+        });
+    run(cout, opts, "push shuffled", shuffled.size(), [&shuffled]() {
+        Sequence_Set s;
+        for (auto uid : shuffled)
+          s.push(uid);
+        return s.size();
+        });
+    run(cout, opts, "copy", ascending.size(), [&set]() {
+        vector<pair<uint32_t, uint32_t> > v;
+        set.copy(v);
+        return v.size();
+        });
+    for (auto v : { IMAP::Client::Writer::Verification::NEVER,
+        IMAP::Client::Writer::Verification::ALWAYS }) {
+      run(cout, opts,
+          v == IMAP::Client::Writer::Verification::NEVER
+          ? "uid store" : "uid store verified",
+          ascending.size(), [&set, v]() {
+          IMAP::Client::Tag tag;
+          size_t n = 0;
+          IMAP::Client::Writer writer(tag,
+              [&n](vector<char> &x) { n += x.size(); }, v);
+          string t;
+          writer.login("juser", "secretvery", t);
+          writer.select("INBOX", t);
+          vector<IMAP::Flag> flags;
+          flags.emplace_back(IMAP::Flag::DELETED);
+          writer.uid_store(set.ranges(), flags, t,
+              IMAP::Client::Store_Mode::REPLACE, true);
+          return set.size();
+          });
+    }
+    run(cout, opts, "difference", ascending.size(), [&set, &other]() {
+        Sequence_Set s;
+        s |= set;
+        s -= other;
+        return s.size();
+        });
+    run(cout, opts, "intersection", ascending.size(), [&set, &other]() {
+        Sequence_Set s;
+        s |= set;
+        s &= other;
+        return s.size();
+        });
+  } catch (std::exception &e) {
+    cerr << "Exception: " << e.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -463,11 +463,8 @@ namespace Client {
 
     void Main::start_replay()
     {
-      replayfile_.open(opts_.replayfile, ifstream::in | ifstream::binary);
-      replayfile_.exceptions(ifstream::failbit | ifstream::badbit);
-      unique_ptr<boost::archive::text_iarchive> a(
-          new boost::archive::text_iarchive(replayfile_));
-      iarchive_ = std::move(a);
+      replay_reader_ = unique_ptr<Trace::Reader>(
+          new Trace::Reader(opts_.replayfile));
 
       if (opts_.limit) {
         limit_timer_.expires_from_now(std::chrono::seconds(opts_.limit));
@@ -494,7 +491,7 @@ namespace Client {
     void Main::do_replay()
     {
       Trace::Record r;
-      *iarchive_ >> r;
+      *replay_reader_ >> r;
       timer_.expires_from_now(std::chrono::milliseconds(r.timestamp));
       switch (r.type) {
         case Trace::Type::SENT:
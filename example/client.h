@@ -27,13 +27,14 @@
 #include <array>
 #include <queue>
 #include <vector>
-#include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/signal_set.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/steady_timer.hpp>
 
+#include <trace/trace.h>
+
 namespace Client {
 
   using namespace std;
@@ -91,8 +92,7 @@ namespace Client {
 
       bool use_replay_ { false };
       vector<char> expected_data_;
-      ifstream replayfile_;
-      unique_ptr<boost::archive::text_iarchive> iarchive_;
+      unique_ptr<Trace::Reader> replay_reader_;
       // asio::steady_timer timer_;
       // workaround: boost autodetection of std::chrono
       // does not seem to work in all boost versions
@@ -19,24 +19,21 @@
 
 }}} */
 #include <iostream>
-#include <fstream>
+#include <sstream>
 #include <string>
 using namespace std;
 
-#include <boost/archive/text_iarchive.hpp>
-#include <boost/archive/text_oarchive.hpp>
-
 #include <trace/trace.h>
 
 
 
-static void c_print_server(boost::archive::text_iarchive &iarchive, ostream &o)
+static void c_print_server(Trace::Reader &reader, ostream &o)
 {
   o << "const char * const received[] = {\n\n";
 
   for (;;) {
     Trace::Record r;
-    iarchive >> r;
+    reader >> r;
 
     switch (r.type) {
       case Trace::Type::SENT:
@@ -86,23 +83,36 @@ static void c_print_server(boost::archive::text_iarchive &iarchive, ostream &o)
 int main(int argc, char **argv)
 {
   if (argc < 2) {
-    cout << "Call: " << *argv << " LOGFILE\n";
+    cout << "Call: " << *argv << " LOGFILE [--cs | --convert OUTFILE "
+      "[text|binary|deflate]]\n";
     return 1;
   }
 
   string logfile(argv[1]);
-  ifstream f(logfile, ifstream::in | ifstream::out);
-  f.exceptions(ifstream::badbit | ifstream::failbit );
-  boost::archive::text_iarchive iarchive(f);
+
+  if (argc > 3 && argv[2] == string("--convert")) {
+    Trace::Format format = Trace::Format::TEXT;
+    if (argc > 4) {
+      istringstream i(argv[4]);
+      if (!(i >> format)) {
+        cerr << "Unknown trace format: " << argv[4] << '\n';
+        return 1;
+      }
+    }
+    Trace::convert(logfile, argv[3], format);
+    return 0;
+  }
+
+  Trace::Reader reader(logfile);
 
   if (argc > 2 && argv[2] == string("--cs")) {
-    c_print_server(iarchive, cout);
+    c_print_server(reader, cout);
     return 0;
   }
 
   for (;;) {
     Trace::Record r;
-    iarchive >> r;
+    reader >> r;
     cout << r;
     if (r.type == Trace::Type::END_OF_FILE)
       break;
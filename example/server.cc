@@ -31,8 +31,6 @@
 #include <utility>
 using namespace std;
 
-#include <boost/archive/text_iarchive.hpp>
-#include <boost/archive/text_oarchive.hpp>
 #include <boost/program_options.hpp>
 
 namespace po = boost::program_options;
@@ -54,6 +52,13 @@ namespace Server {
     static const char TRACEFILE[]     = "trace";
     static const char REPLAYFILE[]    = "replay";
     static const char LIMIT[]         = "limit";
+    static const char SYNTHETIC[]     = "synthetic";
+    static const char MEAN_SIZE[]     = "mean_size";
+    static const char LARGE_SIZE[]    = "large_size";
+    static const char LARGE_EVERY[]   = "large_every";
+    static const char SEED[]          = "seed";
+    static const char LATENCY[]       = "latency";
+    static const char BANDWIDTH[]     = "bandwidth";
 
     static const char PORT[]          = "port";
     static const char DHPARAM[]       = "dhparam";
@@ -98,6 +103,29 @@ namespace Server {
       (OPT::LIMIT, po::value<unsigned>(&limit)->default_value(0),
        "time limit for replay session in seconds - 0 means unlimited")
       ;
+    po::options_description synthetic_group("Synthetic Mailbox");
+    synthetic_group.add_options()
+      (OPT::SYNTHETIC,
+       po::value<unsigned>(&synthetic.messages)->default_value(0),
+       "serve a generated mailbox with that many messages - "
+       "0 means echo mode")
+      (OPT::MEAN_SIZE,
+       po::value<unsigned>(&synthetic.mean_size)->default_value(8 * 1024),
+       "mean message size in bytes")
+      (OPT::LARGE_EVERY,
+       po::value<unsigned>(&synthetic.large_every)->default_value(0),
+       "make every n-th message large - 0 means none")
+      (OPT::LARGE_SIZE,
+       po::value<unsigned>(&synthetic.large_size)->default_value(4 * 1024 * 1024),
+       "size of the large messages")
+      (OPT::SEED, po::value<unsigned>(&synthetic.seed)->default_value(23),
+       "seed of the message generator")
+      (OPT::LATENCY, po::value<unsigned>(&latency)->default_value(0),
+       "delay each response by that many milliseconds")
+      (OPT::BANDWIDTH, po::value<unsigned>(&bandwidth)->default_value(0),
+       "limit the bandwidth to that many bytes per second - "
+       "0 means unlimited")
+      ;
     po::options_description hidden_group;
     hidden_group.add_options()
       (OPT::PORT, po::value<unsigned>(&port), "port")
@@ -105,6 +133,7 @@ namespace Server {
 
     po::options_description visible_group;
     visible_group.add(general_group);
+    visible_group.add(synthetic_group);
     po::options_description all;
     all.add(visible_group);
     all.add(hidden_group);
@@ -132,6 +161,7 @@ namespace Server {
     if (cipher.empty())
       cipher = Cipher::default_list(Cipher::to_class(cipher_preset));
     use_replay = !replayfile.empty();
+    use_synthetic = synthetic.messages;
   }
 
 
@@ -150,15 +180,21 @@ namespace Server {
 
       queue<vector<char> > write_queue_;
       vector<char> expected_data_;
-      ifstream replayfile_;
-      unique_ptr<boost::archive::text_iarchive> iarchive_;
+      unique_ptr<Trace::Reader> replay_reader_;
       // asio::steady_timer timer_;
       // workaround: boost autodetection of std::chrono
       // does not seem to work in all boost versions
       asio::basic_waitable_timer<std::chrono::steady_clock> timer_;
 
+      unique_ptr<Synthetic::Responder> responder_;
+      vector<char> synthetic_out_;
+
 
+      void start_mode();
       void start_replay();
+      void start_synthetic();
+      void do_synthetic_read();
+      void do_synthetic_write(Synthetic::Responder::Result r, bool first);
       void do_close();
       void do_replay();
       void do_read_line();
@@ -239,20 +275,119 @@ namespace Server {
           [this, self](const boost::system::error_code &ec)
           {
             if (!ec) {
-              if (opts_.use_replay)
-                start_replay();
-              else
-                do_read();
+              start_mode();
             } else {
               out_ << "handshake error: " << ec.message() << '\n';
               signals_.cancel();
             }
           });
     } else {
-      if (opts_.use_replay)
-        start_replay();
+      start_mode();
+    }
+  }
+
+  void session::start_mode()
+  {
+    if (opts_.use_replay)
+      start_replay();
+    else if (opts_.use_synthetic)
+      start_synthetic();
+    else
+      do_read();
+  }
+
+  void session::start_synthetic()
+  {
+    responder_.reset(new Synthetic::Responder(opts_.synthetic));
+    synthetic_out_.clear();
+    responder_->start(synthetic_out_);
+    do_synthetic_write(Synthetic::Responder::Result::CONTINUE, true);
+  }
+
+  void session::do_synthetic_read()
+  {
+    auto self(shared_from_this());
+
+    auto f = [this, self](const boost::system::error_code &ec, std::size_t length)
+    {
+      if (ec) {
+        out_ << "synthetic read error: " << ec.message() << '\n';
+        signals_.cancel();
+        return;
+      }
+      string line(length, '\0');
+      buf_.sgetn(&line[0], length);
+      synthetic_out_.clear();
+      auto r = responder_->command(line, synthetic_out_);
+      do_synthetic_write(r, true);
+    };
+    if (opts_.use_ssl)
+      asio::async_read_until(ssl_socket_, buf_, "\r\n", f);
+    else
+      asio::async_read_until(socket_, buf_, "\r\n", f);
+  }
+
+  // FETCH responses are written in batches of about that size
+  static const size_t synthetic_batch = 64 * 1024;
+
+  void session::do_synthetic_write(Synthetic::Responder::Result r, bool first)
+  {
+    auto self(shared_from_this());
+
+    while (synthetic_out_.size() < synthetic_batch
+        && responder_->next(synthetic_out_))
+      ;
+    if (synthetic_out_.empty()) {
+      if (r == Synthetic::Responder::Result::CLOSE) {
+        if (opts_.use_ssl) {
+          do_close();
+        } else {
+          boost::system::error_code ec;
+          socket_.shutdown(tcp::socket::shutdown_both, ec);
+          signals_.cancel();
+        }
+      } else {
+        do_synthetic_read();
+      }
+      return;
+    }
+
+    auto f = [this, self, r](const boost::system::error_code &ec,
+        std::size_t /*length*/)
+    {
+      if (ec) {
+        out_ << "synthetic write error: " << ec.message() << '\n';
+        signals_.cancel();
+        return;
+      }
+      synthetic_out_.clear();
+      do_synthetic_write(r, false);
+    };
+    auto w = [this, self, f]()
+    {
+      if (opts_.use_ssl)
+        asio::async_write(ssl_socket_, asio::buffer(synthetic_out_), f);
       else
-        do_read();
+        asio::async_write(socket_, asio::buffer(synthetic_out_), f);
+    };
+
+    std::chrono::microseconds delay(0);
+    if (first)
+      delay += std::chrono::milliseconds(opts_.latency);
+    if (opts_.bandwidth)
+      delay += std::chrono::microseconds(
+          uint64_t(synthetic_out_.size()) * 1000000u / opts_.bandwidth);
+    if (delay.count()) {
+      timer_.expires_from_now(delay);
+      timer_.async_wait([this, w](const boost::system::error_code &ec)
+          {
+            if (!ec)
+              w();
+            else
+              out_ << "synthetic timer error: " << ec.message() << '\n';
+          });
+    } else {
+      w();
     }
   }
 
@@ -260,11 +395,8 @@ namespace Server {
   {
     auto self(shared_from_this());
 
-    replayfile_.open(opts_.replayfile, ifstream::in | ifstream::binary);
-    replayfile_.exceptions(ifstream::failbit | ifstream::badbit);
-    unique_ptr<boost::archive::text_iarchive> a(
-        new boost::archive::text_iarchive(replayfile_));
-    iarchive_ = std::move(a);
+    replay_reader_ = unique_ptr<Trace::Reader>(
+        new Trace::Reader(opts_.replayfile));
 
 
     do_replay();
@@ -275,7 +407,7 @@ namespace Server {
     auto self(shared_from_this());
 
     Trace::Record r;
-    *iarchive_ >> r;
+    *replay_reader_ >> r;
     out_ << "Replay expires in: " << r.timestamp << '\n';
     timer_.expires_from_now(std::chrono::milliseconds(r.timestamp));
     switch (r.type) {
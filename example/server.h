@@ -30,6 +30,8 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/steady_timer.hpp>
 
+#include "synthetic.h"
+
 namespace Server {
 
   using namespace std;
@@ -56,6 +58,11 @@ namespace Server {
       string replayfile;
       unsigned limit {0};
 
+      bool use_synthetic {false};
+      Synthetic::Options synthetic;
+      // emulated network conditions in synthetic mode
+      unsigned latency {0};
+      unsigned bandwidth {0};
 
       Options(ostream &out = cout);
       Options(int argc, char **argv, ostream &out = cout);
@@ -0,0 +1,319 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "synthetic.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <boost/algorithm/string/case_conv.hpp>
+
+using namespace std;
+
+namespace Synthetic {
+
+  static const char *const words[] = {
+    "imap", "fetch", "message", "the", "a", "mailbox", "literal",
+    "throughput", "parser", "benchmark", "Hello", "World", "of",
+    "state", "machine", "ragel", "download", "server", "client"
+  };
+  // including CRLF
+  static const size_t line_size = 78;
+
+  // a block of text lines the message bodies are sliced from
+  static string make_text()
+  {
+    string t;
+    mt19937 g(42);
+    uniform_int_distribution<size_t> d(0, sizeof(words)/sizeof(words[0]) - 1);
+    string line;
+    for (unsigned i = 0; i < 1024; ++i) {
+      line.clear();
+      while (line.size() < line_size - 2) {
+        line += words[d(g)];
+        line += ' ';
+      }
+      line.resize(line_size - 2);
+      line += "\r\n";
+      t += line;
+    }
+    return t;
+  }
+  static const string &text()
+  {
+    static const string t(make_text());
+    return t;
+  }
+
+  Mailbox::Mailbox(const Options &opts)
+    :
+      opts_(opts)
+  {
+  }
+  uint32_t Mailbox::size() const
+  {
+    return opts_.messages;
+  }
+  const std::string &Mailbox::header(uint32_t uid)
+  {
+    message(uid);
+    return header_;
+  }
+  const std::string &Mailbox::message(uint32_t uid)
+  {
+    if (uid == cached_)
+      return message_;
+    mt19937 g(opts_.seed + uid);
+    size_t n;
+    if (opts_.large_every && uid % opts_.large_every == 0) {
+      n = opts_.large_size;
+    } else {
+      exponential_distribution<double> d(1.0 / max(opts_.mean_size, 1u));
+      n = size_t(d(g));
+    }
+    ostringstream o;
+    o << "Date: Sat, 18 Oct 2014 " << setfill('0')
+      << setw(2) << uid / 3600 % 24 << ':' << setw(2) << uid / 60 % 60 << ':'
+      << setw(2) << uid % 60 << " +0200\r\n"
+      << "From: Juergen User <juser" << uid % 97 << "@example.org>\r\n"
+      << "Subject: Synthetic message " << uid << "\r\n";
+    header_ = o.str();
+    header_ += "\r\n";
+    message_ = o.str();
+    o.str("");
+    o << "To: imapdl@example.org\r\n"
+      << "Message-ID: <" << uid << '.' << opts_.seed << "@synthetic>\r\n"
+      << "\r\n";
+    message_ += o.str();
+
+    const string &t = text();
+    size_t lines = t.size() / line_size;
+    size_t pos = g() % lines * line_size;
+    while (n) {
+      size_t k = min(t.size() - pos, max(n, line_size));
+      // only whole lines
+      k -= k % line_size;
+      message_.append(t, pos, k);
+      n -= min(n, k);
+      pos = 0;
+    }
+    cached_ = uid;
+    return message_;
+  }
+
+
+  Responder::Responder(const Options &opts)
+    :
+      mailbox_(opts)
+  {
+  }
+
+  static void append(vector<char> &out, const string &s)
+  {
+    out.insert(out.end(), s.begin(), s.end());
+  }
+
+  void Responder::start(std::vector<char> &out)
+  {
+    append(out, "* OK [CAPABILITY IMAP4rev1 UIDPLUS] Synthetic server ready\r\n");
+  }
+
+  static string next_token(const string &line, size_t &pos)
+  {
+    size_t b = line.find_first_not_of(' ', pos);
+    if (b == string::npos)
+      b = line.size();
+    size_t e = line.find_first_of(" \r\n", b);
+    if (e == string::npos)
+      e = line.size();
+    pos = e;
+    return line.substr(b, e - b);
+  }
+
+  static uint32_t sequence_nr(const string &s, uint32_t max_nr)
+  {
+    if (s == "*")
+      return max_nr;
+    unsigned long r = stoul(s);
+    return r > max_nr ? max_nr : uint32_t(r);
+  }
+
+  static vector<pair<uint32_t, uint32_t> > sequence_set(const string &s,
+      uint32_t max_nr)
+  {
+    vector<pair<uint32_t, uint32_t> > r;
+    istringstream i(s);
+    string range;
+    while (getline(i, range, ',')) {
+      size_t c = range.find(':');
+      uint32_t a = sequence_nr(range.substr(0, c), max_nr);
+      uint32_t b = c == string::npos ? a
+        : sequence_nr(range.substr(c + 1), max_nr);
+      if (a > b)
+        swap(a, b);
+      if (a)
+        r.emplace_back(a, b);
+    }
+    return r;
+  }
+
+  Responder::Result Responder::command(const std::string &line,
+      std::vector<char> &out)
+  {
+    size_t pos = 0;
+    string tag(next_token(line, pos));
+    string cmd(boost::to_upper_copy(next_token(line, pos)));
+    bool uid = cmd == "UID";
+    if (uid)
+      cmd = boost::to_upper_copy(next_token(line, pos));
+    ostringstream o;
+    if (cmd == "CAPABILITY") {
+      o << "* CAPABILITY IMAP4rev1 UIDPLUS\r\n"
+        << tag << " OK CAPABILITY completed\r\n";
+    } else if (cmd == "LOGIN") {
+      o << tag << " OK [CAPABILITY IMAP4rev1 UIDPLUS] Logged in\r\n";
+    } else if (cmd == "SELECT" || cmd == "EXAMINE") {
+      o << "* FLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft)\r\n"
+        << "* " << mailbox_.size() << " EXISTS\r\n"
+        << "* 0 RECENT\r\n"
+        << "* OK [UIDVALIDITY 1413619200] UIDs valid\r\n"
+        << "* OK [UIDNEXT " << mailbox_.size() + 1 << "] Predicted next UID\r\n"
+        << tag << " OK [READ-WRITE] " << cmd << " completed\r\n";
+    } else if (cmd == "FETCH") {
+      fetch(tag, line.substr(pos), uid, out);
+      return Result::CONTINUE;
+    } else if (cmd == "STORE" || cmd == "EXPUNGE" || cmd == "NOOP"
+        || cmd == "CHECK") {
+      // the mailbox is immutable
+      o << tag << " OK " << cmd << " completed\r\n";
+    } else if (cmd == "LOGOUT") {
+      o << "* BYE Logging out\r\n"
+        << tag << " OK LOGOUT completed\r\n";
+      append(out, o.str());
+      return Result::CLOSE;
+    } else {
+      o << tag << " BAD Command not supported by the synthetic server\r\n";
+    }
+    append(out, o.str());
+    return Result::CONTINUE;
+  }
+
+  void Responder::fetch(const std::string &tag, const std::string &args,
+      bool uid, std::vector<char> &out)
+  {
+    size_t pos = 0;
+    string set(next_token(args, pos));
+    string atts(boost::to_upper_copy(args.substr(pos)));
+    set_ = sequence_set(set, mailbox_.size());
+    set_pos_     = 0;
+    next_        = 0;
+    uid_fetch_   = uid;
+    want_uid_    = uid || atts.find("UID") != string::npos;
+    want_flags_  = atts.find("FLAGS") != string::npos;
+    want_size_   = atts.find("RFC822.SIZE") != string::npos;
+    want_header_ = atts.find("HEADER.FIELDS") != string::npos;
+    size_t b = atts.find("BODY.PEEK[]");
+    if (b == string::npos)
+      b = atts.find("BODY[]");
+    want_body_   = b != string::npos;
+    partial_     = false;
+    if (want_body_) {
+      size_t p = atts.find(']', b) + 1;
+      if (p < atts.size() && atts[p] == '<') {
+        size_t d = atts.find('.', p);
+        size_t e = atts.find('>', p);
+        if (d == string::npos || e == string::npos || d > e)
+          throw runtime_error("invalid partial: " + atts);
+        partial_ = true;
+        offset_ = stoul(atts.substr(p + 1, d - p - 1));
+        length_ = stoul(atts.substr(d + 1, e - d - 1));
+      }
+    }
+    tag_ = tag;
+    next(out);
+  }
+
+  void Responder::fetch_message(uint32_t uid, std::vector<char> &out)
+  {
+    const string &m = mailbox_.message(uid);
+    ostringstream o;
+    o << "* " << uid << " FETCH (";
+    const char *sep = "";
+    if (want_uid_) {
+      o << "UID " << uid;
+      sep = " ";
+    }
+    if (want_flags_) {
+      o << sep << "FLAGS (" << (uid % 3 ? "\\Seen" : "") << ')';
+      sep = " ";
+    }
+    if (want_size_) {
+      o << sep << "RFC822.SIZE " << m.size();
+      sep = " ";
+    }
+    if (want_header_) {
+      const string &h = mailbox_.header(uid);
+      o << sep << "BODY[HEADER.FIELDS (DATE FROM SUBJECT)] {" << h.size()
+        << "}\r\n" << h;
+      sep = " ";
+    }
+    if (want_body_) {
+      o << sep << "BODY[]";
+      if (partial_) {
+        size_t b = min<size_t>(offset_, m.size());
+        size_t n = min<size_t>(length_, m.size() - b);
+        o << '<' << offset_ << "> {" << n << "}\r\n";
+        append(out, o.str());
+        out.insert(out.end(), m.begin() + b, m.begin() + b + n);
+      } else {
+        o << " {" << m.size() << "}\r\n";
+        append(out, o.str());
+        append(out, m);
+      }
+      o.str("");
+    }
+    o << ")\r\n";
+    append(out, o.str());
+  }
+
+  bool Responder::next(std::vector<char> &out)
+  {
+    if (tag_.empty())
+      return false;
+    while (set_pos_ < set_.size()) {
+      auto &r = set_[set_pos_];
+      if (next_ < r.first)
+        next_ = r.first;
+      if (next_ <= r.second) {
+        fetch_message(next_++, out);
+        return true;
+      }
+      ++set_pos_;
+      next_ = 0;
+    }
+    append(out, tag_ + (uid_fetch_ ? " OK UID FETCH completed\r\n"
+          : " OK FETCH completed\r\n"));
+    tag_.clear();
+    return true;
+  }
+
+}
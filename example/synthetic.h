@@ -0,0 +1,98 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef EXAMPLE_SYNTHETIC_H
+#define EXAMPLE_SYNTHETIC_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+// Generated mailbox and a minimal IMAP responder for it - enough
+// for benchmarking a download client (CAPABILITY, LOGIN, SELECT,
+// (UID) FETCH, STORE, (UID) EXPUNGE, NOOP, LOGOUT).
+//
+// Message i has UID i. The messages are generated on demand from a
+// seed, thus, arbitrarily large mailboxes don't need memory.
+namespace Synthetic {
+
+  struct Options {
+    unsigned messages    {0};
+    // message sizes are exponentially distributed around the mean
+    unsigned mean_size   {8 * 1024};
+    // additionally, every n-th message is large (0 -> none)
+    unsigned large_every {0};
+    unsigned large_size  {4 * 1024 * 1024};
+    unsigned seed        {23};
+  };
+
+  class Mailbox {
+    private:
+      const Options &opts_;
+      uint32_t       cached_ {0};
+      std::string    message_;
+      std::string    header_;
+    public:
+      Mailbox(const Options &opts);
+      uint32_t size() const;
+      // valid until the next call
+      const std::string &message(uint32_t uid);
+      // the Date/From/Subject header fields of the message
+      const std::string &header(uint32_t uid);
+  };
+
+  class Responder {
+    public:
+      enum class Result { CONTINUE, CLOSE };
+    private:
+      Mailbox     mailbox_;
+      std::string tag_;
+      // pending FETCH
+      std::vector<std::pair<uint32_t, uint32_t> > set_;
+      size_t      set_pos_     {0};
+      uint32_t    next_        {0};
+      bool        uid_fetch_   {false};
+      bool        want_uid_    {false};
+      bool        want_flags_  {false};
+      bool        want_size_   {false};
+      bool        want_header_ {false};
+      bool        want_body_   {false};
+      bool        partial_     {false};
+      uint32_t    offset_      {0};
+      uint32_t    length_      {0};
+
+      void fetch(const std::string &tag, const std::string &args, bool uid,
+          std::vector<char> &out);
+      void fetch_message(uint32_t uid, std::vector<char> &out);
+    public:
+      Responder(const Options &opts);
+      // the greeting
+      void start(std::vector<char> &out);
+      // line: one complete command (including CRLF, without literals)
+      Result command(const std::string &line, std::vector<char> &out);
+      // FETCH responses are generated one message at a time - returns
+      // false when nothing is pending anymore
+      bool next(std::vector<char> &out);
+  };
+
+}
+
+#endif
@@ -45,17 +45,66 @@ namespace IMAP {
     {
       std::swap(x, cmd_);
     }
+    void Base::set_pipeline_depth(unsigned n)
+    {
+      if (!n)
+        THROW_LOGIC_MSG("pipeline depth must be at least 1");
+      pipeline_depth_ = n;
+      tags_.set_exclusive(n < 2);
+    }
+    unsigned Base::pipeline_depth() const
+    {
+      return pipeline_depth_;
+    }
+    void Base::set_metrics(Metrics::Registry *r)
+    {
+      metrics_ = r;
+    }
+    void Base::record_latency()
+    {
+      Metrics::Phase p;
+      switch (tags_.command(tag_number_)) {
+        case Command::LOGIN      : p = Metrics::Phase::LOGIN;   break;
+        case Command::SELECT     :
+        case Command::EXAMINE    : p = Metrics::Phase::SELECT;  break;
+        case Command::FETCH      :
+        case Command::UID_FETCH  : p = Metrics::Phase::FETCH;   break;
+        case Command::STORE      :
+        case Command::UID_STORE  : p = Metrics::Phase::STORE;   break;
+        case Command::EXPUNGE    :
+        case Command::UID_EXPUNGE: p = Metrics::Phase::EXPUNGE; break;
+        default: return;
+      }
+      metrics_->phase(p).add(Metrics::micros(
+            Metrics::Clock::now() - tags_.start(tag_number_)));
+    }
     void Base::do_write()
     {
-      write_fn_(cmd_);
+      if (in_flight_ < pipeline_depth_) {
+        ++in_flight_;
+        write_fn_(cmd_);
+      } else {
+        LOG_SEV(lg_, Log::DEBUG) << "Pipeline full (" << in_flight_
+          << " commands in flight) - queuing command";
+        pending_.push_back(std::move(cmd_));
+        cmd_.clear();
+      }
+    }
+    void Base::flush_pending()
+    {
+      while (in_flight_ < pipeline_depth_ && !pending_.empty()) {
+        ++in_flight_;
+        write_fn_(pending_.front());
+        pending_.pop_front();
+      }
     }
 
     void Base::async_capabilities(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       string tag;
       writer_.capability(tag);
-      tag_to_fn_[tag] = fn;
+      tags_.set_continuation(std::move(fn));
       BOOST_LOG(lg_) << "Getting CAPABILITIES ..." << " [" << tag << ']';
       do_write();
     }
@@ -63,30 +112,89 @@ namespace IMAP {
     void Base::async_login(const std::string &username, const std::string &password,
         std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       string tag;
       writer_.login(username, password, tag);
-      tag_to_fn_[tag] = fn;
+      tags_.set_continuation(std::move(fn));
       BOOST_LOG(lg_) << "Logging in as |" << username << "| [" << tag << "]";
-      BOOST_LOG_SEV(lg_, Log::INSANE) << "Password: |" << password << "|";
+      LOG_SEV(lg_, Log::INSANE) << "Password: |" << password << "|";
       do_write();
     }
     void Base::async_list(const std::string &reference, const std::string &mailbox,
         std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       string tag;
       writer_.list(reference, mailbox, tag);
-      tag_to_fn_[tag] = fn;
-      BOOST_LOG_SEV(lg_, Log::DEBUG) << "Listing: |" << reference << "| |" << mailbox << "|";
+      tags_.set_continuation(std::move(fn));
+      LOG_SEV(lg_, Log::DEBUG) << "Listing: |" << reference << "| |" << mailbox << "|";
+      do_write();
+    }
+    void Base::async_list(const std::string &reference, const std::string &mailbox,
+        const std::vector<IMAP::Status_Attribute> &status_atts,
+        std::function<void(void)> fn)
+    {
+      LOG_FUNCTION();
+      string tag;
+      writer_.list(reference, mailbox, status_atts, tag);
+      tags_.set_continuation(std::move(fn));
+      LOG_SEV(lg_, Log::DEBUG) << "Listing with status: |" << reference
+        << "| |" << mailbox << "|";
+      do_write();
+    }
+    void Base::async_status(const std::string &mailbox,
+        const std::vector<IMAP::Status_Attribute> &atts,
+        std::function<void(void)> fn)
+    {
+      LOG_FUNCTION();
+      string tag;
+      writer_.status(mailbox, atts, tag);
+      tags_.set_continuation(std::move(fn));
+      LOG_SEV(lg_, Log::DEBUG) << "Status of mailbox: |" << mailbox
+        << "| [" << tag << ']';
+      do_write();
+    }
+    void Base::async_compress(std::function<void(void)> fn)
+    {
+      LOG_FUNCTION();
+      string tag;
+      writer_.compress_deflate(tag);
+      tags_.set_continuation(std::move(fn));
+      BOOST_LOG(lg_) << "Enabling compression ..." << " [" << tag << ']';
+      do_write();
+    }
+    void Base::async_idle(std::function<void(void)> fn)
+    {
+      LOG_FUNCTION();
+      string tag;
+      writer_.idle(tag);
+      tags_.set_continuation(std::move(fn));
+      LOG_SEV(lg_, Log::DEBUG) << "Idling ..." << " [" << tag << ']';
+      do_write();
+    }
+    void Base::idle_done()
+    {
+      LOG_SEV(lg_, Log::DEBUG) << "Finishing IDLE";
+      writer_.idle_done();
+      // not a command, i.e. it doesn't occupy a pipeline slot
+      write_fn_(cmd_);
+    }
+    void Base::async_noop(std::function<void(void)> fn)
+    {
+      LOG_FUNCTION();
+      string tag;
+      writer_.noop(tag);
+      tags_.set_continuation(std::move(fn));
+      LOG_SEV(lg_, Log::DEBUG) << "Polling ..." << " [" << tag << ']';
       do_write();
     }
-    void Base::async_select(const std::string &mailbox, std::function<void(void)> fn)
+    void Base::async_select(const std::string &mailbox, std::function<void(void)> fn,
+        bool condstore)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       string tag;
-      writer_.select(mailbox, tag);
-      tag_to_fn_[tag] = fn;
+      writer_.select(mailbox, tag, condstore);
+      tags_.set_continuation(std::move(fn));
       BOOST_LOG(lg_) << "Selecting mailbox: |" << mailbox << "|" << " [" << tag << ']';
       do_write();
     }
@@ -96,75 +204,98 @@ namespace IMAP {
             const std::vector<IMAP::Client::Fetch_Attribute> &atts,
             std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       string tag;
       writer_.fetch(set, atts, tag);
-      tag_to_fn_[tag] = fn;
+      tags_.set_continuation(std::move(fn));
       BOOST_LOG(lg_) << "Fetching messages " <<  " ..." << " [" << tag << ']';
       do_write();
     }
+    void Base::async_uid_fetch(
+            const std::vector<std::pair<uint32_t, uint32_t> > &set,
+            const std::vector<IMAP::Client::Fetch_Attribute> &atts,
+            std::function<void(void)> fn,
+            uint64_t changedsince)
+    {
+      LOG_FUNCTION();
+      string tag;
+      writer_.uid_fetch(set, atts, tag, changedsince);
+      tags_.set_continuation(std::move(fn));
+      BOOST_LOG(lg_) << "Fetching messages by UID ..." << " [" << tag << ']';
+      do_write();
+    }
 
     void Base::async_store(
             const std::vector<std::pair<uint32_t, uint32_t> > &set,
             const std::vector<IMAP::Flag> &flags,
             std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       string tag;
       writer_.uid_store(set, flags, tag, IMAP::Client::Store_Mode::REPLACE, true);
-      tag_to_fn_[tag] = fn;
+      tags_.set_continuation(std::move(fn));
       BOOST_LOG(lg_) << "Storing DELETED flags ..." << " [" << tag << ']';
       do_write();
     }
     void Base::async_uid_expunge(const std::vector<std::pair<uint32_t, uint32_t> > &set,
         std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       string tag;
       writer_.uid_expunge(set, tag);
-      tag_to_fn_[tag] = fn;
+      tags_.set_continuation(std::move(fn));
       BOOST_LOG(lg_) << "Expunging messages ..." << " [" << tag << ']';
       do_write();
     }
     void Base::async_expunge(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       string tag;
       writer_.expunge(tag);
-      tag_to_fn_[tag] = fn;
+      tags_.set_continuation(std::move(fn));
       BOOST_LOG(lg_) << "Expunging messages (without UIDPLUS) ..." << " [" << tag << ']';
       do_write();
     }
 
     void Base::async_logout(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       string tag;
       writer_.logout(tag);
-      tag_to_fn_[tag] = fn;
+      tags_.set_continuation(std::move(fn));
       BOOST_LOG(lg_) << "Logging out ..." << " [" << tag << ']';
       //state_ = State::LOGGING_OUT;
       do_write();
     }
+    void Base::imap_tag_number(uint64_t n)
+    {
+      tag_number_ = n;
+    }
     void Base::imap_tagged_status_end(IMAP::Server::Response::Status c)
     {
-      BOOST_LOG_FUNCTION();
-      string tag(tag_buffer_.begin(), tag_buffer_.end());
-      BOOST_LOG(lg_) << "Got status " << c << " for tag " << tag;
+      LOG_FUNCTION();
+      BOOST_LOG(lg_) << "Got status " << c << " for tag "
+        << string(tag_buffer_.begin(), tag_buffer_.end());
       if (c != IMAP::Server::Response::Status::OK) {
         stringstream o;
         o << "Command failed: " << c << " - " << string(buffer_.begin(), buffer_.end());
         THROW_MSG(o.str());
       }
-      auto i = tag_to_fn_.find(tag);
-      if (i == tag_to_fn_.end()) {
+      if (!tags_.own(tag_buffer_.begin(), tag_buffer_.end())
+          || !tags_.active(tag_number_)) {
         stringstream o;
-        o << "Got unknown tag: " << tag;
+        o << "Got unknown tag: "
+          << string(tag_buffer_.begin(), tag_buffer_.end());
         THROW_MSG(o.str());
       }
-      tags_.pop(tag);
-      auto fn = i->second;
-      tag_to_fn_.erase(i);
+      if (metrics_)
+        record_latency();
+      auto fn = tags_.pop(tag_number_);
+      // tagged responses may arrive out of order when pipelining,
+      // thus the lookup via the tag
+      --in_flight_;
+      // queued commands were issued before anything fn() may issue
+      flush_pending();
       fn();
     }
 
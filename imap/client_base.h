@@ -25,10 +25,12 @@
 #include <imap/client_parser.h>
 
 #include <log/log.h>
+#include <metrics/metrics.h>
 #include <buffer/buffer.h>
 
 #include <string>
 #include <map>
+#include <deque>
 #include <vector>
 #include <functional>
 #include <utility>
@@ -48,10 +50,19 @@ namespace IMAP {
         IMAP::Client::Tag    tags_;
         std::vector<char>    cmd_;
         IMAP::Client::Writer writer_;
-        std::map<std::string, std::function<void(void)> > tag_to_fn_;
+        // of the current tagged response
+        uint64_t             tag_number_     {0};
+        // maximal number of commands in flight
+        unsigned             pipeline_depth_ {1};
+        unsigned             in_flight_      {0};
+        std::deque<std::vector<char> > pending_;
+        // command latencies are recorded if set
+        Metrics::Registry   *metrics_        {nullptr};
 
         void to_cmd(vector<char> &x);
+        void record_latency();
         void do_write();
+        void flush_pending();
 
       protected:
         Memory::Buffer::Vector tag_buffer_;
@@ -62,11 +73,33 @@ namespace IMAP {
             std::function<void(void)> fn);
         void async_list(const std::string &reference, const std::string &mailbox,
             std::function<void(void)> fn);
-        void async_select(const std::string &mailbox, std::function<void(void)> fn);
+        // RFC5819 LIST-STATUS
+        void async_list(const std::string &reference, const std::string &mailbox,
+            const std::vector<IMAP::Status_Attribute> &status_atts,
+            std::function<void(void)> fn);
+        void async_status(const std::string &mailbox,
+            const std::vector<IMAP::Status_Attribute> &atts,
+            std::function<void(void)> fn);
+        // the caller has to enable compression in the transport layer
+        // in fn - and must not issue other commands until then
+        void async_compress(std::function<void(void)> fn);
+        // RFC2177 - fn is called when the server finishes the IDLE
+        // command, i.e. after idle_done() was called
+        void async_idle(std::function<void(void)> fn);
+        // must only be called after the continuation request
+        void idle_done();
+        void async_noop(std::function<void(void)> fn);
+        void async_select(const std::string &mailbox, std::function<void(void)> fn,
+            bool condstore = false);
         void async_fetch(
             const std::vector<std::pair<uint32_t, uint32_t> > &set,
             const std::vector<IMAP::Client::Fetch_Attribute> &atts,
             std::function<void(void)> fn);
+        void async_uid_fetch(
+            const std::vector<std::pair<uint32_t, uint32_t> > &set,
+            const std::vector<IMAP::Client::Fetch_Attribute> &atts,
+            std::function<void(void)> fn,
+            uint64_t changedsince = 0);
         void async_store(
             const std::vector<std::pair<uint32_t, uint32_t> > &set,
             const std::vector<IMAP::Flag> &flags,
@@ -76,10 +109,19 @@ namespace IMAP {
         void async_expunge(std::function<void(void)> fn);
         void async_logout(std::function<void(void)> fn);
 
+        void imap_tag_number(uint64_t n) override;
         void imap_tagged_status_end(IMAP::Server::Response::Status c) override;
       public:
         Base(Write_Fn write_fn,
             boost::log::sources::severity_logger< Log::Severity > &lg);
+
+        // 1 means no pipelining, i.e. the next command is only sent
+        // after the tagged response of the previous one
+        void set_pipeline_depth(unsigned n);
+        unsigned pipeline_depth() const;
+        // measured from the generation of the tag until the
+        // tagged response
+        void set_metrics(Metrics::Registry *r);
     };
 
   }
@@ -32,7 +32,7 @@ using namespace std;
 namespace IMAP {
 
   namespace Client {
-    class Parser;
+    template <typename CB> class Basic_Parser;
 
     namespace Callback {
 
@@ -40,7 +40,7 @@ namespace IMAP {
 
       class Base {
         private:
-          friend class IMAP::Client::Parser;
+          template <typename CB> friend class IMAP::Client::Basic_Parser;
         protected:
           virtual ~Base();
 
@@ -48,6 +48,12 @@ namespace IMAP {
           //virtual void imap_continuation_request_end() = 0;
           //virtual void imap_response_begin(Group g, Kind k) = 0;
 
+          // on the '+' of a continuation request
+          virtual void imap_continue_req() = 0;
+
+          // the trailing digits of the tag of a tagged response as number
+          // (0 if there are none) - called before imap_tagged_status_begin()
+          virtual void imap_tag_number(uint64_t n) = 0;
           // may consult tag_buffer
           virtual void imap_tagged_status_begin() = 0;
           // may consult buffer
@@ -70,10 +76,14 @@ namespace IMAP {
           // may consult buffer
           virtual void imap_atom_flag() = 0;
           virtual void imap_uid(uint32_t number) = 0;
+          virtual void imap_rfc822_size(uint32_t number) = 0;
           virtual void imap_status_code(Status_Code) = 0;
           virtual void imap_status_code_uidnext(uint32_t n) = 0;
           virtual void imap_status_code_uidvalidity(uint32_t n) = 0;
           virtual void imap_status_code_unseen(uint32_t n) = 0;
+          // RFC7162 CONDSTORE extension
+          virtual void imap_status_code_highestmodseq(uint64_t n) = 0;
+          virtual void imap_modseq(uint64_t n) = 0;
 
           virtual void imap_status_code_capability_begin() = 0;
           virtual void imap_status_code_capability_end() = 0;
@@ -92,12 +102,22 @@ namespace IMAP {
           virtual void imap_list_sflag(SFlag flag) = 0;
           virtual void imap_list_oflag(OFlag oflag) = 0;
           virtual void imap_quoted_char(char c) = 0;
+          // the hierarchy delimiter of the listed mailbox
+          virtual void imap_list_delimiter(char c) = 0;
+          // may consult buffer
           virtual void imap_list_mailbox() = 0;
+
+          // STATUS response (or RFC5819 LIST-STATUS)
+          virtual void imap_status_att(Status_Attribute a, uint32_t n) = 0;
+          // may consult buffer (mailbox name)
+          virtual void imap_status_end() = 0;
       };
 
       class Null : public Base {
         private:
         protected:
+          void imap_continue_req() override;
+          void imap_tag_number(uint64_t n) override;
           void imap_tagged_status_begin() override;
           void imap_tagged_status_end(Status c) override;
           void imap_untagged_status_begin(Status c) override;
@@ -112,10 +132,13 @@ namespace IMAP {
           void imap_flag(Flag flag) override;
           void imap_atom_flag() override;
           void imap_uid(uint32_t number) override;
+          void imap_rfc822_size(uint32_t number) override;
           void imap_status_code(Status_Code) override;
           void imap_status_code_uidnext(uint32_t n) override;
           void imap_status_code_uidvalidity(uint32_t n) override;
           void imap_status_code_unseen(uint32_t n) override;
+          void imap_status_code_highestmodseq(uint64_t n) override;
+          void imap_modseq(uint64_t n) override;
 
           void imap_status_code_capability_begin() override;
           void imap_status_code_capability_end() override;
@@ -134,31 +157,61 @@ namespace IMAP {
           virtual void imap_list_sflag(SFlag flag) override;
           virtual void imap_list_oflag(OFlag oflag) override;
           virtual void imap_quoted_char(char c) override;
+          virtual void imap_list_delimiter(char c) override;
           virtual void imap_list_mailbox() override;
+
+          void imap_status_att(Status_Attribute a, uint32_t n) override;
+          void imap_status_end() override;
       };
     }
 
-    class Parser {
+    // The callbacks are called via a reference to CB - thus, when CB is
+    // a final class the calls are dispatched statically and can be
+    // inlined. CB has to befriend its Basic_Parser if it overrides the
+    // callbacks non-publicly.
+    //
+    // The member definitions are in the ragel generated
+    // client_parser_impl.h - Parser (i.e. the virtual interface) is
+    // explicitly instantiated in client_parser.cc.
+    template <typename CB>
+    class Basic_Parser {
       private:
         int                      cs             {0};
         vector<int>              stack_vector_;
         int                     *stack          {nullptr};
         int                      top            {0};
-        Memory::Buffer::Vector   number_buffer_;
         uint32_t                 number_        {0};
+        // mod-sequence values are 63 bit, also the accumulator of
+        // the number actions
+        uint64_t                 number64_      {0};
+        uint64_t                 tag_number_    {0};
         size_t                   literal_pos_   {0};
+        // inside a literal, i.e. read() copies it via read_literal()
+        bool                     in_literal_    {false};
+        // converting and the last literal character was a CR
+        bool                     literal_cr_    {false};
         bool                     has_imap4rev1_ {false};
+        // read() returns after the current tagged response
+        bool                     stop_          {false};
 
         Memory::Buffer::Base    &buffer_;
         bool                     convert_crlf_  {true};
         Memory::Buffer::Base    &tag_buffer_;
-        Callback::Base          &cb_;
+        CB                      &cb_;
         Server::Response::Status status_        {Server::Response::Status::OK};
+
+        const char *read_literal(const char *p, const char *pe);
+        void append_literal(const char *b, const char *e, bool last);
       public:
-        Parser(Memory::Buffer::Base &buffer,
+        Basic_Parser(Memory::Buffer::Base &buffer,
             Memory::Buffer::Base &tag_buffer,
-            Callback::Base &cb);
-        void read(const char *begin, const char *end);
+            CB &cb);
+        // returns end - or the position after the tagged response
+        // during which stop() was called
+        const char *read(const char *begin, const char *end);
+        // to be called from imap_tagged_status_end(), e.g. when the
+        // following data is compressed (RFC4978)
+        void stop();
         bool in_start() const;
         bool finished() const;
         void verify_finished() const;
@@ -166,6 +219,9 @@ namespace IMAP {
 
     };
 
+    extern template class Basic_Parser<Callback::Base>;
+    using Parser = Basic_Parser<Callback::Base>;
+
   }
 }
 
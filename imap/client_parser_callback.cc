@@ -28,6 +28,12 @@ namespace IMAP {
 
       Base::~Base() =default;
 
+      void Null::imap_continue_req()
+      {
+      }
+      void Null::imap_tag_number(uint64_t)
+      {
+      }
       void Null::imap_tagged_status_begin()
       {
       }
@@ -70,6 +76,9 @@ namespace IMAP {
       void Null::imap_uid(uint32_t)
       {
       }
+      void Null::imap_rfc822_size(uint32_t)
+      {
+      }
       void Null::imap_status_code(Status_Code)
       {
       }
@@ -82,6 +91,12 @@ namespace IMAP {
       void Null::imap_status_code_unseen(uint32_t)
       {
       }
+      void Null::imap_status_code_highestmodseq(uint64_t)
+      {
+      }
+      void Null::imap_modseq(uint64_t)
+      {
+      }
       void Null::imap_status_code_capability_begin()
       {
       }
@@ -128,10 +143,20 @@ namespace IMAP {
       void Null::imap_quoted_char(char)
       {
       }
+      void Null::imap_list_delimiter(char)
+      {
+      }
       void Null::imap_list_mailbox()
       {
       }
 
+      void Null::imap_status_att(Status_Attribute, uint32_t)
+      {
+      }
+      void Null::imap_status_end()
+      {
+      }
+
 
     }
 
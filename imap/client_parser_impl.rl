@@ -18,17 +18,29 @@
     along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
 
 }}} */
+#ifndef IMAP_CLIENT_PARSER_IMPL_H
+#define IMAP_CLIENT_PARSER_IMPL_H
+
+// The definitions of the Basic_Parser template. Only included by the
+// translation units that instantiate it, i.e. client_parser.cc for the
+// virtual callback interface and the ones that instantiate it for a
+// concrete (final) callback class - such that the callbacks are
+// dispatched statically.
+//
+// The ragel tables are static, i.e. each of those translation units
+// gets its own copy.
+
 #include <imap/client_parser.h>
 
 #include <stdexcept>
 #include <string>
+#include <algorithm>
+#include <string.h>
 #include <iomanip>
 #include <sstream>
 
 using namespace std;
 
-#include <boost/lexical_cast.hpp>
-
 #include "lex_util.h"
 
 %%{
@@ -49,8 +61,24 @@ machine imap;
 # {{{ Actions
 
 action return { fret; }
+action cb_continue_req
+{
+  cb_.imap_continue_req();
+}
 action call_continue_req_tail { fcall continue_req_tail; }
 
+# Literal data isn't lexed - read() copies it in bulk via read_literal()
+# and then continues in the state after the literal (i.e. the target
+# of this transition).
+action call_literal_tail
+{
+  if (number_) {
+    in_literal_ = true;
+    literal_cr_ = false;
+    fbreak;
+  }
+}
+
 action call_capability
 {
   fcall capability;
@@ -79,6 +107,8 @@ action cb_tagged_status_begin
 action cb_tagged_status_end
 {
   cb_.imap_tagged_status_end(status_);
+  if (stop_)
+    fbreak;
 }
 action cb_untagged_status_begin
 {
@@ -148,6 +178,10 @@ action cb_uid
 {
   cb_.imap_uid(number_);
 }
+action cb_rfc822_size
+{
+  cb_.imap_rfc822_size(number_);
+}
 action cb_status_code_alert
 {
   cb_.imap_status_code(Server::Response::Status_Code::ALERT);
@@ -195,6 +229,19 @@ action cb_status_code_unseen
   cb_.imap_status_code(Server::Response::Status_Code::UNSEEN);
   cb_.imap_status_code_unseen(number_);
 }
+action cb_status_code_highestmodseq
+{
+  cb_.imap_status_code(Server::Response::Status_Code::HIGHESTMODSEQ);
+  cb_.imap_status_code_highestmodseq(number64_);
+}
+action cb_status_code_nomodseq
+{
+  cb_.imap_status_code(Server::Response::Status_Code::NOMODSEQ);
+}
+action cb_modseq
+{
+  cb_.imap_modseq(number64_);
+}
 
 action cb_status_code_capability_begin
 {
@@ -437,24 +484,20 @@ action cb_capability_within
 action tag_start
 {
   tag_buffer_.start(p);
+  tag_number_ = 0;
 }
-action tag_finish
+# i.e. only the trailing digits are part of the number
+action tag_number
 {
-  tag_buffer_.finish(p);
+  if (*p >= '0' && *p <= '9')
+    tag_number_ = tag_number_ * 10 + (*p - '0');
+  else
+    tag_number_ = 0;
 }
-
-#                    ; (0 <= n < 4,294,967,296)
-# the lexical_cast in number_end already does the checking for us ...
-# thus not used
-action check_number
+action tag_finish
 {
-  // check only works for at most 10 digit long strings
-  if (strncmp(number_buffer_.begin(), "4294967296",
-              number_buffer_.end() - number_buffer_.begin()) >= 0) {
-    // fgoto *imap_error;
-    fnext *imap_error;
-    throw overflow_error("number is >= 4,294,967,296");
-  }
+  tag_buffer_.finish(p);
+  cb_.imap_tag_number(tag_number_);
 }
 
 action cb_body_section_begin
@@ -521,6 +564,35 @@ action cb_list_mailbox
   using namespace IMAP::Server::Response;
   cb_.imap_list_mailbox();
 }
+action cb_list_delimiter
+{
+  cb_.imap_list_delimiter(fc);
+}
+
+action cb_status_messages
+{
+  cb_.imap_status_att(Status_Attribute::MESSAGES, number_);
+}
+action cb_status_recent
+{
+  cb_.imap_status_att(Status_Attribute::RECENT, number_);
+}
+action cb_status_uidnext
+{
+  cb_.imap_status_att(Status_Attribute::UIDNEXT, number_);
+}
+action cb_status_uidvalidity
+{
+  cb_.imap_status_att(Status_Attribute::UIDVALIDITY, number_);
+}
+action cb_status_unseen
+{
+  cb_.imap_status_att(Status_Attribute::UNSEEN, number_);
+}
+action cb_status_end
+{
+  cb_.imap_status_end();
+}
 
 # }}}
 
@@ -716,8 +788,19 @@ resp_text_code_head =
   | /APPENDUID/i
   | /COPYUID/i
   | /UIDNOTSTICKY/i
+  # RFC7162 CONDSTORE extension
+  | /HIGHESTMODSEQ/i
+  | /NOMODSEQ/i
   ;
 
+# RFC7162 CONDSTORE extension
+# mod-sequence-value  = 1*DIGIT
+#                        ;; Positive unsigned 63-bit integer
+#                        ;; (mod-sequence)
+#                        ;; (1 <= n <= 9,223,372,036,854,775,807).
+
+mod_sequence_value64 = mod_sequence_value >number_start $number_digit ;
+
 resp_text_code = /ALERT/i          %cb_status_code_alert
                | /BADCHARSET/i     %cb_status_code_badcharset
                    ( SP '(' astring (SP astring)* ')' )?
@@ -735,6 +818,13 @@ resp_text_code = /ALERT/i          %cb_status_code_alert
                | resp_code_apnd
                | resp_code_copy
                | /UIDNOTSTICKY/i
+               # RFC7162 CONDSTORE extension
+               # resp-text-code   =/ "HIGHESTMODSEQ" SP mod-sequence-value /
+               #                     "NOMODSEQ" /
+               #                     "MODIFIED" SP sequence-set
+               | /HIGHESTMODSEQ/i SP mod_sequence_value64
+                   %cb_status_code_highestmodseq
+               | /NOMODSEQ/i       %cb_status_code_nomodseq
                | (atom - resp_text_code_head) (SP (TEXT_CHAR - ']')+ )? ;
 
 # resp-text       = ["[" resp-text-code "]" SP] text
@@ -782,7 +872,7 @@ resp_cond_state = ( /OK/i %status_ok | /NO/i %status_no | /BAD/i %status_bad )
 
 # response-tagged = tag SP resp-cond-state CRLF
 
-response_tagged = tag                  >tag_start %tag_finish
+response_tagged = tag        >tag_start $tag_number %tag_finish
                   SP                   @cb_tagged_status_begin
                   resp_cond_state CRLF @cb_tagged_status_end ;
 
@@ -962,7 +1052,7 @@ body = ( '(' | ')' | SP | string | nil | number )+ ;
 msg_att_static = /ENVELOPE/i     SP envelope
                | /INTERNALDATE/i SP date_time
                | /RFC822/i ( /.HEADER/i | /.TEXT/i )? SP nstring
-               | /RFC822.SIZE/i SP number
+               | /RFC822.SIZE/i SP number %cb_rfc822_size
                | /BODY/i (/STRUCTURE/i)? SP body
                | /BODY/i section ( '<' number '>' )?
                    SP      @cb_body_section_inner
@@ -972,8 +1062,13 @@ msg_att_static = /ENVELOPE/i     SP envelope
 # msg-att-dynamic = "FLAGS" SP "(" [flag-fetch *(SP flag-fetch)] ")"
 #                    ; MAY change for a message
 
+# RFC7162 CONDSTORE extension
+# fetch-mod-resp      = "MODSEQ" SP "(" permsg-modsequence ")"
+# msg-att-dynamic     =/ fetch-mod-resp
+
 msg_att_dynamic = /FLAGS/i SP '(' (      flag_fetch
-                                     (SP flag_fetch)* )? ")"  ;
+                                     (SP flag_fetch)* )? ")"
+                | /MODSEQ/i SP '(' mod_sequence_value64 ')' %cb_modseq ;
 
 # msg-att         = "(" (msg-att-dynamic / msg-att-static)
 #                    *(SP (msg-att-dynamic / msg-att-static)) ")"
@@ -1019,11 +1114,18 @@ mbx_list_flags  = (mbx_list_oflag SP)* mbx_list_sflag (SP mbx_list_oflag)*
 
 # QUOTED_CHAR is the hierarchy delimiter, nil means no hierarchy/flat
 mailbox_list    = '(' (mbx_list_flags)? ')' SP
-                   (DQUOTE QUOTED_CHAR DQUOTE | nil) SP mailbox %cb_list_mailbox ;
+                   (DQUOTE QUOTED_CHAR @cb_list_delimiter DQUOTE | nil)
+                   SP mailbox %cb_list_mailbox ;
 
 # status-att-list =  status-att SP number *(SP status-att SP number)
 
-status_att_list = status_att SP number (SP status_att SP number)* ;
+status_att_value = /MESSAGES/i    SP number %cb_status_messages
+                 | /RECENT/i      SP number %cb_status_recent
+                 | /UIDNEXT/i     SP number %cb_status_uidnext
+                 | /UIDVALIDITY/i SP number %cb_status_uidvalidity
+                 | /UNSEEN/i      SP number %cb_status_unseen ;
+
+status_att_list = status_att_value (SP status_att_value)* ;
 
 # mailbox-data    =  "FLAGS" SP flag-list / "LIST" SP mailbox-list /
 #                    "LSUB" SP mailbox-list / "SEARCH" *(SP nz-number) /
@@ -1035,7 +1137,7 @@ mailbox_data    = /FLAGS/i  SP
                 | /LIST/i   SP @cb_list_begin mailbox_list %cb_list_end
                 | /LSUB/i   SP mailbox_list
                 | /SEARCH/i (SP nz_number)*
-                | /STATUS/i SP mailbox SP '(' (status_att_list)? ')'
+                | /STATUS/i SP mailbox SP '(' (status_att_list)? ')' %cb_status_end
                 | number SP ( /EXISTS/i %cb_data_exists |
                               /RECENT/i %cb_data_recent   )
                 ;
@@ -1097,7 +1199,7 @@ continue_req_tail := SP ( resp_text | base64 ) CRLF @return ;
 # ragel state chart
 responses =
   start: (
-    '+' @call_continue_req_tail -> start    |
+    '+' @cb_continue_req @call_continue_req_tail -> start |
     '*' SP                      -> untagged |
     # the tagged response_done part
     response_tagged             -> start
@@ -1130,48 +1232,143 @@ namespace IMAP {
 
     %% write data;
 
-    Parser::Parser(Buffer::Base &buffer,
+    template <typename CB>
+    Basic_Parser<CB>::Basic_Parser(Buffer::Base &buffer,
       Buffer::Base &tag_buffer,
-      Callback::Base &cb)
+      CB &cb)
       :
         buffer_(buffer), tag_buffer_(tag_buffer), cb_(cb)
     {
       %% write init;
     }
 
-    void Parser::read(const char *begin, const char *end)
+    template <typename CB>
+    const char *Basic_Parser<CB>::read(const char *begin, const char *end)
     {
       const char *p   = begin;
       const char *pe  = end;
       const char *eof = nullptr;
       Buffer::Resume bur(buffer_, p, pe);
       Buffer::Resume tar(tag_buffer_, p, pe);
-      Buffer::Resume nur(number_buffer_, p, pe);
-      %% write exec;
-      if (cs == %%{write error;}%%) {
-        throw_lex_error("IMAP client automaton in error state", begin, p, pe);
+      if (in_literal_)
+        p = read_literal(p, pe);
+      while (p != pe) {
+        %% write exec;
+        if (cs == %%{write error;}%%) {
+          throw_lex_error("IMAP client automaton in error state", begin, p, pe);
+        }
+        if (stop_) {
+          stop_ = false;
+          return p;
+        }
+        if (in_literal_)
+          p = read_literal(p, pe);
       }
+      return pe;
     }
 
-    bool Parser::in_start() const
+    template <typename CB>
+    void Basic_Parser<CB>::append_literal(const char *b, const char *e, bool last)
+    {
+      if (b == e)
+        return;
+      buffer_.cont(b);
+      if (last)
+        buffer_.finish(e);
+      else
+        buffer_.stop(e);
+    }
+
+    // Hands the available part of a literal to the buffer in one go -
+    // when converting, CRLF is replaced with LF where the spans between
+    // the CRs are found via memchr().
+    //
+    // Same as the literal_tail/literal_tail_convert machines: a CR not
+    // followed by a LF is kept, a LF not preceded by a CR is an error.
+    template <typename CB>
+    const char *Basic_Parser<CB>::read_literal(const char *p, const char *pe)
+    {
+      size_t n = std::min(size_t(pe - p), size_t(number_ - literal_pos_));
+      const char *e = p + n;
+      literal_pos_ += n;
+      if (convert_crlf_) {
+        static const char cr = '\r';
+        const char *s = p;
+        if (literal_cr_ && p != e) {
+          // CR was the last character of the previous read
+          literal_cr_ = false;
+          if (*p == '\n') {
+            ++p;
+          } else {
+            buffer_.cont(&cr);
+            buffer_.stop(&cr + 1);
+          }
+        }
+        while (p != e) {
+          const char *q = static_cast<const char*>(memchr(p, '\r', e - p));
+          const char *x = q ? q : e;
+          if (memchr(p, '\n', x - p))
+            throw_lex_error("LF without CR in literal", s, p, e);
+          if (!q) {
+            break;
+          } else if (q + 1 == e) {
+            append_literal(s, q, false);
+            s = e;
+            literal_cr_ = true;
+            break;
+          } else if (q[1] == '\n') {
+            append_literal(s, q, false);
+            // the LF starts the next span
+            s = q + 1;
+            p = q + 2;
+          } else {
+            p = q + 1;
+          }
+        }
+        append_literal(s, e, literal_pos_ == number_ && s != e
+            && e[-1] != '\n');
+        if (literal_cr_ && literal_pos_ == number_) {
+          literal_cr_ = false;
+          buffer_.cont(&cr);
+          buffer_.stop(&cr + 1);
+        }
+      } else {
+        append_literal(p, e, literal_pos_ == number_);
+      }
+      if (literal_pos_ == number_)
+        in_literal_ = false;
+      return e;
+    }
+
+    template <typename CB>
+    bool Basic_Parser<CB>::in_start() const
     {
       return cs == %%{write start;}%%;
     }
-    bool Parser::finished() const
+    template <typename CB>
+    bool Basic_Parser<CB>::finished() const
     {
       // return cs >= %%{write first_final;}%%;
       // for this machine: start state == final state
       return in_start();
     }
 
-    void Parser::verify_finished() const
+    template <typename CB>
+    void Basic_Parser<CB>::verify_finished() const
     {
       if (!finished())
         throw runtime_error("IMAP client automaton not in final state");
     }
 
+    template <typename CB>
+    void Basic_Parser<CB>::stop()
+    {
+      stop_ = true;
+    }
+
     // e.g. for mailbox/maildir we want to convert - which is the default
-    void Parser::set_convert_crlf(bool b)
+    template <typename CB>
+    void Basic_Parser<CB>::set_convert_crlf(bool b)
     {
       (void)imap_first_final;
       (void)imap_en_literal_tail;
@@ -1187,4 +1384,4 @@ namespace IMAP {
 
 }
 
-
+#endif
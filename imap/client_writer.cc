@@ -20,6 +20,10 @@
 }}} */
 #include "client_writer.h"
 
+#include "config.h"
+
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <limits>
 using namespace std;
@@ -33,65 +37,198 @@ namespace IMAP {
   namespace Client {
 
     Tag::Tag(const std::string &prefix, unsigned width)
-      : prefix_(prefix), width_(width)
+      : prefix_(prefix), width_(width), ring_(16)
+    {
+    }
+    void Tag::set_exclusive(bool b)
+    {
+      exclusive_ = b;
+    }
+    Tag::Slot &Tag::slot(size_t number)
+    {
+      return ring_[number & (ring_.size() - 1)];
+    }
+    const Tag::Slot &Tag::slot(size_t number) const
+    {
+      return ring_[number & (ring_.size() - 1)];
+    }
+    void Tag::grow()
     {
+      vector<Slot> v(ring_.size() * 2);
+      swap(v, ring_);
+      for (auto &s : v)
+        if (s.active)
+          slot(s.number) = std::move(s);
     }
-    void Tag::next(string &tag, Command command)
+    size_t Tag::next(string &tag, Command command)
     {
-      if (command_set_.find(command) != command_set_.end()) {
+      unsigned &active = active_[static_cast<size_t>(command)];
+      if (exclusive_ && active) {
         ostringstream t;
         t << "Command " << command << " is still active.";
         throw logic_error(t.str());
       }
-      command_set_.insert(command);
-      buffer_.clear();
-      buffer_.seekp(0);
-      buffer_ << prefix_ << setw(width_) << setfill('0') << value_;
-      // no std::move() because it is an r-value
-      tag = buffer_.str();
-      auto p = map_.insert(make_pair(tag, command));
-      if (!p.second) {
-        ostringstream t;
-        t << "Tag " << p.first->first << " already inserted.";
-        throw logic_error(t.str());
-      }
-      ++value_;
+      // an older tag is still active
+      while (slot(value_).active)
+        grow();
+      Slot &s = slot(value_);
+      s.number = value_;
+      s.command = command;
+      s.active = true;
+      s.start = std::chrono::steady_clock::now();
+      ++active;
+
+      char b[24];
+      char *e = b + sizeof b;
+      char *p = e;
+      size_t v = value_;
+      do {
+        *--p = '0' + v % 10;
+        v /= 10;
+      } while (v);
+      tag.assign(prefix_);
+      if (size_t(e - p) < width_)
+        tag.append(width_ - (e - p), '0');
+      tag.append(p, e);
+      return value_++;
+    }
+    void Tag::set_continuation(Continuation fn)
+    {
+      if (!value_)
+        throw logic_error("No tag generated yet");
+      slot(value_ - 1).fn = std::move(fn);
+    }
+    bool Tag::own(const char *begin, const char *end) const
+    {
+      size_t n = end - begin;
+      // more digits would overflow the tag number
+      if (n < prefix_.size() + width_ || n > prefix_.size() + 19)
+        return false;
+      if (!std::equal(prefix_.begin(), prefix_.end(), begin))
+        return false;
+      return std::all_of(begin + prefix_.size(), end,
+          [](char c) { return c >= '0' && c <= '9'; });
+    }
+    bool Tag::active(size_t number) const
+    {
+      const Slot &s = slot(number);
+      return s.active && s.number == number;
+    }
+    Command Tag::command(size_t number) const
+    {
+      return slot(number).command;
     }
-    void Tag::pop(const std::string &tag)
+    std::chrono::steady_clock::time_point Tag::start(size_t number) const
     {
-      auto i = map_.find(tag);
-      if (i == map_.end()) {
+      return slot(number).start;
+    }
+    Tag::Continuation Tag::pop(size_t number)
+    {
+      if (!active(number)) {
         stringstream t;
-        t << "Trying to pop unknown tag: " << tag;
+        t << "Trying to pop unknown tag: " << prefix_ << setw(width_)
+          << setfill('0') << number;
         throw logic_error(t.str());
       }
-      size_t r = command_set_.erase(i->second);
-      if (!r) {
+      Slot &s = slot(number);
+      s.active = false;
+      --active_[static_cast<size_t>(s.command)];
+      Continuation fn;
+      swap(fn, s.fn);
+      return fn;
+    }
+    Tag::Continuation Tag::pop(const std::string &tag)
+    {
+      if (!own(tag.data(), tag.data() + tag.size())) {
         stringstream t;
-        t << "Command " << i->second << " for tag " << tag << " unknown";
+        t << "Trying to pop unknown tag: " << tag;
         throw logic_error(t.str());
       }
-      map_.erase(i);
+      size_t number = 0;
+      for (auto i = tag.begin() + prefix_.size(); i != tag.end(); ++i)
+        number = number * 10 + (*i - '0');
+      return pop(number);
     }
 
 
-    Writer::Writer(Tag &tag, Write_Fn write_fn)
+#ifndef IMAPDL_WRITER_VERIFY
+  #define IMAPDL_WRITER_VERIFY ALWAYS
+#endif
+
+    Writer::Writer(Tag &tag, Write_Fn write_fn,
+        Verification verification, unsigned sample_interval)
       :
-        parser_(buffer_, tag_buffer_, null_cb_),
         generate_(tag),
         write_fn_(write_fn)
     {
+      set_verification(verification, sample_interval);
+    }
+    void Writer::set_verification(Verification v, unsigned sample_interval)
+    {
+      if (v == Verification::DEFAULT)
+        v = Verification::IMAPDL_WRITER_VERIFY;
+      if (v == Verification::DEBUG_ONLY) {
+#ifdef NDEBUG
+        v = Verification::NEVER;
+#else
+        v = Verification::ALWAYS;
+#endif
+      }
+      if (v == Verification::DEFAULT)
+        throw logic_error("IMAPDL_WRITER_VERIFY must not be DEFAULT");
+      if (v == Verification::SAMPLED && !sample_interval)
+        throw logic_error("sample interval must be at least 1");
+      if (v == Verification::NEVER) {
+        parser_.reset();
+      } else if (!parser_) {
+        // the parser tracks the connection state
+        if (command_ != Command::FIRST_)
+          throw logic_error("cannot enable the verification"
+              " after the first command");
+        parser_.reset(new IMAP::Server::Parser(buffer_, tag_buffer_, null_cb_));
+      }
+      verification_ = v;
+      sample_interval_ = sample_interval;
+    }
+    size_t Writer::verified() const
+    {
+      return verified_;
+    }
+    bool Writer::verify()
+    {
+      switch (verification_) {
+        case Verification::NEVER:
+          return false;
+        case Verification::SAMPLED:
+          switch (command_) {
+            case Command::LOGIN:
+            case Command::AUTHENTICATE:
+            case Command::SELECT:
+            case Command::EXAMINE:
+            case Command::CLOSE:
+            case Command::LOGOUT:
+              return true;
+            default:
+              return sampled_++ % sample_interval_ == 0;
+          }
+        default:
+          return true;
+      }
     }
     void Writer::write(std::vector<char> &v)
     {
       // to verify that we send conforming IMAP commands
-      parser_.read(v.data(), v.data()+v.size());
+      if (verify()) {
+        parser_->read(v.data(), v.data()+v.size());
+        ++verified_;
+      }
       if (write_fn_)
         write_fn_(v);
     }
     void Writer::nullary(Command c, string &tag)
     {
       generate_.next(tag, c);
+      command_ = c;
       v_.clear();
       stream_.swap_vector(v_);
       stream_ << tag << ' ' << c << "\r\n";
@@ -101,6 +238,7 @@ namespace IMAP {
     void Writer::command_start(Command c, string &tag)
     {
       generate_.next(tag, c);
+      command_ = c;
       v_.clear();
       stream_.swap_vector(v_);
       stream_ << tag << ' ' << c << ' ';
@@ -141,16 +279,62 @@ namespace IMAP {
       write_literal(mailbox);
       command_finish();
     }
-    void Writer::select(const std::string &mailbox, string &tag)
+    void Writer::list(const std::string &reference,
+        const std::string &mailbox,
+        const std::vector<Status_Attribute> &status_atts, string &tag)
+    {
+      command_start(Command::LIST, tag);
+      write_literal(reference);
+      stream_ << ' ';
+      write_literal(mailbox);
+      if (!status_atts.empty()) {
+        stream_ << " RETURN (STATUS ";
+        write_status_attributes(status_atts);
+        stream_ << ')';
+      }
+      command_finish();
+    }
+    void Writer::status(const std::string &mailbox,
+        const std::vector<Status_Attribute> &atts, string &tag)
+    {
+      if (atts.empty())
+        throw logic_error("empty status attribute list not allowed");
+      command_start(Command::STATUS, tag);
+      write_mailbox(mailbox);
+      stream_ << ' ';
+      write_status_attributes(atts);
+      command_finish();
+    }
+    void Writer::compress_deflate(string &tag)
+    {
+      command_start(Command::COMPRESS, tag);
+      stream_ << "DEFLATE";
+      command_finish();
+    }
+    void Writer::idle(string &tag)
+    {
+      nullary(Command::IDLE, tag);
+    }
+    // DONE isn't a command, thus, it isn't verified by the parser
+    void Writer::idle_done()
+    {
+      static const char done[] = "DONE\r\n";
+      v_.assign(done, done + sizeof(done) - 1);
+      if (write_fn_)
+        write_fn_(v_);
+    }
+    void Writer::select(const std::string &mailbox, string &tag, bool condstore)
     {
       command_start(Command::SELECT, tag);
-      stream_ << mailbox;
+      write_mailbox(mailbox);
+      if (condstore)
+        stream_ << " (CONDSTORE)";
       command_finish();
     }
     void Writer::examine(const std::string &mailbox, string &tag)
     {
       command_start(Command::EXAMINE, tag);
-      stream_ << mailbox;
+      write_mailbox(mailbox);
       command_finish();
     }
     void Writer::close(string &tag)
@@ -165,6 +349,41 @@ namespace IMAP {
     {
       stream_ << '{' << s.size() << "}\r\n" << s;
     }
+    // atom if possible, else a quoted string - and a literal only
+    // for 8 bit characters/CR/LF
+    void Writer::write_mailbox(const string &s)
+    {
+      bool atom = !s.empty();
+      for (unsigned char c : s) {
+        if (!c || c > 127 || c == '\r' || c == '\n') {
+          write_literal(s);
+          return;
+        }
+        if (c <= ' ' || c == 127 || strchr("(){%*\"\\", c))
+          atom = false;
+      }
+      if (atom) {
+        stream_ << s;
+        return;
+      }
+      stream_ << '"';
+      for (char c : s) {
+        if (c == '"' || c == '\\')
+          stream_ << '\\';
+        stream_ << c;
+      }
+      stream_ << '"';
+    }
+    void Writer::write_status_attributes(const std::vector<Status_Attribute> &atts)
+    {
+      stream_ << '(';
+      auto i = atts.begin();
+      stream_ << *i;
+      ++i;
+      for (; i != atts.end(); ++i)
+        stream_ << ' ' << *i;
+      stream_ << ')';
+    }
     void Writer::write_cond_literal(const string &s)
     {
       static boost::regex re("^[A-Za-z0-9]+$", boost::regex::extended);
@@ -177,10 +396,19 @@ namespace IMAP {
     {
       if (!nz)
         throw logic_error("zero sequence number not allowed");
-      if (nz == numeric_limits<uint32_t>::max())
+      if (nz == numeric_limits<uint32_t>::max()) {
         stream_ << '*';
-      else
-        stream_ << nz;
+      } else {
+        // bypasses the locale machinery of operator<<
+        char b[10];
+        char *e = b + sizeof b;
+        char *p = e;
+        do {
+          *--p = '0' + nz % 10;
+          nz /= 10;
+        } while (nz);
+        stream_.write(p, e - p);
+      }
     }
     void Writer::write_sequence(const std::pair<uint32_t, uint32_t> &seq)
     {
@@ -213,14 +441,8 @@ namespace IMAP {
       write_sequence_set(sequence_set);
       command_finish();
     }
-    void Writer::fetch(const vector<std::pair<uint32_t, uint32_t> > &sequence_set,
-            const std::vector<Fetch_Attribute> &as, string &tag)
+    void Writer::write_fetch_attributes(const std::vector<Fetch_Attribute> &as)
     {
-      if (as.empty())
-        throw logic_error("empty fetch attribute list not allowed");
-      command_start(Command::FETCH, tag);
-      write_sequence_set(sequence_set);
-      stream_ << ' ';
       if (as.size() == 1) {
         stream_ << as.front();
       } else {
@@ -233,6 +455,30 @@ namespace IMAP {
         }
         stream_ << ')';
       }
+    }
+    void Writer::fetch(const vector<std::pair<uint32_t, uint32_t> > &sequence_set,
+            const std::vector<Fetch_Attribute> &as, string &tag)
+    {
+      if (as.empty())
+        throw logic_error("empty fetch attribute list not allowed");
+      command_start(Command::FETCH, tag);
+      write_sequence_set(sequence_set);
+      stream_ << ' ';
+      write_fetch_attributes(as);
+      command_finish();
+    }
+    void Writer::uid_fetch(const vector<std::pair<uint32_t, uint32_t> > &sequence_set,
+            const std::vector<Fetch_Attribute> &as, string &tag,
+            uint64_t changedsince)
+    {
+      if (as.empty())
+        throw logic_error("empty fetch attribute list not allowed");
+      command_start(Command::UID_FETCH, tag);
+      write_sequence_set(sequence_set);
+      stream_ << ' ';
+      write_fetch_attributes(as);
+      if (changedsince)
+        stream_ << " (CHANGEDSINCE " << changedsince << ')';
       command_finish();
     }
     void Writer::write_flags(const std::vector<IMAP::Flag> &flags)
@@ -21,11 +21,14 @@
 #ifndef IMAP_CLIENT_WRITER_H
 #define IMAP_CLIENT_WRITER_H
 
+#include <array>
+#include <chrono>
 #include <functional>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <stddef.h> 
@@ -40,33 +43,89 @@ namespace IMAP {
 
   namespace Client {
 
+    // Tags are the prefix followed by the zero-padded tag number.
+    //
+    // The active tags (and their continuations) are stored in a ring
+    // that is indexed by the tag number - it only grows when a slot is
+    // still occupied by an older active tag, i.e. in the steady state
+    // no allocations happen per command.
     class Tag {
+      public:
+        using Continuation = std::function<void(void)>;
       private:
+        struct Slot {
+          size_t       number  {0};
+          Command      command {Command::FIRST_};
+          bool         active  {false};
+          Continuation fn;
+          // when the tag was generated
+          std::chrono::steady_clock::time_point start;
+        };
         std::string        prefix_    ;
         unsigned           width_  {3};
         size_t             value_  {0};
-        std::ostringstream buffer_    ;
 
-        std::map<std::string, IMAP::Client::Command> map_;
-        std::set<IMAP::Client::Command>              command_set_;
+        // size is a power of 2
+        std::vector<Slot>  ring_;
+        // number of active tags per command
+        std::array<unsigned, static_cast<size_t>(Command::LAST_)> active_ {{}};
+        bool               exclusive_ {true};
+
+        Slot &slot(size_t number);
+        const Slot &slot(size_t number) const;
+        void grow();
       public:
         Tag(const std::string &prefix = "A", unsigned width = 3);
 
-        // also store in map
-        void next(std::string &tag, Command command);
-        // pop tag from map
-        void pop(const std::string &tag);
+        // when false, the same command may be active several times
+        // (i.e. when pipelining commands)
+        void set_exclusive(bool b);
+
+        // also marks it as active, returns the tag number
+        size_t next(std::string &tag, Command command);
+        // of the tag last returned by next()
+        void set_continuation(Continuation fn);
+        // i.e. the prefix followed by at least width digits
+        bool own(const char *begin, const char *end) const;
+        bool active(size_t number) const;
+        // of an active tag
+        Command command(size_t number) const;
+        std::chrono::steady_clock::time_point start(size_t number) const;
+        // marks it as inactive, returns its continuation
+        Continuation pop(size_t number);
+        Continuation pop(const std::string &tag);
     };
 
     class Writer {
       public:
         // may be swapped or moved! Thus non-const ...
         using Write_Fn = std::function<void(std::vector<char> &buffer)>;
+
+        // How the generated commands are verified with the server parser.
+        // DEFAULT is selected at build time via IMAPDL_WRITER_VERIFY
+        // (ALWAYS, if not set).
+        enum class Verification {
+          DEFAULT,
+          NEVER,
+          ALWAYS,
+          // every n-th command - except commands that change the
+          // connection state (e.g. LOGIN, SELECT), which are always
+          // verified such that the parser can track the state
+          SAMPLED,
+          // ALWAYS, unless NDEBUG is defined, else NEVER
+          DEBUG_ONLY
+        };
       private:
         Memory::Buffer::Proxy        buffer_;
         Memory::Buffer::Proxy        tag_buffer_;
         IMAP::Server::Callback::Null null_cb_;
-        IMAP::Server::Parser         parser_;
+        // only constructed when verifying
+        std::unique_ptr<IMAP::Server::Parser> parser_;
+        Verification verification_    {Verification::ALWAYS};
+        unsigned     sample_interval_  {64};
+        size_t       sampled_          {0};
+        size_t       verified_         {0};
+        Command      command_          {Command::FIRST_};
 
         Tag      &generate_;
         Write_Fn  write_fn_;
@@ -76,19 +135,30 @@ namespace IMAP {
           boost::interprocess::basic_vectorstream<std::vector<char> >;
         VectorStream stream_;
 
+        bool verify();
         void write(std::vector<char> &v);
         void command_start(Command c, std::string &tag);
         void command_finish();
         void nullary(Command c, std::string &tag);
         void write_literal(const std::string &s);
         void write_cond_literal(const std::string &s);
+        void write_mailbox(const std::string &s);
+        void write_status_attributes(const std::vector<Status_Attribute> &atts);
         void write_sequence_nr(uint32_t nz);
         void write_sequence(const std::pair<uint32_t, uint32_t> &seq);
         void write_sequence_set(
             const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set);
         void write_flags(const std::vector<IMAP::Flag> &flags);
+        void write_fetch_attributes(const std::vector<Fetch_Attribute> &as);
       public:
-        Writer(Tag &tag, Write_Fn write_fn = nullptr);
+        Writer(Tag &tag, Write_Fn write_fn = nullptr,
+            Verification verification = Verification::DEFAULT,
+            unsigned sample_interval = 64);
+
+        // takes effect with the next command
+        void set_verification(Verification v, unsigned sample_interval = 64);
+        // number of commands that went through the server parser
+        size_t verified() const;
 
         void capability(std::string &tag);
         void noop      (std::string &tag);
@@ -99,8 +169,25 @@ namespace IMAP {
 
         void list(const std::string &reference,
             const std::string &mailbox, string &tag);
-
-        void select (const std::string &mailbox, std::string &tag);
+        // RFC5819 LIST-STATUS - the server returns STATUS responses
+        // for the listed mailboxes
+        void list(const std::string &reference,
+            const std::string &mailbox,
+            const std::vector<Status_Attribute> &status_atts, string &tag);
+        void status(const std::string &mailbox,
+            const std::vector<Status_Attribute> &atts, std::string &tag);
+
+        // RFC4978 - compression is enabled after the tagged OK
+        void compress_deflate(std::string &tag);
+
+        // RFC2177 - the IDLE command is finished with idle_done(),
+        // i.e. after the server's continuation request
+        void idle(std::string &tag);
+        void idle_done();
+
+        // condstore: RFC7162 CONDSTORE select parameter
+        void select (const std::string &mailbox, std::string &tag,
+            bool condstore = false);
         void examine(const std::string &mailbox, std::string &tag);
 
         void close  (std::string &tag);
@@ -119,6 +206,12 @@ namespace IMAP {
             const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set,
             const std::vector<Fetch_Attribute> &as, std::string &tag
             );
+        // changedsince: RFC7162 CONDSTORE fetch modifier, 0 means none
+        void uid_fetch(
+            const std::vector<std::pair<uint32_t, uint32_t> > &sequence_set,
+            const std::vector<Fetch_Attribute> &as, std::string &tag,
+            uint64_t changedsince = 0
+            );
 
     };
 
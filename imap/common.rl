@@ -88,31 +88,32 @@ action buffer_add_char
   buffer_.cont(p);
   buffer_.stop(p+1);
 }
+# Numbers are accumulated digit by digit - the grammar limits number to
+# at most 10 digits, nz_number to 11 and mod_sequence_value to 19, thus
+# the 64 bit accumulator can't overflow and the 32 bit range of number
+# and nz_number is checked once at the end. Since the accumulator is a
+# member, a number may span several read() calls.
 action number_start
 {
-  number_buffer_.start(p);
-  number_ = 0;
+  number64_ = 0;
+}
+action number_digit
+{
+  number64_ = number64_ * 10 + (fc - '0');
 }
 action number_finish
 {
-  number_buffer_.finish(p);
-  number_ = boost::lexical_cast<uint32_t>(
-      string(number_buffer_.begin(), number_buffer_.end()));
+  if (number64_ > 4294967295u)
+    throw overflow_error("number is >= 4,294,967,296");
+  number_ = number64_;
   literal_pos_ = 0;
 }
 action literal_tail_begin
 {
   buffer_.cont(p);
 }
-action call_literal_tail
-{
-  if (number_) {
-    if (convert_crlf_)
-      fcall literal_tail_convert;
-    else
-      fcall literal_tail;
-  }
-}
+# call_literal_tail is defined by the includers - the client parser
+# copies literals in bulk while the server parser calls literal_tail
 action literal_tail_cond_return
 {
   ++literal_pos_;
@@ -162,13 +163,20 @@ atom = ATOM_CHAR+ ;
 #                    ; Unsigned 32-bit integer
 #                    ; (0 <= n < 4,294,967,296)
 
-number = DIGIT{1,10} >number_start %number_finish ;
+number = DIGIT{1,10} >number_start $number_digit %number_finish ;
 
 # nz-number       = digit-nz *DIGIT
 #                    ; Non-zero unsigned 32-bit integer
 #                    ; (0 < n < 4,294,967,296)
 
-nz_number = (digit_nz DIGIT {0,10} ) >number_start %number_finish ;
+nz_number = (digit_nz DIGIT {0,10} ) >number_start $number_digit
+            %number_finish ;
+
+# RFC7162 CONDSTORE extension
+# mod-sequence-value  = 1*DIGIT
+#                        ;; Positive unsigned 63-bit integer
+
+mod_sequence_value = digit_nz DIGIT {0,18} ;
 
 # literal         = "{" number "}" CRLF *CHAR8
 #                    ; Number represents the number of CHAR8s
@@ -180,7 +188,7 @@ literal_tail := (CHAR8*) >literal_tail_begin $literal_tail_cond_return;
 # convert_literal_tail is defined in imap/literal_converter.rl
 literal_tail_convert := convert_literal_tail;
 
-literal = '{' number >number_start %number_finish '}' CRLF @buffer_clear  @call_literal_tail ;
+literal = '{' number '}' CRLF @buffer_clear  @call_literal_tail ;
 
 # QUOTED-CHAR     = <any TEXT-CHAR except quoted-specials> /
 #                   "\" quoted-specials
@@ -42,6 +42,19 @@ namespace IMAP {
     return o;
   }
 
+  static const char * const status_attribute_map[] = {
+    "MESSAGES",
+    "RECENT",
+    "UIDNEXT",
+    "UIDVALIDITY",
+    "UNSEEN"
+  };
+  std::ostream &operator<<(std::ostream &o, Status_Attribute a)
+  {
+    o << enum_str(status_attribute_map, a);
+    return o;
+  }
+
   static const char * const section_map[] = {
     "HEADER",
     "HEADER.FIELDS",
@@ -131,6 +144,10 @@ namespace IMAP {
       "LSUB",
       "STATUS",
       "APPEND",
+      // RFC4978 COMPRESS extension
+      "COMPRESS",
+      // RFC2177 IDLE extension
+      "IDLE",
       // Selected
       "CHECK",
       "CLOSE",
@@ -195,6 +212,21 @@ namespace IMAP {
       if (!(fetch_ == Fetch::BODY || fetch_ == Fetch::BODY_PEEK))
         throw logic_error("sections only allowed with BODY/BODY_PEEK attributes");
     }
+    Fetch_Attribute::Fetch_Attribute(Fetch fetch,
+        const Section_Attribute &section,
+        uint32_t offset, uint32_t length)
+      :
+        fetch_(fetch),
+        section_(section),
+        partial_(true),
+        offset_(offset),
+        length_(length)
+    {
+      if (!(fetch_ == Fetch::BODY || fetch_ == Fetch::BODY_PEEK))
+        throw logic_error("partials only allowed with BODY/BODY_PEEK attributes");
+      if (!length_)
+        throw logic_error("partial length must not be zero");
+    }
     std::ostream &Fetch_Attribute::print(std::ostream &o) const
     {
       o << fetch_;
@@ -202,6 +234,8 @@ namespace IMAP {
         o << '[';
         o << section_;
         o << ']';
+        if (partial_)
+          o << '<' << offset_ << '.' << length_ << '>';
       }
       return o;
     }
@@ -252,6 +286,8 @@ namespace IMAP {
         "UIDNEXT",
         "UIDVALIDITY",
         "UNSEEN",
+        "HIGHESTMODSEQ",
+        "NOMODSEQ",
       };
       std::ostream &operator<<(std::ostream &o, Status_Code status_code)
       {
@@ -24,6 +24,7 @@
 #include <ostream>
 #include <vector>
 #include <string>
+#include <stdint.h>
 
 namespace IMAP {
 
@@ -78,6 +79,17 @@ namespace IMAP {
   };
   std::ostream &operator<<(std::ostream &o, Flag flag);
 
+  enum class Status_Attribute {
+    FIRST_,
+    MESSAGES,
+    RECENT,
+    UIDNEXT,
+    UIDVALIDITY,
+    UNSEEN,
+    LAST_
+  };
+  std::ostream &operator<<(std::ostream &o, Status_Attribute a);
+
   namespace Client {
     enum class Command {
       FIRST_,
@@ -101,6 +113,10 @@ namespace IMAP {
       LSUB,
       STATUS,
       APPEND,
+      // RFC4978 COMPRESS extension
+      COMPRESS,
+      // RFC2177 IDLE extension
+      IDLE,
       // Selected
       CHECK,
       CLOSE,
@@ -140,12 +156,19 @@ namespace IMAP {
       private:
         Fetch fetch_ { Fetch::FIRST_ };
         Section_Attribute section_;
+        bool     partial_ {false};
+        uint32_t offset_  {0};
+        uint32_t length_  {0};
       public:
         Fetch_Attribute(Fetch fetch);
         Fetch_Attribute(Fetch fetch,
             const Section_Attribute &section);
         Fetch_Attribute(Fetch fetch,
             Section_Attribute &&section);
+        // BODY[section]<offset.length>, i.e. a partial fetch
+        Fetch_Attribute(Fetch fetch,
+            const Section_Attribute &section,
+            uint32_t offset, uint32_t length);
         std::ostream &print(std::ostream &o) const;
     };
     std::ostream &operator<<(std::ostream &o, const Fetch_Attribute &a);
@@ -195,6 +218,9 @@ namespace IMAP {
         UIDNEXT,
         UIDVALIDITY,
         UNSEEN,
+        // RFC7162 CONDSTORE extension
+        HIGHESTMODSEQ,
+        NOMODSEQ,
         LAST_
       };
       std::ostream &operator<<(std::ostream &o, Status_Code code);
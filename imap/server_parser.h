@@ -59,8 +59,9 @@ namespace IMAP {
         vector<int>              stack_vector_;
         int                     *stack          {nullptr};
         int                      top            {0};
-        Memory::Buffer::Vector   number_buffer_;
         uint32_t                 number_        {0};
+        // accumulator of the number actions
+        uint64_t                 number64_      {0};
         size_t                   literal_pos_   {0};
         bool                     convert_crlf_  {false};
         Memory::Buffer::Vector   userid_buffer_;
@@ -26,8 +26,6 @@
 
 using namespace std;
 
-#include <boost/lexical_cast.hpp>
-
 #include "lex_util.h"
 
 %%{
@@ -210,6 +208,15 @@ action call_search_key
 {
   fcall search_key;
 }
+action call_literal_tail
+{
+  if (number_) {
+    if (convert_crlf_)
+      fcall literal_tail_convert;
+    else
+      fcall literal_tail;
+  }
+}
 
 # }}}
 
@@ -273,7 +280,12 @@ list_mailbox = list_char+ | string
 
 #list            = "LIST" SP mailbox SP list-mailbox
 
+# RFC5819 LIST-STATUS (only the STATUS return option of RFC5258)
+# list-return-opts = "RETURN" SP "(" "STATUS" SP "(" status-att-list ")" ")"
+
 list = /LIST/i SP mailbox SP list_mailbox
+       ( SP /RETURN/i SP '(' /STATUS/i SP
+         '(' status_att (SP status_att)* ')' ')' )?
   ;
 
 #lsub            = "LSUB" SP mailbox SP list-mailbox
@@ -289,7 +301,10 @@ rename = /RENAME/i SP mailbox SP mailbox
 
 # select          = "SELECT" SP mailbox
 
-select = /SELECT/i SP mailbox %cb_select
+# RFC7162 CONDSTORE extension (QRESYNC parameters are not supported)
+# select-param    = "CONDSTORE"
+
+select = /SELECT/i SP mailbox %cb_select (SP '(' /CONDSTORE/i ')')?
   ;
 
 # status          = "STATUS" SP mailbox SP
@@ -309,6 +324,21 @@ subscribe = /SUBSCRIBE/i SP mailbox
 unsubscribe = /UNSUBSCRIBE/ SP mailbox
   ;
 
+# RFC4978 IMAP COMPRESS extension
+# compress        = "COMPRESS" SP algorithm
+# algorithm       = "DEFLATE"
+
+compress = /COMPRESS/i SP /DEFLATE/i
+  ;
+
+# RFC2177 IMAP4 IDLE command
+# idle            = "IDLE" CRLF "DONE"
+#
+# the DONE line isn't a command, i.e. it isn't parsed here
+
+idle = /IDLE/i
+  ;
+
 #command-auth    = append / create / delete / examine / list / lsub /
 #                  rename / select / status / subscribe / unsubscribe
 #                    ; Valid only in Authenticated or Selected state
@@ -324,6 +354,10 @@ command_auth = append
              | status
              | subscribe
              | unsubscribe
+             # RFC4978 IMAP COMPRESS extension
+             | compress
+             # RFC2177 IMAP4 IDLE command
+             | idle
   ;
 
 # authenticate    = "AUTHENTICATE" SP auth-type *(CRLF base64)
@@ -428,9 +462,13 @@ fetch_att = /ENVELOPE/i
 #fetch           = "FETCH" SP sequence-set SP ("ALL" / "FULL" / "FAST" /
 #                  fetch-att / "(" fetch-att *(SP fetch-att) ")")
 
+# RFC7162 CONDSTORE extension
+# fetch-modifier  = "CHANGEDSINCE" SP mod-sequence-value
+
 fetch = /FETCH/i SP sequence_set SP
                  ( /ALL/i | /FULL/i | /FAST/i |
                    fetch_att | '(' fetch_att (SP fetch_att)* ')' )
+                 ( SP '(' /CHANGEDSINCE/i SP mod_sequence_value ')' )?
   ;
 
 #store-att-flags = (["+" / "-"] "FLAGS" [".SILENT"]) SP
@@ -620,6 +658,7 @@ namespace IMAP {
       const char *pe = end;
       Buffer::Resume bur(buffer_, p, pe);
       Buffer::Resume tar(tag_buffer_, p, pe);
+      Buffer::Resume uir(userid_buffer_, p, pe);
       %% write exec;
       if (cs == %%{write error;}%%) {
         throw_lex_error("IMAP server automaton in error state", begin, p, pe);
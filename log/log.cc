@@ -19,6 +19,7 @@
 
 }}} */
 #include "log.h"
+#include "ring.h"
 
 #include "enum.h"
 
@@ -31,12 +32,26 @@
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/file.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/log/sinks/text_file_backend.hpp>
+#include <boost/core/null_deleter.hpp>
+#include <boost/make_shared.hpp>
 
 // needed for attributes::timer()
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
 //using namespace std;
 
 
@@ -63,6 +78,161 @@ namespace Log {
     return o;
   }
 
+  // Queueing strategy for boost::log::sinks::asynchronous_sink:
+  // producers only touch the lock-free ring - the sink thread polls
+  // it every few milliseconds and is only woken up early when the
+  // ring is half full, i.e. logging a record usually doesn't involve
+  // a system call. When the ring is full, producers yield until the
+  // sink thread catches up, i.e. records aren't dropped.
+  class Ring_Queue {
+    private:
+      static const size_t CAPACITY = 4096;
+      static const unsigned POLL_MS  = 10;
+
+      Ring<boost::log::record_view> ring_;
+      std::atomic<bool>             waiting_     {false};
+      std::atomic<bool>             interrupted_ {false};
+      std::mutex                    mutex_;
+      std::condition_variable       cond_;
+
+      void wake_up()
+      {
+        // pairs with the fence in dequeue_ready()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_.load(std::memory_order_relaxed)) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          cond_.notify_one();
+        }
+      }
+    protected:
+      Ring_Queue() : ring_(CAPACITY) {}
+      template <typename ArgsT>
+      explicit Ring_Queue(ArgsT const&) : ring_(CAPACITY) {}
+
+      void enqueue(boost::log::record_view const &rec)
+      {
+        while (!ring_.try_push(rec)) {
+          wake_up();
+          std::this_thread::yield();
+        }
+        if (ring_.size() >= CAPACITY / 2)
+          wake_up();
+      }
+      bool try_enqueue(boost::log::record_view const &rec)
+      {
+        if (!ring_.try_push(rec))
+          return false;
+        if (ring_.size() >= CAPACITY / 2)
+          wake_up();
+        return true;
+      }
+      bool try_dequeue_ready(boost::log::record_view &rec)
+      {
+        return ring_.try_pop(rec);
+      }
+      bool try_dequeue(boost::log::record_view &rec)
+      {
+        return ring_.try_pop(rec);
+      }
+      bool dequeue_ready(boost::log::record_view &rec)
+      {
+        if (ring_.try_pop(rec))
+          return true;
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (;;) {
+          if (interrupted_.exchange(false)) {
+            waiting_.store(false, std::memory_order_relaxed);
+            return false;
+          }
+          if (ring_.try_pop(rec)) {
+            waiting_.store(false, std::memory_order_relaxed);
+            return true;
+          }
+          cond_.wait_for(lock, std::chrono::milliseconds(POLL_MS));
+        }
+      }
+      void interrupt_dequeue()
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        interrupted_.store(true);
+        cond_.notify_one();
+      }
+  };
+  // odr-used by wait_for()
+  const unsigned Ring_Queue::POLL_MS;
+
+  struct Async_Sink {
+    boost::shared_ptr<boost::log::sinks::sink> sink;
+    std::function<void()>                      stop;
+  };
+  static std::vector<Async_Sink> &async_sinks()
+  {
+    static std::vector<Async_Sink> v;
+    return v;
+  }
+  // registered via atexit() - the sink threads must be finished
+  // before the static destructors run
+  static void stop_async_sinks()
+  {
+    for (auto &s : async_sinks()) {
+      boost::log::core::get()->remove_sink(s.sink);
+      s.stop();
+    }
+    async_sinks().clear();
+  }
+  static void register_async_sink(Async_Sink s)
+  {
+    // constructed before the handler is registered, i.e. destructed
+    // after it ran
+    auto &v = async_sinks();
+    static bool registered = false;
+    if (!registered) {
+      atexit(stop_async_sinks);
+      registered = true;
+    }
+    v.push_back(std::move(s));
+  }
+
+  template <typename Backend, typename Formatter>
+  static void add_sink(const boost::shared_ptr<Backend> &backend,
+      const Formatter &formatter, Severity severity_threshold, bool async)
+  {
+    namespace sinks = boost::log::sinks;
+    if (async) {
+      typedef sinks::asynchronous_sink<Backend, Ring_Queue> Sink;
+      auto sink = boost::make_shared<Sink>(backend);
+      sink->set_formatter(formatter);
+      sink->set_filter(severity <= severity_threshold);
+      boost::log::core::get()->add_sink(sink);
+      register_async_sink(Async_Sink{sink, [sink](){
+          sink->stop();
+          sink->flush();
+          }});
+    } else {
+      typedef sinks::synchronous_sink<Backend> Sink;
+      auto sink = boost::make_shared<Sink>(backend);
+      sink->set_formatter(formatter);
+      sink->set_filter(severity <= severity_threshold);
+      boost::log::core::get()->add_sink(sink);
+    }
+  }
+
+  static boost::shared_ptr<boost::log::sinks::text_file_backend>
+    file_backend(const std::string &filename)
+  {
+    return boost::shared_ptr<boost::log::sinks::text_file_backend>(
+        new boost::log::sinks::text_file_backend(
+          boost::log::keywords::file_name = filename));
+  }
+
+  void flush()
+  {
+    for (auto &s : async_sinks())
+      s.sink->flush();
+  }
+
   static void format_console(boost::log::record_view const& rec,
       boost::log::formatting_ostream& strm)
   {
@@ -72,21 +242,21 @@ namespace Log {
       << rec[boost::log::expressions::smessage];
   }
 
-  static void setup_console(Severity severity_threshold)
+  static void setup_console(Severity severity_threshold, bool async)
   {
-    auto clog = boost::log::add_console_log();
-    clog->set_formatter(&format_console);
-    clog->set_filter(severity <= severity_threshold);
+    auto backend = boost::make_shared<boost::log::sinks::text_ostream_backend>();
+    backend->add_stream(
+        boost::shared_ptr<std::ostream>(&std::clog, boost::null_deleter()));
+    add_sink(backend, &format_console, severity_threshold, async);
   }
-  void setup_file(Severity severity_threshold, const std::string &filename)
+  void setup_file(Severity severity_threshold, const std::string &filename,
+      bool async)
   {
     if (filename.empty())
       return;
-    auto flog = boost::log::add_file_log(
-      boost::log::keywords::file_name = filename
-      //, boost::log::keywords::open_mode = std::ios_base::app | std::ios_base::out
-      );
-    flog->set_formatter(
+    add_sink(file_backend(filename
+        //, boost::log::keywords::open_mode = std::ios_base::app | std::ios_base::out
+        ),
         boost::log::expressions::stream
         << std::setw(5) << std::setfill('0')
         << boost::log::expressions::attr< unsigned >("LineID")
@@ -99,22 +269,21 @@ namespace Log {
           boost::log::keywords::format = "%n@%f:%l")
         << "> "
         << boost::log::expressions::smessage
-        );
-    flog->set_filter(severity <= severity_threshold);
+        , severity_threshold, async);
   }
-  void setup_vanilla_file(Severity severity_threshold, const std::string &filename)
+  void setup_vanilla_file(Severity severity_threshold, const std::string &filename,
+      bool async)
   {
     if (filename.empty())
       return;
-    auto flog = boost::log::add_file_log(boost::log::keywords::file_name = filename);
-    flog->set_formatter(boost::log::expressions::stream
-        << "[" << severity << "] " << boost::log::expressions::smessage);
-    flog->set_filter(severity <= severity_threshold);
+    add_sink(file_backend(filename), boost::log::expressions::stream
+        << "[" << severity << "] " << boost::log::expressions::smessage,
+        severity_threshold, async);
   }
 
   boost::log::sources::severity_logger< Severity > 
     create(Severity sev, Severity file_severity,
-        const std::string &logfile)
+        const std::string &logfile, bool async)
     {
       BOOST_LOG_SCOPED_THREAD_ATTR("Timeline", boost::log::attributes::timer());
       boost::log::core::get()->add_global_attribute("Scope",
@@ -122,8 +291,8 @@ namespace Log {
       boost::log::add_common_attributes();
       boost::log::sources::severity_logger< Severity > lg(boost::log::keywords::severity = INFO);
       lg.add_attribute("Timeline", boost::log::attributes::timer());
-      setup_console(sev);
-      setup_file(file_severity, logfile);
+      setup_console(sev, async);
+      setup_file(file_severity, logfile, async);
       return lg;
     }
 
@@ -24,6 +24,39 @@
 #include <ostream>
 
 #include <boost/log/sources/severity_logger.hpp>
+#include <boost/log/sources/record_ostream.hpp>
+#include <boost/log/attributes/named_scope.hpp>
+
+#include "config.h"
+
+// The most verbose severity that is compiled in - less severe
+// statements (and the named scopes below DEBUG) are eliminated at
+// compile time, i.e. they can't be enabled with -v at runtime.
+#ifndef IMAPDL_LOG_MAX_SEVERITY
+  #define IMAPDL_LOG_MAX_SEVERITY INSANE
+#endif
+
+#define LOG_LEVEL_FATAL   1
+#define LOG_LEVEL_ERROR   2
+#define LOG_LEVEL_WARN    3
+#define LOG_LEVEL_MSG     4
+#define LOG_LEVEL_INFO    5
+#define LOG_LEVEL_DEBUG   6
+#define LOG_LEVEL_DEBUG_V 7
+#define LOG_LEVEL_INSANE  8
+#define LOG_LEVEL_(s) LOG_LEVEL_ ## s
+#define LOG_LEVEL(s) LOG_LEVEL_(s)
+
+// use these instead of BOOST_LOG_SEV()/BOOST_LOG_FUNCTION() - a for
+// instead of an if statement such that there is no dangling else
+#define LOG_SEV(lg, sev) \
+  for (bool log_on_ = ::Log::compiled_in(sev); log_on_; log_on_ = false) \
+    BOOST_LOG_SEV(lg, sev)
+#if LOG_LEVEL(IMAPDL_LOG_MAX_SEVERITY) >= LOG_LEVEL_DEBUG
+  #define LOG_FUNCTION() BOOST_LOG_FUNCTION()
+#else
+  #define LOG_FUNCTION()
+#endif
 
 namespace Log {
 
@@ -41,11 +74,21 @@ namespace Log {
   };
   std::ostream &operator<<(std::ostream &o, Severity s);
 
+  static const Severity MAX_SEVERITY = IMAPDL_LOG_MAX_SEVERITY;
+  constexpr bool compiled_in(Severity s) { return s <= MAX_SEVERITY; }
+
+  // async: the sinks format and write the records in a background
+  // thread, fed by a lock-free ring buffer - they are flushed at exit
+  // or via flush()
   boost::log::sources::severity_logger< Severity > 
     create(Severity severity, Severity file_severity,
-        const std::string &logfile = std::string());
-  void setup_file(Severity severity_threshold, const std::string &filename);
-  void setup_vanilla_file(Severity severity_threshold, const std::string &filename);
+        const std::string &logfile = std::string(), bool async = false);
+  void setup_file(Severity severity_threshold, const std::string &filename,
+      bool async = false);
+  void setup_vanilla_file(Severity severity_threshold, const std::string &filename,
+      bool async = false);
+  // waits until the asynchronous sinks have written all records
+  void flush();
 }
 
 #endif
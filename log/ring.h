@@ -0,0 +1,122 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdexcept>
+#include <utility>
+
+namespace Log {
+
+  // Bounded lock-free queue (multiple producers, multiple consumers),
+  // cf. Dmitry Vyukov's bounded MPMC queue: each cell carries a
+  // sequence number that tells producers and consumers whether it
+  // is free or filled in the current lap. The capacity is a power
+  // of 2.
+  template <typename T>
+  class Ring {
+    private:
+      struct Cell {
+        std::atomic<size_t> seq;
+        T                   value;
+      };
+      std::unique_ptr<Cell[]> cells_;
+      size_t                  mask_;
+      // separate cache lines for the producer and consumer positions
+      alignas(64) std::atomic<size_t> head_ {0};
+      alignas(64) std::atomic<size_t> tail_ {0};
+    public:
+      explicit Ring(size_t capacity)
+        :
+          cells_(new Cell[capacity]),
+          mask_(capacity - 1)
+      {
+        if (capacity < 2 || (capacity & mask_))
+          throw std::invalid_argument("ring capacity must be a power of 2");
+        for (size_t i = 0; i < capacity; ++i)
+          cells_[i].seq.store(i, std::memory_order_relaxed);
+      }
+      Ring(const Ring &) = delete;
+      Ring &operator=(const Ring &) = delete;
+
+      size_t capacity() const { return mask_ + 1; }
+      // approximation when other threads push/pop concurrently
+      size_t size() const
+      {
+        size_t t = tail_.load(std::memory_order_relaxed);
+        size_t h = head_.load(std::memory_order_relaxed);
+        return h > t ? h - t : 0;
+      }
+
+      // returns false if the ring is full
+      bool try_push(const T &v)
+      {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+          Cell &c = cells_[pos & mask_];
+          size_t seq = c.seq.load(std::memory_order_acquire);
+          ptrdiff_t d = ptrdiff_t(seq) - ptrdiff_t(pos);
+          if (!d) {
+            if (head_.compare_exchange_weak(pos, pos + 1,
+                  std::memory_order_relaxed)) {
+              c.value = v;
+              c.seq.store(pos + 1, std::memory_order_release);
+              return true;
+            }
+          } else if (d < 0) {
+            return false;
+          } else {
+            pos = head_.load(std::memory_order_relaxed);
+          }
+        }
+      }
+      // returns false if the ring is empty - the cell is moved from,
+      // i.e. it doesn't keep the value alive
+      bool try_pop(T &v)
+      {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+          Cell &c = cells_[pos & mask_];
+          size_t seq = c.seq.load(std::memory_order_acquire);
+          ptrdiff_t d = ptrdiff_t(seq) - ptrdiff_t(pos + 1);
+          if (!d) {
+            if (tail_.compare_exchange_weak(pos, pos + 1,
+                  std::memory_order_relaxed)) {
+              v = std::move(c.value);
+              c.value = T();
+              c.seq.store(pos + mask_ + 1, std::memory_order_release);
+              return true;
+            }
+          } else if (d < 0) {
+            return false;
+          } else {
+            pos = tail_.load(std::memory_order_relaxed);
+          }
+        }
+      }
+  };
+
+}
+
+#endif
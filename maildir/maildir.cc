@@ -24,10 +24,13 @@
 #include <sstream>
 #include <random>
 #include <array>
+#include <atomic>
 #include <exception>
 #include <stdexcept>
 using namespace std;
 
+#include <errno.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -37,6 +40,8 @@ namespace fs = boost::filesystem;
 #include <boost/io/ios_state.hpp>
 
 #include <ixxx/ixxx.h>
+
+#include <metrics/metrics.h>
 using namespace ixxx;
 
 // http://en.wikipedia.org/wiki/Maildir
@@ -75,6 +80,10 @@ Maildir::Maildir(const string &path, bool create_it)
 }
 Maildir::~Maildir()
 {
+  try {
+    commit();
+  } catch (const std::exception&) {
+  }
   try {
     posix::close(tmp_dir_fd_);
     posix::close(new_dir_fd_);
@@ -94,11 +103,14 @@ void Maildir::add_time(ostream &o)
   o << t;
 }
 
+// process wide - several Maildir objects may deliver into the same
+// directory (e.g. when downloading with multiple connections)
+static std::atomic<size_t> delivery_;
+
 void Maildir::add_delivery_id(ostream &o)
 {
   boost::io::ios_flags_saver ifs(o);
-  o << "P" << ::getpid() << "Q" << delivery_ << "R" << hex << g();
-  ++delivery_;
+  o << "P" << ::getpid() << "Q" << delivery_++ << "R" << hex << g();
 }
 
 void Maildir::add_hostname(ostream &o)
@@ -133,6 +145,20 @@ void Maildir::create_tmp_name(std::string &dirname, std::string &filename)
   create_tmp_name(filename);
 }
 
+void Maildir::resume_tmp_name(const std::string &filename)
+{
+  if (!name_.empty())
+    throw std::runtime_error("last tmp name not delivered - call commit()");
+  name_ = filename;
+}
+
+string Maildir::tmp_path(const std::string &filename) const
+{
+  ostringstream p;
+  p << tmp_dir_name_ << '/' << filename;
+  return p.str();
+}
+
 string Maildir::create_tmp_name()
 {
   string d, f;
@@ -186,17 +212,124 @@ void Maildir::move(int new_or_cur_fd)
     new_name += flags_;
   }
 
-  posix::linkat(tmp_dir_fd_, name_, new_or_cur_fd, new_name, 0);
-  // assuming same logic as with open/creat ...
-  posix::fsync(new_or_cur_fd);
-  posix::unlinkat(tmp_dir_fd_, name_, 0);
+  if (batch_size_ > 1) {
+    // the tmp file isn't synced yet, i.e. it is only linked by commit()
+    uncommitted_.push_back(Pending { std::move(name_), new_or_cur_fd,
+        std::move(new_name) });
+  } else {
+    posix::linkat(tmp_dir_fd_, name_, new_or_cur_fd, new_name, 0);
+    // assuming same logic as with open/creat ...
+    sync(new_or_cur_fd);
+    posix::unlinkat(tmp_dir_fd_, name_, 0);
+  }
   name_.clear();
   flags_.clear();
 }
 
+void Maildir::set_batch_size(size_t n)
+{
+  if (!n)
+    throw std::logic_error("batch size must be at least 1");
+  if (n < 2)
+    commit();
+  batch_size_ = n;
+}
+size_t Maildir::uncommitted() const
+{
+  return uncommitted_.size();
+}
+// the tmp files of a batch are written without fsync - on Linux one
+// syncfs() is much cheaper than an fsync per message
+void Maildir::sync_tmp()
+{
+  if (uncommitted_.empty())
+    return;
+  auto start = Metrics::Clock::now();
+#ifdef __linux__
+  if (::syncfs(tmp_dir_fd_) == -1) {
+    ostringstream o;
+    o << "syncfs of " << tmp_dir_name_ << " failed: " << strerror(errno);
+    throw std::runtime_error(o.str());
+  }
+#else
+  for (auto &x : uncommitted_) {
+    int fd = posix::openat(tmp_dir_fd_, x.tmp_name, O_RDONLY);
+    posix::fsync(fd);
+    posix::close(fd);
+  }
+#endif
+  if (fsync_histogram_)
+    fsync_histogram_->add(Metrics::micros(Metrics::Clock::now() - start));
+}
+// order: tmp data durable, then the links, then the tmp names are removed
+// - a crash in between leaves at most duplicate names (tmp and new/cur)
+void Maildir::commit()
+{
+  if (uncommitted_.empty())
+    return;
+  sync_tmp();
+  bool new_dirty = false;
+  bool cur_dirty = false;
+  for (auto &x : uncommitted_) {
+    posix::linkat(tmp_dir_fd_, x.tmp_name, x.dir_fd, x.name, 0);
+    if (x.dir_fd == cur_dir_fd_)
+      cur_dirty = true;
+    else
+      new_dirty = true;
+  }
+  if (new_dirty)
+    sync(new_dir_fd_);
+  if (cur_dirty)
+    sync(cur_dir_fd_);
+  for (auto &x : uncommitted_)
+    posix::unlinkat(tmp_dir_fd_, x.tmp_name, 0);
+  uncommitted_.clear();
+}
+void Maildir::sync(int fd)
+{
+  if (!fsync_histogram_) {
+    posix::fsync(fd);
+    return;
+  }
+  auto start = Metrics::Clock::now();
+  posix::fsync(fd);
+  fsync_histogram_->add(Metrics::micros(Metrics::Clock::now() - start));
+}
+void Maildir::set_fsync_histogram(Metrics::Histogram *h)
+{
+  fsync_histogram_ = h;
+}
+
 void Maildir::clear()
 {
   name_.clear();
   flags_.clear();
 }
 
+void Maildir::select_folder(const std::string &folder)
+{
+  if (!name_.empty())
+    throw std::runtime_error("last tmp name not delivered - call commit()");
+  commit();
+  string p(path_);
+  if (!folder.empty()) {
+    p += "/.";
+    p += folder;
+  }
+  const array<const char*, 3> subs = {{ "cur", "new", "tmp" }};
+  for (auto x : subs)
+    fs::create_directories(p + '/' + x);
+  if (!folder.empty() && !fs::exists(p + "/maildirfolder")) {
+    int fd = posix::open(p + "/maildirfolder", O_CREAT | O_WRONLY, 0666);
+    posix::close(fd);
+  }
+  int dir_fd  = posix::open(p, O_RDONLY);
+  int new_fd  = posix::openat(dir_fd, "new", O_RDONLY);
+  int cur_fd  = posix::openat(dir_fd, "cur", O_RDONLY);
+  posix::close(dir_fd);
+  posix::close(new_dir_fd_);
+  posix::close(cur_dir_fd_);
+  new_dir_fd_ = new_fd;
+  cur_dir_fd_ = cur_fd;
+}
+
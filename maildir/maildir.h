@@ -22,10 +22,13 @@
 #define MAILDIR_H
 
 #include <string>
+#include <vector>
 #include <random>
 #include <ostream>
 #include <stddef.h> 
 
+namespace Metrics { class Histogram; }
+
 class Maildir {
   private:
     std::string  path_;
@@ -35,14 +38,24 @@ class Maildir {
     int          tmp_dir_fd_   {-1};
     int          new_dir_fd_   {-1};
     int          cur_dir_fd_   {-1};
-    size_t       delivery_     {0};
     std::mt19937 g;
+    // group commit: moves that are only done by commit()
+    struct Pending {
+      std::string tmp_name;
+      int         dir_fd;
+      std::string name;
+    };
+    size_t       batch_size_   {1};
+    std::vector<Pending> uncommitted_;
+    Metrics::Histogram *fsync_histogram_ {nullptr};
 
     void add_time       (std::ostream &o);
     void add_delivery_id(std::ostream &o);
     void add_hostname   (std::ostream &o);
     void set_flags(const std::string &flags);
     void move(int new_or_cur_fd);
+    void sync(int fd);
+    void sync_tmp();
   public:
     Maildir(const Maildir &) =delete;
     Maildir &operator=(const Maildir &) =delete;
@@ -55,10 +68,33 @@ class Maildir {
     std::string create_tmp_name();
     void create_tmp_name(std::string &dirname, std::string &filename);
     void create_tmp_name(std::string &filename);
+    // continues the delivery of an existing tmp file - e.g. of a
+    // message that was only partially downloaded by an earlier run
+    void resume_tmp_name(const std::string &filename);
+    std::string tmp_path(const std::string &filename) const;
 
     void move_to_new();
     void move_to_cur(const std::string &flags = std::string());
     void clear();
+
+    // Maildir++: further deliveries go to the subfolder .folder (created
+    // if necessary), an empty name selects the top-level maildir. The
+    // tmp directory of the top-level maildir is used for all folders.
+    void select_folder(const std::string &folder);
+
+    // With a batch size greater than 1, move_to_new()/move_to_cur() only
+    // record the message - commit() syncs the tmp files (which the caller
+    // writes without fsync), links them into new/cur, syncs these
+    // directories and removes the tmp names, i.e. once per batch instead
+    // of once per message. Thus, a message never shows up in new/cur
+    // before its data is durable. The caller decides when a batch is
+    // complete.
+    void set_batch_size(size_t n);
+    size_t uncommitted() const;
+    void commit();
+
+    // the duration of each directory fsync is added (in us), if set
+    void set_fsync_histogram(Metrics::Histogram *h);
 };
 
 #endif
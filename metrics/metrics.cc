@@ -0,0 +1,210 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "metrics.h"
+
+#include <enum.h>
+
+#include <ixxx/ixxx.h>
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace Metrics {
+
+  static const char * const phase_map[] = {
+    "resolve",
+    "connect",
+    "handshake",
+    "login",
+    "select",
+    "fetch",
+    "store",
+    "expunge"
+  };
+  const char *phase_str(Phase p)
+  {
+    return enum_str(phase_map, p);
+  }
+  ostream &operator<<(ostream &o, Phase p)
+  {
+    o << phase_str(p);
+    return o;
+  }
+
+  void Histogram::merge(const Histogram &o)
+  {
+    if (!o.count_)
+      return;
+    for (size_t i = 0; i < BUCKETS; ++i)
+      buckets_[i] += o.buckets_[i];
+    if (!count_ || o.min_ < min_)
+      min_ = o.min_;
+    if (o.max_ > max_)
+      max_ = o.max_;
+    count_ += o.count_;
+    sum_ += o.sum_;
+  }
+  uint64_t Histogram::upper(size_t i)
+  {
+    return i < 64 ? uint64_t(1) << i : UINT64_MAX;
+  }
+  uint64_t Histogram::quantile(double q) const
+  {
+    if (!count_)
+      return 0;
+    uint64_t rank = uint64_t(q * count_);
+    if (rank >= count_)
+      rank = count_ - 1;
+    uint64_t n = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      n += buckets_[i];
+      if (n > rank)
+        return std::min(upper(i), max_);
+    }
+    return max_;
+  }
+
+  void Registry::merge(const Registry &o)
+  {
+    for (size_t i = 0; i < phases.size(); ++i)
+      phases[i].merge(o.phases[i]);
+    message_size.merge(o.message_size);
+    delivery_latency.merge(o.delivery_latency);
+    fsync.merge(o.fsync);
+    parse.merge(o.parse);
+    messages       += o.messages;
+    bytes_read     += o.bytes_read;
+    bytes_written  += o.bytes_written;
+    bytes_inflated += o.bytes_inflated;
+  }
+
+  static void write_json_string(ostream &o, const string &s)
+  {
+    o << '"';
+    for (unsigned char c : s) {
+      if (c == '"' || c == '\\')
+        o << '\\' << c;
+      else if (c < 0x20)
+        o << "\\u" << hex << setw(4) << setfill('0') << unsigned(c)
+          << dec << setfill(' ');
+      else
+        o << c;
+    }
+    o << '"';
+  }
+
+  // only the non-empty buckets, as [upper bound, count] pairs
+  void write_json(ostream &o, const Histogram &h)
+  {
+    o << "{\"count\": " << h.count() << ", \"sum\": " << h.sum()
+      << ", \"min\": " << h.min() << ", \"max\": " << h.max()
+      << ", \"p50\": " << h.quantile(0.5) << ", \"p90\": " << h.quantile(0.9)
+      << ", \"p99\": " << h.quantile(0.99) << ", \"buckets\": [";
+    bool first = true;
+    for (size_t i = 0; i < Histogram::BUCKETS; ++i) {
+      if (!h.buckets()[i])
+        continue;
+      if (!first)
+        o << ", ";
+      first = false;
+      o << '[' << Histogram::upper(i) << ", " << h.buckets()[i] << ']';
+    }
+    o << "]}";
+  }
+
+  void write_json(ostream &o, const Registry &r)
+  {
+    o << "{\"messages\": " << r.messages
+      << ", \"bytes_read\": " << r.bytes_read
+      << ", \"bytes_written\": " << r.bytes_written
+      << ", \"bytes_inflated\": " << r.bytes_inflated
+      << ",\n  \"phases_us\": {";
+    for (size_t i = 1; i < static_cast<size_t>(Phase::LAST_); ++i) {
+      o << (i > 1 ? ",\n    " : "\n    ") << '"'
+        << static_cast<Phase>(i) << "\": ";
+      write_json(o, r.phases[i]);
+    }
+    o << "},\n  \"message_size_bytes\": ";
+    write_json(o, r.message_size);
+    o << ",\n  \"delivery_latency_us\": ";
+    write_json(o, r.delivery_latency);
+    o << ",\n  \"fsync_us\": ";
+    write_json(o, r.fsync);
+    o << ",\n  \"parse_ns\": ";
+    write_json(o, r.parse);
+    o << '}';
+  }
+
+  Exporter::Exporter(const string &filename)
+    :
+      filename_(filename),
+      start_(Clock::now())
+  {
+  }
+  const string &Exporter::filename() const
+  {
+    return filename_;
+  }
+  void Exporter::update(const string &account, const Registry &r)
+  {
+    lock_guard<mutex> lock(mutex_);
+    accounts_[account] = r;
+  }
+  void Exporter::write()
+  {
+    // also serializes the writers of the tmp file
+    lock_guard<mutex> lock(mutex_);
+    ostringstream o;
+    Registry total;
+    for (auto &a : accounts_)
+      total.merge(a.second);
+    o << "{\"seconds\": "
+      << chrono::duration<double>(Clock::now() - start_).count()
+      << ",\n\"total\": ";
+    write_json(o, total);
+    o << ",\n\"accounts\": {";
+    bool first = true;
+    for (auto &a : accounts_) {
+      o << (first ? "\n" : ",\n");
+      first = false;
+      write_json_string(o, a.first);
+      o << ": ";
+      write_json(o, a.second);
+    }
+    o << "}}\n";
+
+    // readers never see a partially written file
+    string tmp(filename_ + ".tmp");
+    {
+      ofstream f(tmp, ios::binary | ios::trunc);
+      f << o.str();
+      f.close();
+      if (!f)
+        throw runtime_error("Could not write metrics file " + tmp);
+    }
+    ixxx::posix::rename(tmp, filename_);
+  }
+
+}
@@ -0,0 +1,148 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef METRICS_METRICS_H
+#define METRICS_METRICS_H
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+// Instrumentation of download runs - the hot paths only add values to
+// histograms (i.e. a few integer operations), the aggregation and the
+// export as JSON happen when the metrics are written.
+namespace Metrics {
+
+  using Clock = std::chrono::steady_clock;
+
+  enum class Phase {
+    FIRST_,
+    RESOLVE,
+    CONNECT,
+    HANDSHAKE,
+    LOGIN,
+    SELECT,
+    FETCH,
+    STORE,
+    EXPUNGE,
+    LAST_
+  };
+  const char *phase_str(Phase p);
+  std::ostream &operator<<(std::ostream &o, Phase p);
+
+  inline uint64_t micros(Clock::duration d)
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  }
+  inline uint64_t nanos(Clock::duration d)
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+  }
+
+  // Power of 2 buckets, i.e. bucket i counts the values v with
+  // 2^(i-1) <= v < 2^i (bucket 0 counts zeros).
+  class Histogram {
+    public:
+      static const size_t BUCKETS = 65;
+    private:
+      std::array<uint64_t, BUCKETS> buckets_ {{}};
+      uint64_t count_ {0};
+      uint64_t sum_   {0};
+      uint64_t min_   {0};
+      uint64_t max_   {0};
+    public:
+      void add(uint64_t v)
+      {
+        ++buckets_[v ? 64 - __builtin_clzll(v) : 0];
+        if (!count_ || v < min_)
+          min_ = v;
+        if (v > max_)
+          max_ = v;
+        ++count_;
+        sum_ += v;
+      }
+      void merge(const Histogram &o);
+
+      uint64_t count() const { return count_; }
+      uint64_t sum()   const { return sum_;   }
+      uint64_t min()   const { return min_;   }
+      uint64_t max()   const { return max_;   }
+      const std::array<uint64_t, BUCKETS> &buckets() const { return buckets_; }
+      // exclusive upper bound of bucket i (saturated for the last one)
+      static uint64_t upper(size_t i);
+      // upper bound of the bucket that contains the q-quantile,
+      // capped by the maximum
+      uint64_t quantile(double q) const;
+  };
+
+  struct Registry {
+    // latency of the network setup and of the IMAP commands (in us)
+    std::array<Histogram, static_cast<size_t>(Phase::LAST_)> phases;
+    // of each delivered message
+    Histogram message_size;
+    // from the begin of the FETCH response until the message is
+    // delivered into the maildir (in us)
+    Histogram delivery_latency;
+    // maildir fsync() calls (in us)
+    Histogram fsync;
+    // parsing of the received data, per read (in ns)
+    Histogram parse;
+    uint64_t  messages       {0};
+    uint64_t  bytes_read     {0};
+    uint64_t  bytes_written  {0};
+    uint64_t  bytes_inflated {0};
+
+    Histogram &phase(Phase p) { return phases[static_cast<size_t>(p)]; }
+    const Histogram &phase(Phase p) const
+    {
+      return phases[static_cast<size_t>(p)];
+    }
+    void merge(const Registry &o);
+  };
+
+  void write_json(std::ostream &o, const Histogram &h);
+  void write_json(std::ostream &o, const Registry &r);
+
+  // Collects the latest metrics of each account and writes them
+  // (including the total) to a file - thread-safe, such that each
+  // account worker can update its snapshot.
+  class Exporter {
+    private:
+      std::mutex                       mutex_;
+      std::string                      filename_;
+      Clock::time_point                start_;
+      std::map<std::string, Registry>  accounts_;
+    public:
+      explicit Exporter(const std::string &filename);
+      const std::string &filename() const;
+      // replaces the snapshot of the account
+      void update(const std::string &account, const Registry &r);
+      // atomically replaces the file
+      void write();
+  };
+
+}
+
+#endif
@@ -22,6 +22,7 @@
 #define MIME_BASE64_DECODER_H
 
 #include <functional>
+#include <string>
 #include <stdint.h>
 
 #include <buffer/buffer.h>
@@ -38,6 +39,8 @@ namespace MIME {
         Memory::Buffer::Base &conv_buffer_;
         std::string           sentinel_;
         const char           *next_         {nullptr};
+
+        const char *exec(const char *p, const char *pe);
       public:
         Decoder(Memory::Buffer::Base &buffer,
             const std::string &sentinel = std::string());
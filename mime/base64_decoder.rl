@@ -31,6 +31,9 @@
 
 machine base64_decoder;
 
+# hold_it and group_end are defined by the includer - group_end is
+# executed after each complete group of 4 characters
+
 # {{{ Actions
 
 action set_base64_val_Alph
@@ -136,8 +139,8 @@ b_encoded_word =
     pad         -> e4
   ),
   s4: (
-    base64_alph @finish_unit     -> b_start |
-    pad         @finish_pad1     -> final
+    base64_alph @finish_unit @group_end -> b_start |
+    pad         @finish_pad1            -> final
   ),
   e4: (
     pad         @finish_pad2     -> final
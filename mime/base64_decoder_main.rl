@@ -20,9 +20,12 @@
 }}} */
 
 #include <mime/base64_decoder.h>
+#include <mime/decode_kernel.h>
 
 #include <lex_util.h>
 
+#include <algorithm>
+
 using namespace std;
 
 // frontend for base64_decoder, such that in can be tested on its own
@@ -39,6 +42,12 @@ action hold_it
 {
   fhold;
 }
+# makes b_start an entry point: the state after a complete group,
+# where the kernel may continue
+action group_end
+{
+  fnext b_start;
+}
 
 # }}}
 
@@ -53,6 +62,10 @@ namespace MIME {
 
     %% write data;
 
+    // the state after a complete group of 4 characters, cf. group_end
+    static const int group_state =
+      base64_decoder_main_en_base64_main_b_encoded_word_b_start;
+
     Decoder::Decoder(Memory::Buffer::Base &buffer, const string &sentinel)
       :
         conv_buffer_(buffer),
@@ -60,11 +73,35 @@ namespace MIME {
     {
       %% write init;
     }
+    const char *Decoder::exec(const char *p, const char *pe)
+    {
+      %% write exec;
+      return p;
+    }
     void Decoder::read(const char *begin, const char *end)
     {
       const char *p  = begin;
       const char *pe = end;
-      %% write exec;
+      char out[3 * 1024 + Kernel::BASE64_SLACK];
+      while (p != pe) {
+        if (cs == %%{write start;}%% || cs == group_state) {
+          // runs of complete groups are decoded in bulk
+          size_t n = Kernel::base64_decode(p,
+              p + min(size_t(pe - p), size_t(4 * 1024)), out);
+          if (n) {
+            conv_buffer_.cont(out);
+            conv_buffer_.stop(out + n / 4 * 3);
+            p += n;
+            cs = group_state;
+            continue;
+          }
+        }
+        // the state machine only sees partial groups, padding, the end
+        // of the word and errors
+        p = exec(p, p + 1);
+        if (cs == %%{write error;}%%)
+          break;
+      }
       if (cs == %%{write error;}%%) {
         if (   !sentinel_.empty()
             && size_t(pe-p) >= sentinel_.size()
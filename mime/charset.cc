@@ -0,0 +1,213 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <mime/charset.h>
+
+#include <unordered_map>
+#include <errno.h>
+#include <stdint.h>
+#include <iconv.h>
+
+#include <boost/locale/encoding_errors.hpp>
+
+using namespace std;
+
+namespace MIME {
+  namespace Charset {
+
+    namespace {
+
+      // iconv descriptors of one thread, a failed iconv_open() is cached
+      // as well
+      class Cache {
+        private:
+          unordered_map<string, iconv_t> map_;
+          // bound the number of open descriptors - a mailbox with
+          // many exotic charsets just reopens them
+          static const size_t MAX_SIZE = 32;
+
+          void clear();
+        public:
+          ~Cache();
+          iconv_t get(const string &key,
+              const pair<const char*, const char*> &charset);
+      };
+      Cache::~Cache()
+      {
+        clear();
+      }
+      void Cache::clear()
+      {
+        for (auto &i : map_)
+          if (i.second != iconv_t(-1))
+            iconv_close(i.second);
+        map_.clear();
+      }
+      iconv_t Cache::get(const string &key,
+          const pair<const char*, const char*> &charset)
+      {
+        auto i = map_.find(key);
+        if (i != map_.end())
+          return i->second;
+        if (map_.size() >= MAX_SIZE)
+          clear();
+        string name(charset.first, charset.second);
+        iconv_t cd = iconv_open("UTF-8", name.c_str());
+        map_.emplace(key, cd);
+        return cd;
+      }
+
+      thread_local Cache cache;
+
+      bool is_ascii(const char *begin, const char *end)
+      {
+        for (const char *p = begin; p != end; ++p)
+          if (static_cast<unsigned char>(*p) > 0x7f)
+            return false;
+        return true;
+      }
+
+      bool is_utf8(const char *begin, const char *end)
+      {
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(begin);
+        const unsigned char *e = reinterpret_cast<const unsigned char*>(end);
+        while (p != e) {
+          unsigned char c = *p++;
+          if (c < 0x80)
+            continue;
+          unsigned n = 0;
+          uint32_t x = 0;
+          if ((c & 0xe0) == 0xc0) {
+            n = 1; x = c & 0x1f;
+          } else if ((c & 0xf0) == 0xe0) {
+            n = 2; x = c & 0x0f;
+          } else if ((c & 0xf8) == 0xf0) {
+            n = 3; x = c & 0x07;
+          } else {
+            return false;
+          }
+          if (size_t(e - p) < n)
+            return false;
+          for (unsigned i = 0; i < n; ++i) {
+            if ((p[i] & 0xc0) != 0x80)
+              return false;
+            x = (x << 6) | (p[i] & 0x3f);
+          }
+          p += n;
+          // overlong encodings, surrogates, out of range
+          static const uint32_t min[] = { 0, 0x80, 0x800, 0x10000 };
+          if (x < min[n] || (x >= 0xd800 && x <= 0xdfff) || x > 0x10ffff)
+            return false;
+        }
+        return true;
+      }
+
+      void latin1_to_utf8(const char *begin, const char *end, string &out)
+      {
+        for (const char *p = begin; p != end; ++p) {
+          unsigned char c = static_cast<unsigned char>(*p);
+          if (c < 0x80) {
+            out.push_back(char(c));
+          } else {
+            out.push_back(char(0xc0 | (c >> 6)));
+            out.push_back(char(0x80 | (c & 0x3f)));
+          }
+        }
+      }
+
+      void iconv_to_utf8(const pair<const char*, const char*> &charset,
+          const string &key, const char *begin, const char *end, string &out)
+      {
+        iconv_t cd = cache.get(key, charset);
+        if (cd == iconv_t(-1))
+          throw boost::locale::conv::invalid_charset_error(
+              string(charset.first, charset.second));
+        // reset the shift state left over from a previous conversion
+        iconv(cd, nullptr, nullptr, nullptr, nullptr);
+
+        char *inp = const_cast<char*>(begin);
+        size_t in_left = end - begin;
+        size_t off = out.size();
+        out.resize(off + in_left * 2 + 16);
+        for (;;) {
+          char *outp = &out[off];
+          size_t out_left = out.size() - off;
+          // the last call writes the final shift sequence
+          bool flush = !in_left;
+          size_t r = flush
+            ? iconv(cd, nullptr, nullptr, &outp, &out_left)
+            : iconv(cd, &inp, &in_left, &outp, &out_left);
+          int e = errno;
+          off = outp - &out[0];
+          if (r != size_t(-1)) {
+            if (flush)
+              break;
+          } else if (e == E2BIG) {
+            out.resize(out.size() * 2);
+          } else if (!flush && (e == EILSEQ || e == EINVAL)) {
+            // skip like boost::locale's default method
+            ++inp;
+            --in_left;
+          } else {
+            break;
+          }
+        }
+        out.resize(off);
+      }
+
+    }
+
+    void normalize(const std::pair<const char*, const char*> &charset,
+        std::string &out)
+    {
+      out.clear();
+      for (const char *p = charset.first; p != charset.second; ++p) {
+        char c = *p;
+        if (c >= 'A' && c <= 'Z')
+          out.push_back(c - 'A' + 'a');
+        else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+          out.push_back(c);
+      }
+    }
+
+    void to_utf8(const std::pair<const char*, const char*> &charset,
+        const char *begin, const char *end, std::string &out)
+    {
+      thread_local string key;
+      normalize(charset, key);
+      if (key == "utf8") {
+        if (is_utf8(begin, end)) {
+          out.append(begin, end);
+          return;
+        }
+      } else if (key == "usascii" || key == "ascii") {
+        if (is_ascii(begin, end)) {
+          out.append(begin, end);
+          return;
+        }
+      } else if (key == "iso88591" || key == "latin1") {
+        latin1_to_utf8(begin, end, out);
+        return;
+      }
+      iconv_to_utf8(charset, key, begin, end, out);
+    }
+
+  }
+}
@@ -0,0 +1,48 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef MIME_CHARSET_H
+#define MIME_CHARSET_H
+
+#include <string>
+#include <utility>
+
+namespace MIME {
+  namespace Charset {
+
+    // Appends the UTF-8 representation of [begin, end) to out.
+    //
+    // UTF-8, US-ASCII and ISO-8859-1 input is converted without iconv,
+    // converters for other charsets are cached per thread (keyed by the
+    // normalized charset name). As with boost::locale::conv::to_utf(),
+    // invalid input sequences are skipped and an unknown charset throws
+    // boost::locale::conv::invalid_charset_error.
+    void to_utf8(const std::pair<const char*, const char*> &charset,
+        const char *begin, const char *end, std::string &out);
+
+    // lower case, only alpha-numeric characters, e.g. 'ISO_8859-1'
+    // -> 'iso88591'
+    void normalize(const std::pair<const char*, const char*> &charset,
+        std::string &out);
+
+  }
+}
+
+#endif
@@ -0,0 +1,321 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <mime/decode_kernel.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define MIME_KERNEL_X86 1
+  #include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace MIME {
+  namespace Kernel {
+
+    // {{{ scalar
+
+    // 0xff -> not part of the alphabet
+    static const uint8_t base64_table[256] = {
+      #define X 0xff
+      X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+      X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+      X, X, X, X, X, X, X, X, X, X, X,62, X, X, X,63,
+     52,53,54,55,56,57,58,59,60,61, X, X, X, X, X, X,
+      X, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,
+     15,16,17,18,19,20,21,22,23,24,25, X, X, X, X, X,
+      X,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,
+     41,42,43,44,45,46,47,48,49,50,51, X, X, X, X, X,
+      X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+      X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+      X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+      X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+      X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+      X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+      X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+      X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X
+      #undef X
+    };
+
+    static size_t base64_decode_scalar(const char *begin, const char *end,
+        char *out)
+    {
+      const uint8_t *p = reinterpret_cast<const uint8_t*>(begin);
+      const uint8_t *e = p + (end - begin) / 4 * 4;
+      for (; p != e; p += 4) {
+        uint32_t a = base64_table[p[0]];
+        uint32_t b = base64_table[p[1]];
+        uint32_t c = base64_table[p[2]];
+        uint32_t d = base64_table[p[3]];
+        if ((a | b | c | d) > 63)
+          break;
+        uint32_t x = a << 18 | b << 12 | c << 6 | d;
+        *out++ = char(x >> 16);
+        *out++ = char(x >> 8);
+        *out++ = char(x);
+      }
+      return reinterpret_cast<const char*>(p) - begin;
+    }
+
+    static bool is_q(char c)
+    {
+      return c > 0x20 && c < 0x7f && c != '=' && c != '?' && c != '_';
+    }
+
+    static size_t q_span_scalar(const char *begin, const char *end)
+    {
+      const char *p = begin;
+      while (p != end && is_q(*p))
+        ++p;
+      return p - begin;
+    }
+
+    // }}}
+
+#ifdef MIME_KERNEL_X86
+
+    // {{{ SSE4.1
+
+    // cf. Wojciech Mula, Daniel Lemire: Faster Base64 Encoding and Decoding
+    // Using AVX2 Instructions, 2018 - the pshufb/bitmask lookup variant
+
+    __attribute__((target("sse4.1")))
+    static size_t base64_decode_sse41(const char *begin, const char *end,
+        char *out)
+    {
+      const __m128i lut_lo = _mm_setr_epi8(
+          0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+          0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+      const __m128i lut_hi = _mm_setr_epi8(
+          0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+      const __m128i lut_roll = _mm_setr_epi8(
+          0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+      const __m128i mask_2f = _mm_set1_epi8(0x2f);
+      const __m128i pack = _mm_setr_epi8(
+          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+      const char *p = begin;
+      for (; end - p >= 16; p += 16, out += 12) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+        __m128i lo_nibbles = _mm_and_si128(in, mask_2f);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm_testz_si128(lo, hi))
+          break;
+        __m128i eq_2f = _mm_cmpeq_epi8(in, mask_2f);
+        __m128i roll = _mm_shuffle_epi8(lut_roll,
+            _mm_add_epi8(eq_2f, hi_nibbles));
+        __m128i v = _mm_add_epi8(in, roll);
+        v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        v = _mm_shuffle_epi8(v, pack);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), v);
+      }
+      return p - begin + base64_decode_scalar(p, end, out);
+    }
+
+    __attribute__((target("sse4.1")))
+    static size_t q_span_sse41(const char *begin, const char *end)
+    {
+      const __m128i space = _mm_set1_epi8(0x20);
+      const __m128i del   = _mm_set1_epi8(0x7f);
+      const __m128i eq    = _mm_set1_epi8('=');
+      const __m128i qm    = _mm_set1_epi8('?');
+      const __m128i us    = _mm_set1_epi8('_');
+      const char *p = begin;
+      for (; end - p >= 16; p += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        // signed compare - bytes >= 0x80 are negative
+        __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(in, space),
+            _mm_cmplt_epi8(in, del));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(in, eq),
+              _mm_cmpeq_epi8(in, qm)), _mm_cmpeq_epi8(in, us));
+        unsigned m = unsigned(_mm_movemask_epi8(_mm_andnot_si128(special, ok)));
+        if (m != 0xffffu)
+          return p - begin + __builtin_ctz(~m);
+      }
+      return p - begin + q_span_scalar(p, end);
+    }
+
+    // }}}
+
+    // {{{ AVX2
+
+    __attribute__((target("avx2")))
+    static size_t base64_decode_avx2(const char *begin, const char *end,
+        char *out)
+    {
+      const __m256i lut_lo = _mm256_setr_epi8(
+          0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+          0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+          0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+          0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+      const __m256i lut_hi = _mm256_setr_epi8(
+          0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+          0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+          0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+      const __m256i lut_roll = _mm256_setr_epi8(
+          0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+          0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+      const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+      const __m256i pack = _mm256_setr_epi8(
+          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+      const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+      const char *p = begin;
+      for (; end - p >= 32; p += 32, out += 24) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4),
+            mask_2f);
+        __m256i lo_nibbles = _mm256_and_si256(in, mask_2f);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi))
+          break;
+        __m256i eq_2f = _mm256_cmpeq_epi8(in, mask_2f);
+        __m256i roll = _mm256_shuffle_epi8(lut_roll,
+            _mm256_add_epi8(eq_2f, hi_nibbles));
+        __m256i v = _mm256_add_epi8(in, roll);
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, pack);
+        v = _mm256_permutevar8x32_epi32(v, lanes);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);
+      }
+      return p - begin + base64_decode_sse41(p, end, out);
+    }
+
+    __attribute__((target("avx2")))
+    static size_t q_span_avx2(const char *begin, const char *end)
+    {
+      const __m256i space = _mm256_set1_epi8(0x20);
+      const __m256i del   = _mm256_set1_epi8(0x7f);
+      const __m256i eq    = _mm256_set1_epi8('=');
+      const __m256i qm    = _mm256_set1_epi8('?');
+      const __m256i us    = _mm256_set1_epi8('_');
+      const char *p = begin;
+      for (; end - p >= 32; p += 32) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(in, space),
+            _mm256_cmpgt_epi8(del, in));
+        __m256i special = _mm256_or_si256(_mm256_or_si256(
+              _mm256_cmpeq_epi8(in, eq), _mm256_cmpeq_epi8(in, qm)),
+            _mm256_cmpeq_epi8(in, us));
+        uint32_t m = uint32_t(_mm256_movemask_epi8(
+              _mm256_andnot_si256(special, ok)));
+        if (m != 0xffffffffu)
+          return p - begin + __builtin_ctz(~m);
+      }
+      return p - begin + q_span_sse41(p, end);
+    }
+
+    // }}}
+
+#endif
+
+    using Base64_Fn = size_t (*)(const char*, const char*, char*);
+    using Q_Fn      = size_t (*)(const char*, const char*);
+
+    struct Impl {
+      Isa       isa;
+      Base64_Fn base64;
+      Q_Fn      q;
+    };
+
+    static const Impl *impl(Isa isa)
+    {
+#ifdef MIME_KERNEL_X86
+      static const Impl avx2  { Isa::AVX2,   base64_decode_avx2,  q_span_avx2  };
+      static const Impl sse41 { Isa::SSE4_1, base64_decode_sse41, q_span_sse41 };
+#endif
+      static const Impl scalar { Isa::SCALAR, base64_decode_scalar,
+        q_span_scalar };
+      switch (isa) {
+#ifdef MIME_KERNEL_X86
+        case Isa::AVX2:   return &avx2;
+        case Isa::SSE4_1: return &sse41;
+#endif
+        default:          return &scalar;
+      }
+    }
+
+    Isa best()
+    {
+#ifdef MIME_KERNEL_X86
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+        return Isa::AVX2;
+      if (__builtin_cpu_supports("sse4.1"))
+        return Isa::SSE4_1;
+#endif
+      return Isa::SCALAR;
+    }
+
+    // resolved once (thread-safe static initialization), select() may
+    // switch it while decoders run on other threads
+    static std::atomic<const Impl*> &current()
+    {
+      static std::atomic<const Impl*> i { impl(best()) };
+      return i;
+    }
+
+    Isa selected()
+    {
+      return current().load(std::memory_order_relaxed)->isa;
+    }
+
+    void select(Isa isa)
+    {
+      if (isa > best())
+        throw runtime_error(string("CPU doesn't support ") + name(isa));
+      current().store(impl(isa), std::memory_order_relaxed);
+    }
+
+    const char *name(Isa isa)
+    {
+      switch (isa) {
+        case Isa::SCALAR: return "scalar";
+        case Isa::SSE4_1: return "sse4.1";
+        case Isa::AVX2:   return "avx2";
+      }
+      return "";
+    }
+
+    size_t base64_decode(const char *begin, const char *end, char *out)
+    {
+      return current().load(std::memory_order_relaxed)->base64(begin, end, out);
+    }
+
+    size_t q_span(const char *begin, const char *end)
+    {
+      return current().load(std::memory_order_relaxed)->q(begin, end);
+    }
+
+  }
+}
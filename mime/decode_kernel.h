@@ -0,0 +1,61 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef MIME_DECODE_KERNEL_H
+#define MIME_DECODE_KERNEL_H
+
+#include <stddef.h>
+
+namespace MIME {
+
+  // Bulk decoding of runs of valid alphabet characters - the Ragel decoders
+  // use them where their state machine doesn't need to look at each byte.
+  //
+  // The implementation is selected at runtime (AVX2, SSE4.1 or scalar).
+  namespace Kernel {
+
+    enum class Isa { SCALAR, SSE4_1, AVX2 };
+
+    // best implementation supported by the CPU
+    Isa best();
+    Isa selected();
+    // for tests and benchmarks, affects all threads,
+    // throws if the CPU doesn't support it
+    void select(Isa isa);
+    const char *name(Isa isa);
+
+    // output may be written up to that many bytes past the decoded data
+    static const size_t BASE64_SLACK = 32;
+
+    // Decodes the longest prefix of [begin, end) that consists of
+    // complete groups of 4 base64 alphabet characters (i.e. no padding)
+    // into out (which has room for 3/4 of the input plus BASE64_SLACK).
+    // Returns the number of consumed characters, a multiple of 4.
+    size_t base64_decode(const char *begin, const char *end, char *out);
+
+    // length of the prefix of [begin, end) that consists of characters
+    // that are literally copied by the Q encoding, i.e. 0x21..0x7e
+    // without '=', '?' and '_'
+    size_t q_span(const char *begin, const char *end);
+
+  }
+}
+
+#endif
@@ -22,6 +22,8 @@
 #define MIME_HEADER_DECODER_H
 
 #include <functional>
+#include <string>
+#include <utility>
 #include <stdint.h>
 
 #include <buffer/buffer.h>
@@ -29,6 +31,8 @@
 namespace MIME {
   namespace Header {
 
+    // appends the UTF-8 representation of an encoded word to out, control
+    // characters are escaped
     void default_convert(const std::pair<const char*, const char*> &charset,
         const std::pair<const char*, const char*> &lang,
         const std::pair<const char*, const char*> &inp,
@@ -38,6 +42,7 @@ namespace MIME {
       public:
         enum class Ending { BOTH, LF, CRLF };
         using Callback_Fn = std::function<void()>;
+        // out is empty when called, its capacity is reused
         using Convert_Fn  = std::function<
           void (const std::pair<const char*, const char*> &charset,
               const std::pair<const char*, const char*> &lang,
@@ -54,6 +59,7 @@ namespace MIME {
         Memory::Buffer::Vector  default_language_buffer_;
         Memory::Buffer::Vector  space_buffer_;
         Memory::Buffer::Vector  conv_buffer_;
+        std::string             conv_out_;
         Ending                  ending_       {Ending::BOTH};
         Callback_Fn             callback_fn_;
         Convert_Fn              convert_fn_;
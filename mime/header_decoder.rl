@@ -135,12 +135,19 @@ action hold_it
 {
   fhold;
 }
+# hooks of the base64/q decoders for their standalone frontends
+action group_end
+{
+}
+action q_word_char
+{
+}
 action convert_buffer
 {
-  string s;
-  convert_fn_(charset_buffer_.range(), language_buffer_.range(), conv_buffer_.range(), s);
-  buffer_.cont(s.data());
-  buffer_.stop(s.data()+s.size());
+  conv_out_.clear();
+  convert_fn_(charset_buffer_.range(), language_buffer_.range(), conv_buffer_.range(), conv_out_);
+  buffer_.cont(conv_out_.data());
+  buffer_.stop(conv_out_.data()+conv_out_.size());
   conv_buffer_.clear();
 }
 action check_cr
@@ -365,8 +372,9 @@ header_main :=  header ;
 
 }%%
 
-#include <boost/locale/encoding.hpp>
+#include <algorithm>
 
+#include <mime/charset.h>
 #include <ascii/control_sanitizer.h>
 
 namespace MIME {
@@ -376,19 +384,20 @@ namespace MIME {
         const std::pair<const char*, const char*> &inp,
         std::string &out)
     {
-      string s(inp.first, inp.second);
-      string cs(charset.first, charset.second);
-      string result(boost::locale::conv::to_utf<char>(s, cs));
-
+      size_t off = out.size();
+      Charset::to_utf8(charset, inp.first, inp.second, out);
+
+      // control characters are rare - thus, only then the sanitizer
+      // has to copy the result
+      auto is_ctl = [](char c) {
+        return static_cast<unsigned char>(c) < 0x20 || c == 0x7f; };
+      if (std::none_of(out.begin() + off, out.end(), is_ctl))
+        return;
       Memory::Buffer::Vector v;
       ASCII::Control::Sanitizer sani(v);
-      sani.read(result.data(), result.data() + result.size());
-      if (sani.seen_ctl()) {
-        // no std::move(), string() already is an r-value
-        out = string(v.begin(), v.end());
-      } else {
-        out = std::move(result);
-      }
+      sani.read(out.data() + off, out.data() + out.size());
+      out.resize(off);
+      out.append(v.begin(), v.end());
     }
 
     %% write data;
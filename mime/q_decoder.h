@@ -22,6 +22,7 @@
 #define MIME_Q_DECODER_H
 
 #include <functional>
+#include <string>
 #include <stdint.h>
 
 #include <buffer/buffer.h>
@@ -37,6 +38,9 @@ namespace MIME {
         std::string                         sentinel_;
         const char                         *next_       {nullptr};
 
+        const char *exec(const char *p, const char *pe);
+        bool in_word() const;
+
       public:
         Decoder(Memory::Buffer::Base &buffer,
             const std::string &sentinel = std::string());
@@ -33,6 +33,9 @@ using namespace std;
 
 machine q_decoder;
 
+# q_word_char is defined by the includer - it is executed for each
+# character of a q_word
+
 # {{{ Actions
 
 action clear_hex
@@ -98,7 +101,8 @@ q_printable = 0x21..0x7E
 q_alph = q_printable - q_specials
   ;
 
-q_word = (q_alph q_alph**) >conv_buffer_cont %conv_buffer_stop
+q_word = (q_alph q_in_word: (q_alph**))
+    >conv_buffer_cont $q_word_char %conv_buffer_stop
   ;
 
 # RFC specifies that uppercase 'A'..'F' "should" be used, but apparently
@@ -20,6 +20,7 @@
 }}} */
 
 #include <mime/q_decoder.h>
+#include <mime/decode_kernel.h>
 
 #include <lex_util.h>
 
@@ -32,6 +33,12 @@ using namespace std;
 
 machine q_main;
 
+# makes q_in_word an entry point: inside a run of literally copied
+# characters, where the kernel may continue
+action q_word_char
+{
+  fnext q_in_word;
+}
 
 include q_decoder "mime/q_decoder.rl";
 
@@ -51,15 +58,40 @@ namespace MIME {
     {
       %% write init;
     }
+    const char *Decoder::exec(const char *p, const char *pe)
+    {
+      const char *eof {nullptr};
+      (void)eof;
+      %% write exec;
+      return p;
+    }
+    // inside a run of literally copied characters, i.e. where the
+    // machine doesn't execute any actions, cf. q_word_char
+    bool Decoder::in_word() const
+    {
+      return cs == q_main_en_q_main_q_encoded_word_q_word_q_in_word;
+    }
     void Decoder::read(const char *begin, const char *end)
     {
       using namespace Memory;
       const char *p  = begin;
       const char *pe = end;
-      const char *eof {nullptr};
-      (void)eof;
       Buffer::Resume conv_buffer_resume(conv_buffer_, p, pe);
-      %% write exec;
+      while (p != pe) {
+        if (in_word()) {
+          size_t n = Kernel::q_span(p, pe);
+          if (n) {
+            // the machine only sees the last one of the run such that it
+            // ends up in its own state
+            p = exec(p + n - 1, p + n);
+            continue;
+          }
+        }
+        // quoted characters, underscores, the end of the word and errors
+        p = exec(p, p + 1);
+        if (cs == %%{write error;}%%)
+          break;
+      }
       if (cs == %%{write error;}%%) {
         if (   !sentinel_.empty()
             && size_t(pe-p) >= sentinel_.size()
@@ -19,8 +19,10 @@
 
 }}} */
 #include "client.h"
+#include "deflate.h"
 
 #include <exception.h>
+#include <algorithm>
 #include <utility>
 
 #include <boost/log/sources/record_ostream.hpp>
@@ -30,15 +32,22 @@ using namespace std;
 namespace Net {
 
   namespace Client {
+
+    static const size_t read_buffer_min = 4 * 1024;
+    // shrink the read buffer after that many reads that used
+    // less than a quarter of it
+    static const unsigned small_reads_max = 8;
+
     Base::Base(boost::asio::io_service &io_service, const Options &opts,
           boost::log::sources::severity_logger<Log::Severity> &lg
         )
       :
         io_service_(io_service),
         opts_(opts),
-        input_(4 * 1024),
+        input_(read_buffer_min),
+        read_buffer_size_(read_buffer_min),
         lg_(lg),
-        trace_writer_(opts_.tracefile)
+        trace_writer_(opts_.tracefile, opts_.trace_format)
     {
     }
     Base::~Base()
@@ -52,25 +61,122 @@ namespace Net {
     {
       return input_;
     }
+    // the buffer is only resized here, i.e. when the previous
+    // read was already consumed by the reader
+    std::vector<char> &Base::read_buffer()
+    {
+      if (input_.size() != read_buffer_size_) {
+        // swap instead of resize() to release the memory when shrinking
+        vector<char>(read_buffer_size_).swap(input_);
+        if (deflate_)
+          vector<char>(read_buffer_size_).swap(compressed_input_);
+      }
+      return deflate_ ? compressed_input_ : input_;
+    }
+    void Base::adapt_read_buffer(size_t size)
+    {
+      size_t i = 0;
+      for (size_t x = size >> 1; x && i < read_histogram_.size() - 1; x >>= 1)
+        ++i;
+      ++read_histogram_[i];
+
+      size_t max_size = max<size_t>(opts_.read_buffer_max, read_buffer_min);
+      if (size == read_buffer_size_) {
+        small_reads_ = 0;
+        if (read_buffer_size_ < max_size) {
+          read_buffer_size_ = min(2 * read_buffer_size_, max_size);
+          LOG_SEV(lg_, Log::DEBUG_V) << "Growing read buffer to "
+            << read_buffer_size_ << " bytes";
+        }
+      } else if (size < read_buffer_size_ / 4) {
+        if (++small_reads_ >= small_reads_max
+            && read_buffer_size_ > read_buffer_min) {
+          small_reads_ = 0;
+          read_buffer_size_ = max(read_buffer_size_ / 2, read_buffer_min);
+          LOG_SEV(lg_, Log::DEBUG_V) << "Shrinking read buffer to "
+            << read_buffer_size_ << " bytes";
+        }
+      } else {
+        small_reads_ = 0;
+      }
+    }
+    void Base::handle_read(const boost::system::error_code &ec, size_t size,
+        Read_Fn fn)
+    {
+      if (!ec) {
+        bytes_read_ += size;
+        // size is 0 when draining pending compressed input
+        if (size)
+          adapt_read_buffer(size);
+        if (deflate_) {
+          // size is 0 when draining input left from the last read
+          if (size)
+            deflate_->set_input(compressed_input_.data(), size);
+          size = deflate_->inflate(input_.data(), input_.size());
+        }
+        log_read(size);
+      }
+      fn(ec, size);
+    }
+    bool Base::post_pending_read(Read_Fn fn)
+    {
+      if (!deflate_ || !deflate_->pending())
+        return false;
+      io_service_.post([this, fn]()
+          {
+            boost::system::error_code ec;
+            handle_read(ec, 0, fn);
+          });
+      return true;
+    }
+    void Base::enable_compression()
+    {
+      LOG_SEV(lg_, Log::DEBUG) << "Enabling DEFLATE compression";
+      deflate_.reset(new Deflate());
+      compressed_input_.resize(input_.size());
+    }
+    void Base::set_compressed_input(const char *begin, const char *end)
+    {
+      if (!deflate_)
+        THROW_LOGIC_MSG("compressed input without enabled compression");
+      if (begin == end)
+        return;
+      // begin/end usually point into input_, which is overwritten
+      // by the inflation - the size is kept because it is the
+      // size of the next transport read
+      size_t n = end - begin;
+      if (n > compressed_input_.size())
+        compressed_input_.resize(n);
+      std::copy(begin, end, compressed_input_.begin());
+      deflate_->set_input(compressed_input_.data(), n);
+    }
+    bool Base::compression_enabled() const
+    {
+      return bool(deflate_);
+    }
+    // the trace contains the uncompressed data - thus, it
+    // can be replayed without compression
     void Base::log_read(size_t size)
     {
-      bytes_read_ += size;
+      bytes_inflated_ += size;
       trace_writer_.push(Trace::Type::RECEIVED, input_, size);
-      if (opts_.severity < Log::DEBUG && opts_.file_severity < Log::DEBUG)
+      if (!Log::compiled_in(Log::DEBUG_V)
+          || (opts_.severity < Log::DEBUG_V && opts_.file_severity < Log::DEBUG_V))
         return;
-      BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Read " << size << " bytes from host";
+      LOG_SEV(lg_, Log::DEBUG_V) << "Read " << size << " bytes from host";
       string s(input_.data(), size);
-      BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Read |" << s << "|";
+      LOG_SEV(lg_, Log::DEBUG_V) << "Read |" << s << "|";
     }
     void Base::log_write()
     {
       trace_writer_.push(Trace::Type::SENT, write_queue_.front());
-      if (opts_.severity < Log::DEBUG && opts_.file_severity < Log::DEBUG)
+      if (!Log::compiled_in(Log::DEBUG_V)
+          || (opts_.severity < Log::DEBUG_V && opts_.file_severity < Log::DEBUG_V))
         return;
-      BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Schedule " << write_queue_.front().size()
+      LOG_SEV(lg_, Log::DEBUG_V) << "Schedule " << write_queue_.front().size()
         << " bytes to write to host";
       string s(write_queue_.front().data(), write_queue_.front().size());
-      BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Schedule write |" << s << "|";
+      LOG_SEV(lg_, Log::DEBUG_V) << "Schedule write |" << s << "|";
     }
     void Base::log_shutdown()
     {
@@ -96,7 +202,10 @@ namespace Net {
         THROW_LOGIC_MSG("do_write() called with empty queue");
 
       log_write();
-      async_write(write_queue_.front(), [this](
+      if (deflate_)
+        // only one write is in progress at a time
+        deflate_->deflate(write_queue_.front(), deflated_output_);
+      async_write(deflate_ ? deflated_output_ : write_queue_.front(), [this](
           const boost::system::error_code &ec, size_t size
             )
           {
@@ -104,7 +213,7 @@ namespace Net {
               THROW_ERROR(ec);
             } else {
               bytes_written_ += size;
-              BOOST_LOG_SEV(lg_, Log::DEBUG_V) << "Wrote " << size << " bytes.";
+              LOG_SEV(lg_, Log::DEBUG_V) << "Wrote " << size << " bytes.";
               write_free_stack_.push(std::move(write_queue_.front()));
               write_free_stack_.top().clear();
               write_queue_.pop();
@@ -120,6 +229,18 @@ namespace Net {
     {
       return bytes_written_;
     }
+    size_t Base::bytes_inflated() const
+    {
+      return bytes_inflated_;
+    }
+    const Read_Histogram &Base::read_histogram() const
+    {
+      return read_histogram_;
+    }
+    size_t Base::read_buffer_size() const
+    {
+      return read_buffer_size_;
+    }
 
   }
 
@@ -24,7 +24,9 @@
 #include <log/log.h>
 #include <trace/trace.h>
 
+#include <array>
 #include <functional>
+#include <memory>
 #include <vector>
 #include <queue>
 #include <stack>
@@ -36,6 +38,8 @@
 
 namespace Net {
 
+  class Deflate;
+
   namespace Client {
     class Options {
       public:
@@ -43,8 +47,17 @@ namespace Net {
         unsigned file_severity {0};
 
         std::string tracefile;
+        Trace::Format trace_format {Trace::Format::TEXT};
+
+        // the read buffer grows up to this size (in bytes) while reads
+        // keep filling it completely
+        unsigned read_buffer_max {256 * 1024};
     };
 
+    // read sizes - bucket i counts reads of [2^i, 2^(i+1)) bytes,
+    // the last one all larger reads
+    using Read_Histogram = std::array<size_t, 21>;
+
     class Base {
       protected:
         boost::asio::io_service       &io_service_;
@@ -53,12 +66,25 @@ namespace Net {
         std::stack<std::vector<char> > write_free_stack_;
         std::queue<std::vector<char> > write_queue_;
 
+        // RFC4978 COMPRESS=DEFLATE - the transport reads into
+        // compressed_input_ which is then inflated into input_
+        std::unique_ptr<Deflate>       deflate_;
+        std::vector<char>              compressed_input_;
+        std::vector<char>              deflated_output_;
+
+        // size of the next read from the transport layer
+        size_t                         read_buffer_size_;
+        unsigned                       small_reads_ {0};
+        Read_Histogram                 read_histogram_ {{}};
+
+        void adapt_read_buffer(size_t size);
         void log_read(size_t size);
         void log_write();
         void log_shutdown();
       protected:
-        size_t bytes_read_    {0};
-        size_t bytes_written_ {0};
+        size_t bytes_read_     {0};
+        size_t bytes_written_  {0};
+        size_t bytes_inflated_ {0};
 
         boost::log::sources::severity_logger<Log::Severity> &lg_;
 
@@ -91,6 +117,15 @@ namespace Net {
           boost::log::sources::severity_logger<Log::Severity> &lg
             );
 
+        // the buffer the transport layer should read into
+        std::vector<char> &read_buffer();
+        // to be called by the transport layer on read completion
+        void handle_read(const boost::system::error_code &ec, size_t size,
+            Read_Fn fn);
+        // true if compressed input is left from a previous read - then
+        // fn is posted without reading from the transport layer
+        bool post_pending_read(Read_Fn fn);
+
       public:
         virtual ~Base();
 
@@ -117,8 +152,21 @@ namespace Net {
         void do_write();
         void push_write(std::vector<char> &v);
 
+        // all following reads/writes are (de-)compressed
+        void enable_compression();
+        // the part of the last read after the response that enabled
+        // compression - it is inflated before the next transport read
+        void set_compressed_input(const char *begin, const char *end);
+        bool compression_enabled() const;
+
+        // bytes received from the transport layer
         size_t bytes_read() const;
         size_t bytes_written() const;
+        // bytes passed to the reader, i.e. after decompression
+        size_t bytes_inflated() const;
+
+        const Read_Histogram &read_histogram() const;
+        size_t read_buffer_size() const;
     };
 
   }
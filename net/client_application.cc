@@ -43,6 +43,15 @@ namespace Net {
         lg_(lg)
     {
     }
+    void Application::set_metrics(Metrics::Registry *r)
+    {
+      metrics_ = r;
+    }
+    void Application::record(Metrics::Phase p, Metrics::Clock::time_point start)
+    {
+      if (metrics_)
+        metrics_->phase(p).add(Metrics::micros(Metrics::Clock::now() - start));
+    }
     void Application::async_start(std::function<void(void)> fn)
     {
       async_resolve(fn);
@@ -53,15 +62,17 @@ namespace Net {
     }
     void Application::async_resolve(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       BOOST_LOG(lg_) << "Resolving " << host_ << "...";
-      client_.async_resolve([this, fn](const boost::system::error_code &ec,
+      auto start = Metrics::Clock::now();
+      client_.async_resolve([this, fn, start](const boost::system::error_code &ec,
             boost::asio::ip::tcp::resolver::iterator iterator)
           {
-            BOOST_LOG_FUNCTION();
+            LOG_FUNCTION();
             if (ec) {
               THROW_ERROR(ec);
             } else {
+              record(Metrics::Phase::RESOLVE, start);
               BOOST_LOG(lg_) << host_ << " resolved.";
               async_connect(iterator, fn);
             }
@@ -71,14 +82,16 @@ namespace Net {
     void Application::async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
         std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       BOOST_LOG(lg_) << "Connecting to " << host_ << "...";
-      client_.async_connect(iterator, [this, fn](const boost::system::error_code &ec)
+      auto start = Metrics::Clock::now();
+      client_.async_connect(iterator, [this, fn, start](const boost::system::error_code &ec)
           {
-            BOOST_LOG_FUNCTION();
+            LOG_FUNCTION();
             if (ec) {
               THROW_ERROR(ec);
             } else {
+              record(Metrics::Phase::CONNECT, start);
               BOOST_LOG(lg_) << host_ << " connected.";
               async_handshake(fn);
             }
@@ -87,14 +100,16 @@ namespace Net {
 
     void Application::async_handshake(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       BOOST_LOG(lg_) << "Shaking hands with " << host_ << "...";
-      client_.async_handshake([this, fn](const boost::system::error_code &ec)
+      auto start = Metrics::Clock::now();
+      client_.async_handshake([this, fn, start](const boost::system::error_code &ec)
           {
-            BOOST_LOG_FUNCTION();
+            LOG_FUNCTION();
             if (ec) {
               THROW_ERROR(ec);
             } else {
+              record(Metrics::Phase::HANDSHAKE, start);
               BOOST_LOG(lg_) << "Handshake completed.";
               fn();
             }
@@ -103,20 +118,20 @@ namespace Net {
 
     void Application::async_quit(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
-      BOOST_LOG_SEV(lg_, Log::DEBUG) << "async_quit()";
+      LOG_FUNCTION();
+      LOG_SEV(lg_, Log::DEBUG) << "async_quit()";
       client_.cancel();
       async_shutdown(fn);
     }
 
     void Application::async_shutdown(std::function<void(void)> fn)
     {
-      BOOST_LOG_FUNCTION();
+      LOG_FUNCTION();
       client_.async_shutdown([this, fn](
             const boost::system::error_code &ec)
           {
-            BOOST_LOG_FUNCTION();
-            BOOST_LOG_SEV(lg_, Log::DEBUG) << "shutting down connect to: " << host_;
+            LOG_FUNCTION();
+            LOG_SEV(lg_, Log::DEBUG) << "shutting down connect to: " << host_;
             if (ec) {
                         // for Boost >= 1.63 (e.g. Fedora >= 26)
               if
@@ -134,17 +149,17 @@ namespace Net {
               } else if (ec.category() == boost::asio::error::get_misc_category()
                          && ec.value() == boost::asio::error::eof
                          ) {
-                BOOST_LOG_SEV(lg_, Log::DEBUG) << "server " << host_ << " disconnected first";
+                LOG_SEV(lg_, Log::DEBUG) << "server " << host_ << " disconnected first";
               } else {
                 if (ec.category() == boost::asio::error::get_ssl_category()) {
-                  BOOST_LOG_SEV(lg_, Log::ERROR)
+                  LOG_SEV(lg_, Log::ERROR)
                     << "ssl_category: lib " << ERR_GET_LIB(ec.value())
 #if OPENSSL_VERSION_MAJOR < 3
                     << " func " << ERR_GET_FUNC(ec.value())
 #endif
                     << " reason " << ERR_GET_REASON(ec.value());
                 }
-                BOOST_LOG_SEV(lg_, Log::DEBUG) << "do_shutdown() fail: " << ec.message();
+                LOG_SEV(lg_, Log::DEBUG) << "do_shutdown() fail: " << ec.message();
                 THROW_ERROR(ec);
               }
             } else {
@@ -27,6 +27,7 @@
 #include <boost/asio/ip/tcp.hpp>
 
 #include <log/log.h>
+#include <metrics/metrics.h>
 
 namespace Net { namespace Client { class Base; } }
 
@@ -39,7 +40,9 @@ namespace Net {
         const std::string                                     &host_;
         Net::Client::Base                                     &client_;
         boost::log::sources::severity_logger< Log::Severity > &lg_;
+        Metrics::Registry                                     *metrics_ {nullptr};
 
+        void record(Metrics::Phase p, Metrics::Clock::time_point start);
         void async_resolve(std::function<void(void)> fn);
         void async_connect(boost::asio::ip::tcp::resolver::iterator iterator,
             std::function<void(void)> fn);
@@ -53,6 +56,8 @@ namespace Net {
             Net::Client::Base &client,
             boost::log::sources::severity_logger<Log::Severity> &lg
             );
+        // resolve, connect and handshake latencies are recorded if set
+        void set_metrics(Metrics::Registry *r);
         void async_start (std::function<void(void)> fn);
         void async_finish(std::function<void(void)> fn);
     };
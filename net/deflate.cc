@@ -0,0 +1,112 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "deflate.h"
+
+#include <exception.h>
+
+#include <sstream>
+
+using namespace std;
+
+namespace Net {
+
+  // negative window bits select raw deflate
+  static const int window_bits = -15;
+
+  static void throw_zlib(const char *what, const z_stream &z, int r)
+  {
+    ostringstream o;
+    o << what << " failed (" << r << ")";
+    if (z.msg)
+      o << ": " << z.msg;
+    THROW_MSG(o.str());
+  }
+
+  Deflate::Deflate(int level)
+    :
+      inflate_(),
+      deflate_()
+  {
+    int r = inflateInit2(&inflate_, window_bits);
+    if (r != Z_OK)
+      throw_zlib("inflateInit2", inflate_, r);
+    r = deflateInit2(&deflate_, level, Z_DEFLATED, window_bits, 8,
+        Z_DEFAULT_STRATEGY);
+    if (r != Z_OK) {
+      inflateEnd(&inflate_);
+      throw_zlib("deflateInit2", deflate_, r);
+    }
+  }
+  Deflate::~Deflate()
+  {
+    inflateEnd(&inflate_);
+    deflateEnd(&deflate_);
+  }
+
+  void Deflate::set_input(const char *begin, size_t size)
+  {
+    inflate_.next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(begin));
+    inflate_.avail_in = size;
+  }
+  size_t Deflate::inflate(char *out, size_t size)
+  {
+    inflate_.next_out  = reinterpret_cast<Bytef*>(out);
+    inflate_.avail_out = size;
+    int r = ::inflate(&inflate_, Z_SYNC_FLUSH);
+    switch (r) {
+      case Z_OK:
+      case Z_STREAM_END:
+        break;
+      // no progress possible - i.e. nothing left to do
+      case Z_BUF_ERROR:
+        break;
+      default:
+        throw_zlib("inflate", inflate_, r);
+    }
+    // zlib may still hold decompressed data when the output was full
+    inflate_full_ = !inflate_.avail_out;
+    return size - inflate_.avail_out;
+  }
+  bool Deflate::pending() const
+  {
+    return inflate_.avail_in || inflate_full_;
+  }
+
+  void Deflate::deflate(const std::vector<char> &in, std::vector<char> &out)
+  {
+    out.resize(deflateBound(&deflate_, in.size()) + 16);
+    deflate_.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    deflate_.avail_in  = in.size();
+    size_t n = 0;
+    do {
+      if (n == out.size())
+        out.resize(2 * out.size());
+      deflate_.next_out  = reinterpret_cast<Bytef*>(out.data() + n);
+      deflate_.avail_out = out.size() - n;
+      int r = ::deflate(&deflate_, Z_SYNC_FLUSH);
+      if (r != Z_OK && r != Z_BUF_ERROR)
+        throw_zlib("deflate", deflate_, r);
+      n = out.size() - deflate_.avail_out;
+    } while (!deflate_.avail_out);
+    out.resize(n);
+  }
+
+}
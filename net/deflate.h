@@ -0,0 +1,60 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef NET_DEFLATE_H
+#define NET_DEFLATE_H
+
+#include <vector>
+#include <stddef.h>
+
+#include <zlib.h>
+
+namespace Net {
+
+  // Streaming raw deflate in both directions, i.e. without zlib header
+  // and checksum, as required by RFC4978 (IMAP COMPRESS=DEFLATE).
+  //
+  // Input that doesn't fit into the output buffer is kept inside the
+  // z_stream - thus, call inflate() again while pending() is true.
+  class Deflate {
+    private:
+      z_stream inflate_;
+      z_stream deflate_;
+      bool     inflate_full_ {false};
+    public:
+      Deflate(int level = Z_DEFAULT_COMPRESSION);
+      ~Deflate();
+      Deflate(const Deflate &) = delete;
+      Deflate &operator=(const Deflate &) = delete;
+
+      // the memory has to stay valid until pending() is false
+      void set_input(const char *begin, size_t size);
+      // returns the number of decompressed bytes written to out
+      size_t inflate(char *out, size_t size);
+      bool pending() const;
+
+      // replaces the content of out with the compressed and
+      // flushed input
+      void deflate(const std::vector<char> &in, std::vector<char> &out);
+  };
+
+}
+
+#endif
@@ -0,0 +1,152 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include "ssl_session.h"
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <openssl/ssl.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ixxx/ixxx.h>
+
+#include <boost/log/sources/record_ostream.hpp>
+#include <boost/algorithm/hex.hpp>
+
+using namespace std;
+
+namespace Net {
+
+  namespace SSL {
+
+    static const char magic[] = "imapdl-tls-session 1";
+
+    Session_Cache::Session_Cache(
+        boost::log::sources::severity_logger<Log::Severity> &lg,
+        const string &filename,
+        const string &host,
+        const string &service,
+        const string &fingerprint)
+      :
+        lg_(lg),
+        filename_(filename),
+        key_(host + ' ' + service + ' ' + fingerprint)
+    {
+    }
+
+    bool Session_Cache::load(::SSL *ssl)
+    {
+      if (filename_.empty())
+        return false;
+      ifstream f(filename_);
+      string m, key, hex;
+      if (!getline(f, m) || !getline(f, key) || !getline(f, hex))
+        return false;
+      if (m != magic || key != key_) {
+        LOG_SEV(lg_, Log::DEBUG) << "Ignoring cached TLS session of "
+          "another server/certificate";
+        return false;
+      }
+      vector<unsigned char> der;
+      try {
+        boost::algorithm::unhex(hex, back_inserter(der));
+      } catch (const std::exception &e) {
+        LOG_SEV(lg_, Log::WARN) << "Corrupt TLS session cache "
+          << filename_ << ": " << e.what();
+        return false;
+      }
+      const unsigned char *p = der.data();
+      SSL_SESSION *session = d2i_SSL_SESSION(nullptr, &p, der.size());
+      if (!session) {
+        LOG_SEV(lg_, Log::WARN) << "Could not decode cached TLS session";
+        return false;
+      }
+      int r = SSL_set_session(ssl, session);
+      SSL_SESSION_free(session);
+      if (r != 1)
+        return false;
+      LOG_SEV(lg_, Log::DEBUG) << "Offering cached TLS session";
+      return true;
+    }
+
+    void Session_Cache::store(::SSL *ssl)
+    {
+      if (filename_.empty())
+        return;
+      SSL_SESSION *session = SSL_get1_session(ssl);
+      if (!session)
+        return;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+      // e.g. with TLSv1.3 before the server sent a session ticket
+      if (!SSL_SESSION_is_resumable(session)) {
+        SSL_SESSION_free(session);
+        return;
+      }
+#endif
+      int n = i2d_SSL_SESSION(session, nullptr);
+      vector<unsigned char> der(n > 0 ? n : 0);
+      unsigned char *p = der.data();
+      if (n > 0)
+        n = i2d_SSL_SESSION(session, &p);
+      SSL_SESSION_free(session);
+      if (n <= 0)
+        return;
+
+      string s(magic);
+      s += '\n';
+      s += key_;
+      s += '\n';
+      boost::algorithm::hex(der.begin(), der.end(), back_inserter(s));
+      s += '\n';
+
+      // the session contains the master secret, thus, the file is
+      // created with restricted permissions right away (O_EXCL: no
+      // following of a planted symlink)
+      string tmp(filename_ + ".tmp");
+      // e.g. left over by a killed run
+      ::unlink(tmp.c_str());
+      try {
+        int fd = ixxx::posix::open(tmp,
+            O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        try {
+          for (const char *p = s.data(), *e = p + s.size(); p != e; )
+            p += ixxx::posix::write(fd, p, e - p);
+          ixxx::posix::fsync(fd);
+        } catch (...) {
+          ixxx::posix::close(fd);
+          throw;
+        }
+        ixxx::posix::close(fd);
+        ixxx::posix::rename(tmp, filename_);
+      } catch (const std::exception &e) {
+        LOG_SEV(lg_, Log::WARN) << "Could not write TLS session cache "
+          << filename_ << ": " << e.what();
+        ::unlink(tmp.c_str());
+        return;
+      }
+      LOG_SEV(lg_, Log::DEBUG) << "Stored TLS session in " << filename_;
+    }
+
+  }
+}
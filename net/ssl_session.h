@@ -0,0 +1,60 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#ifndef SSL_SESSION_CACHE_H
+#define SSL_SESSION_CACHE_H
+
+#include <log/log.h>
+
+#include <string>
+
+typedef struct ssl_st SSL;
+
+namespace Net {
+
+  namespace SSL {
+
+    // Persists the TLS session of a connection in a file such that
+    // the next run can resume it (abbreviated handshake). A stored
+    // session is only used for the same host, service and certificate
+    // fingerprint. Errors are logged and otherwise ignored, i.e. they
+    // just result in a full handshake.
+    class Session_Cache {
+      private:
+        boost::log::sources::severity_logger<Log::Severity> &lg_;
+        std::string filename_;
+        std::string key_;
+      public:
+        Session_Cache(
+            boost::log::sources::severity_logger<Log::Severity> &lg,
+            const std::string &filename,
+            const std::string &host,
+            const std::string &service,
+            const std::string &fingerprint);
+        // true if a matching session was set for the handshake
+        bool load(::SSL *ssl);
+        // stores the current session (if it is resumable)
+        void store(::SSL *ssl);
+    };
+
+  }
+}
+
+#endif
@@ -24,6 +24,8 @@
 #include "ssl_verification.h"
 #include "exception.h"
 
+#include <atomic>
+
 #include <boost/asio/ssl.hpp>
 #include <boost/log/sources/record_ostream.hpp>
 
@@ -82,13 +84,13 @@ namespace Net {
       }
       void Base::async_read_some(Read_Fn fn)
       {
-        socket_.async_read_some(asio::buffer(input_), [this, fn](
+        if (post_pending_read(fn))
+          return;
+        socket_.async_read_some(asio::buffer(read_buffer()), [this, fn](
             const boost::system::error_code &ec,
             size_t size)
           {
-            if (!ec)
-              log_read(size);
-            fn(ec, size);
+            handle_read(ec, size, fn);
           });
       }
       void Base::async_write(const char *c, size_t size, Write_Fn fn)
@@ -124,6 +126,19 @@ namespace Net {
 
       namespace Client {
 
+        // over all connections of the process
+        static std::atomic<size_t> resumed_handshakes_ {0};
+        static std::atomic<size_t> full_handshakes_    {0};
+
+        size_t resumed_handshakes()
+        {
+          return resumed_handshakes_;
+        }
+        size_t full_handshakes()
+        {
+          return full_handshakes_;
+        }
+
         boost::asio::ssl::context &Options::apply(boost::asio::ssl::context &context)
           const
         {
@@ -146,9 +161,11 @@ namespace Net {
           :
             Net::Client::Base(io_service, opts, lg),
             opts_(opts),
-            context_(opts_.apply(context)),
+            context_(context),
             stream_(io_service, context_),
-            resolver_(io_service)
+            resolver_(io_service),
+            session_cache_(lg_, opts_.session_cache, opts_.host, opts_.service,
+                opts_.fingerprint)
         {
           using namespace Net::SSL;
           stream_.set_verify_mode(asio::ssl::verify_peer);
@@ -187,18 +204,39 @@ namespace Net {
         }
         void Base::async_handshake(Handshake_Fn fn)
         {
-          BOOST_LOG_SEV(lg_, Log::DEBUG) << "Handshaking - Cipher list: " << opts_.cipher;
-          stream_.async_handshake(asio::ssl::stream_base::client, fn);
+          LOG_SEV(lg_, Log::DEBUG) << "Handshaking - Cipher list: " << opts_.cipher;
+          session_cache_.load(stream_.native_handle());
+          stream_.async_handshake(asio::ssl::stream_base::client,
+              [this, fn](const boost::system::error_code &ec)
+              {
+                if (!ec) {
+                  log_handshake();
+                  session_cache_.store(stream_.native_handle());
+                }
+                fn(ec);
+              });
+        }
+        void Base::log_handshake()
+        {
+          bool resumed = SSL_session_reused(stream_.native_handle());
+          if (resumed)
+            ++resumed_handshakes_;
+          else
+            ++full_handshakes_;
+          LOG_SEV(lg_, Log::INFO) << "TLS handshake "
+            << (resumed ? "resumed session" : "full")
+            << " (resumed: " << resumed_handshakes_
+            << ", full: " << full_handshakes_ << ')';
         }
         void Base::async_read_some(Read_Fn fn)
         {
-          stream_.async_read_some(asio::buffer(input_), [this, fn](
+          if (post_pending_read(fn))
+            return;
+          stream_.async_read_some(asio::buffer(read_buffer()), [this, fn](
             const boost::system::error_code &ec,
             size_t size)
           {
-            if (!ec)
-              log_read(size);
-            fn(ec, size);
+            handle_read(ec, size, fn);
           });
         }
         void Base::async_write(const char *c, size_t size, Write_Fn fn)
@@ -212,6 +250,8 @@ namespace Net {
         void Base::async_shutdown(Shutdown_Fn fn)
         {
           log_shutdown();
+          // TLSv1.3 session tickets are only received after the handshake
+          session_cache_.store(stream_.native_handle());
           stream_.async_shutdown(fn);
         }
         void Base::cancel()
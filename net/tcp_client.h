@@ -22,6 +22,7 @@
 #define NET_TCP_CLIENT_H
 
 #include <net/client.h>
+#include <net/ssl_session.h>
 
 #include <log/log.h>
 
@@ -94,17 +95,29 @@ namespace Net {
             std::string ca_file;
             std::string ca_path;
             bool        tls1          {true};
+            // file to persist the TLS session in for resumption,
+            // empty -> disabled
+            std::string session_cache;
 
+            // configures a fresh context - call it once, before the context
+            // is passed to any Base, since clients on other threads
+            // may use it concurrently
             boost::asio::ssl::context &apply(boost::asio::ssl::context &context) const;
         };
 
+        // handshakes over all connections of the process
+        size_t resumed_handshakes();
+        size_t full_handshakes();
+
         class Base : public Net::Client::Base {
           private:
             const Options             &opts_;
             boost::asio::ssl::context &context_;
             boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream_;
             boost::asio::ip::tcp::resolver resolver_;
+            Net::SSL::Session_Cache        session_cache_;
 
+            void log_handshake();
         public:
             void async_resolve(Resolve_Fn fn) override;
 
@@ -122,6 +135,8 @@ namespace Net {
             void close() override;
             bool is_open() const override;
           public:
+            // context: already configured via Options::apply(),
+            // it isn't modified
             Base(boost::asio::io_service &io_service,
                 boost::asio::ssl::context &context, const Options &opts,
           boost::log::sources::severity_logger<Log::Severity> &lg
@@ -20,97 +20,188 @@
 }}} */
 #include "sequence_set.h"
 
-#include <functional>
+#include <algorithm>
 
-#include <boost/icl/interval_map.hpp>
-
-namespace icl = boost::icl;
 using namespace std;
 
-using ISet = icl::interval_set<uint32_t, std::less, icl::closed_interval<uint32_t> >;
-
-class Sequence_Set_Priv {
-  private:
-    ISet iset_;
-  public:
-    Sequence_Set_Priv();
-    ~Sequence_Set_Priv();
-    void   push(uint32_t id);
-    void   push(uint32_t fst, uint32_t snd);
-    void   copy(std::vector<std::pair<uint32_t, uint32_t> > &v) const;
-    size_t size() const;
-    void   clear();
-};
-
-Sequence_Set_Priv::Sequence_Set_Priv()
+Sequence_Set::Sequence_Set()
 {
 }
-Sequence_Set_Priv::~Sequence_Set_Priv()
+
+void Sequence_Set::push(uint32_t id)
 {
+  if (ranges_.empty() || id > uint64_t(ranges_.back().second) + 1)
+    ranges_.emplace_back(id, id);
+  else if (id == uint64_t(ranges_.back().second) + 1)
+    ++ranges_.back().second;
+  else if (id < ranges_.back().first)
+    insert(id, id);
 }
-void Sequence_Set_Priv::push(uint32_t id)
+
+void Sequence_Set::push(uint32_t fst, uint32_t snd)
 {
-  ISet::interval_type i(id, id);
-  iset_.insert(i);
+  if (fst > snd)
+    return;
+  if (ranges_.empty() || fst > uint64_t(ranges_.back().second) + 1)
+    ranges_.emplace_back(fst, snd);
+  else if (fst >= ranges_.back().first)
+    ranges_.back().second = max(ranges_.back().second, snd);
+  else
+    insert(fst, snd);
 }
-void Sequence_Set_Priv::push(uint32_t fst, uint32_t snd)
+
+// merges all ranges that overlap or are adjacent to [fst, snd]
+void Sequence_Set::insert(uint32_t fst, uint32_t snd)
 {
-  ISet::interval_type i(fst, snd);
-  iset_.insert(i);
+  auto b = lower_bound(ranges_.begin(), ranges_.end(), fst,
+      [](const Range &r, uint32_t x) { return uint64_t(r.second) + 1 < x; });
+  auto e = upper_bound(b, ranges_.end(), snd,
+      [](uint32_t x, const Range &r) { return uint64_t(x) + 1 < r.first; });
+  if (b == e) {
+    ranges_.emplace(b, fst, snd);
+    return;
+  }
+  b->first = min(b->first, fst);
+  b->second = max((e - 1)->second, snd);
+  ranges_.erase(b + 1, e);
 }
-void Sequence_Set_Priv::copy(std::vector<std::pair<uint32_t, uint32_t> > &v) const
+
+void Sequence_Set::copy(std::vector<Range> &v) const
 {
-  v.clear();
-  for (auto &i : iset_)
-    v.emplace_back(icl::first(i), icl::last(i));
+  v = ranges_;
+}
 
+const std::vector<Sequence_Set::Range> &Sequence_Set::ranges() const
+{
+  return ranges_;
 }
-size_t Sequence_Set_Priv::size() const
+
+size_t Sequence_Set::size() const
 {
-  return icl::interval_count(iset_);
+  return ranges_.size();
 }
-void Sequence_Set_Priv::clear()
+
+size_t Sequence_Set::count() const
 {
-  iset_.clear();
+  size_t n = 0;
+  for (auto &r : ranges_)
+    n += size_t(r.second - r.first) + 1;
+  return n;
 }
 
-Sequence_Set::Sequence_Set()
-  : d(new Sequence_Set_Priv())
+void Sequence_Set::clear()
 {
+  ranges_.clear();
 }
 
-Sequence_Set::~Sequence_Set()
+bool Sequence_Set::empty() const
 {
-  delete d;
+  return ranges_.empty();
 }
 
-void Sequence_Set::push(uint32_t id)
+bool Sequence_Set::contains(uint32_t id) const
 {
-  d->push(id);
+  auto i = upper_bound(ranges_.begin(), ranges_.end(), id,
+      [](uint32_t x, const Range &r) { return x < r.first; });
+  return i != ranges_.begin() && id <= (i - 1)->second;
 }
 
-void Sequence_Set::copy(std::vector<std::pair<uint32_t, uint32_t> > &v) const
+Sequence_Set &Sequence_Set::operator=(const std::vector<Range> &v)
 {
-  d->copy(v);
+  for (auto &x : v)
+    push(x.first, x.second);
+  return *this;
 }
 
-size_t Sequence_Set::size() const
+Sequence_Set &Sequence_Set::operator|=(const Sequence_Set &o)
 {
-  return d->size();
+  vector<Range> r;
+  r.reserve(ranges_.size() + o.ranges_.size());
+  auto add = [&r](const Range &x) {
+    if (!r.empty() && uint64_t(r.back().second) + 1 >= x.first)
+      r.back().second = max(r.back().second, x.second);
+    else
+      r.push_back(x);
+  };
+  auto i = ranges_.begin();
+  auto j = o.ranges_.begin();
+  while (i != ranges_.end() || j != o.ranges_.end()) {
+    if (j == o.ranges_.end() || (i != ranges_.end() && i->first < j->first))
+      add(*i++);
+    else
+      add(*j++);
+  }
+  swap(ranges_, r);
+  return *this;
 }
 
-void Sequence_Set::clear()
+Sequence_Set &Sequence_Set::operator-=(const Sequence_Set &o)
 {
-  d->clear();
+  vector<Range> r;
+  r.reserve(ranges_.size());
+  auto j = o.ranges_.begin();
+  for (auto &x : ranges_) {
+    uint64_t fst = x.first;
+    while (j != o.ranges_.end() && j->second < fst)
+      ++j;
+    for (auto k = j; k != o.ranges_.end() && k->first <= x.second; ++k) {
+      if (k->first > fst)
+        r.emplace_back(uint32_t(fst), k->first - 1);
+      fst = uint64_t(k->second) + 1;
+      if (k->second >= x.second)
+        break;
+    }
+    if (fst <= x.second)
+      r.emplace_back(uint32_t(fst), x.second);
+  }
+  swap(ranges_, r);
+  return *this;
 }
 
-Sequence_Set &Sequence_Set::operator=(const std::vector<std::pair<uint32_t, uint32_t> > &v)
+Sequence_Set &Sequence_Set::operator&=(const Sequence_Set &o)
 {
-  for (auto &x : v)
-    d->push(x.first, x.second);
+  vector<Range> r;
+  auto i = ranges_.begin();
+  auto j = o.ranges_.begin();
+  while (i != ranges_.end() && j != o.ranges_.end()) {
+    uint32_t fst = max(i->first, j->first);
+    uint32_t snd = min(i->second, j->second);
+    if (fst <= snd)
+      r.emplace_back(fst, snd);
+    if (i->second < j->second)
+      ++i;
+    else
+      ++j;
+  }
+  swap(ranges_, r);
   return *this;
 }
-bool Sequence_Set::empty() const
+
+static char *format(char *e, uint32_t x)
+{
+  do {
+    *--e = '0' + x % 10;
+    x /= 10;
+  } while (x);
+  return e;
+}
+
+std::ostream &operator<<(std::ostream &o, const Sequence_Set &s)
 {
-  return size() == 0;
+  bool first = true;
+  for (auto &r : s.ranges()) {
+    // ",4294967295:4294967295"
+    char b[24];
+    char *e = b + sizeof b;
+    char *p = format(e, r.second);
+    if (r.first != r.second) {
+      *--p = ':';
+      p = format(p, r.first);
+    }
+    if (!first)
+      *--p = ',';
+    first = false;
+    o.write(p, e - p);
+  }
+  return o;
 }
@@ -23,26 +23,49 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <ostream>
 #include <utility>
 #include <vector>
 
-class Sequence_Set_Priv;
+// A set of UIDs (or message sequence numbers) as sorted list of disjoint,
+// non-adjacent closed ranges.
+//
+// Optimized for ascending pushes, which just extend (or follow) the last
+// range in O(1).
 class Sequence_Set {
-
+  public:
+    using Range = std::pair<uint32_t, uint32_t>;
   private:
-    Sequence_Set_Priv *d {nullptr};
+    std::vector<Range> ranges_;
+
+    void insert(uint32_t fst, uint32_t snd);
     Sequence_Set(const Sequence_Set&) =delete;
     Sequence_Set &operator=(const Sequence_Set&) =delete;
   public:
     Sequence_Set();
-    ~Sequence_Set();
+    Sequence_Set(Sequence_Set &&) =default;
+    Sequence_Set &operator=(Sequence_Set &&) =default;
+
     void   push(uint32_t id);
-    void   copy(std::vector<std::pair<uint32_t, uint32_t> > &v) const;
+    void   push(uint32_t fst, uint32_t snd);
+    void   copy(std::vector<Range> &v) const;
+    // e.g. to pass it to the IMAP::Client::Writer without copying
+    const std::vector<Range> &ranges() const;
+    // number of ranges
     size_t size() const;
+    // number of elements
+    size_t count() const;
     void   clear();
     bool   empty() const;
+    bool   contains(uint32_t id) const;
 
-    Sequence_Set &operator=(const std::vector<std::pair<uint32_t, uint32_t> > &v);
+    Sequence_Set &operator=(const std::vector<Range> &v);
+    Sequence_Set &operator|=(const Sequence_Set &o);
+    Sequence_Set &operator-=(const Sequence_Set &o);
+    Sequence_Set &operator&=(const Sequence_Set &o);
 };
 
+// IMAP sequence-set syntax, e.g. 1:3,5
+std::ostream &operator<<(std::ostream &o, const Sequence_Set &s);
+
 #endif
@@ -25,12 +25,92 @@
 #include <chrono>
 #include <utility>
 #include <stdexcept>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <string.h>
+#include <stdint.h>
 #include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+#include <zlib.h>
 
 using namespace std;
 
 namespace Trace {
 
+  // binary format:
+  //
+  //     file   = MAGIC block*
+  //     block  = u32 kind, u32 stored size, u32 raw size, payload
+  //     record = u8 type, u64 timestamp, u32 size, message
+  //
+  // all integers are little endian, the payload of a DEFLATE
+  // block is compressed with zlib
+  static const char   MAGIC[]    = "IMAPDLT1";
+  static const size_t MAGIC_SIZE = sizeof MAGIC - 1;
+  static const size_t BLOCK_HEADER_SIZE = 12;
+  static const size_t RECORD_HEADER_SIZE = 13;
+  enum : uint32_t { RAW_BLOCK = 0, DEFLATE_BLOCK = 1 };
+
+  // a block is handed off to the writer thread when it is full - at most
+  // MAX_BLOCKS blocks are queued - or, such that a trace of a stalled
+  // or crashed connection is still on disk, after a DISCONNECT record
+  // and when its first record is older than HAND_OFF_AGE
+  static const size_t BLOCK_SIZE = 64 * 1024;
+  static const size_t MAX_BLOCKS = 16;
+  static const chrono::milliseconds HAND_OFF_AGE(1000);
+
+  static void put_u32(char *p, uint32_t x)
+  {
+    for (unsigned i = 0; i < 4; ++i)
+      p[i] = char(x >> (8 * i));
+  }
+  static uint32_t get_u32(const char *p)
+  {
+    uint32_t x = 0;
+    for (unsigned i = 0; i < 4; ++i)
+      x |= uint32_t(uint8_t(p[i])) << (8 * i);
+    return x;
+  }
+  static void put_u64(char *p, uint64_t x)
+  {
+    for (unsigned i = 0; i < 8; ++i)
+      p[i] = char(x >> (8 * i));
+  }
+  static uint64_t get_u64(const char *p)
+  {
+    uint64_t x = 0;
+    for (unsigned i = 0; i < 8; ++i)
+      x |= uint64_t(uint8_t(p[i])) << (8 * i);
+    return x;
+  }
+
+  std::istream &operator>>(std::istream &i, Format &f)
+  {
+    string s;
+    i >> s;
+    if (s == "text")
+      f = Format::TEXT;
+    else if (s == "binary")
+      f = Format::BINARY;
+    else if (s == "deflate")
+      f = Format::DEFLATE;
+    else
+      i.setstate(ios::failbit);
+    return i;
+  }
+  std::ostream &operator<<(std::ostream &o, Format f)
+  {
+    switch (f) {
+      case Format::TEXT:    o << "text"   ; break;
+      case Format::BINARY:  o << "binary" ; break;
+      case Format::DEFLATE: o << "deflate"; break;
+    }
+    return o;
+  }
+
   Record::Record()
   {
   }
@@ -77,22 +157,67 @@ namespace Trace {
 
   class Writer_Priv {
     private:
+      Format format_;
       ofstream file_;
       std::chrono::time_point<std::chrono::steady_clock> start_;
-    public:
+      // start_ when the first record of block_ was pushed
+      std::chrono::time_point<std::chrono::steady_clock> block_start_;
       unique_ptr<boost::archive::text_oarchive>          oarchive_;
 
+      // filled by the caller
+      vector<char> block_;
+
+      // shared with the writer thread
+      mutex m_;
+      condition_variable filled_;
+      condition_variable drained_;
+      deque<vector<char>> full_;
+      vector<vector<char>> free_;
+      bool done_ {false};
+      exception_ptr error_;
+
+      vector<char> compressed_;
+      thread thread_;
+
+      void hand_off();
+      void run();
+      void write(const vector<char> &block);
+      void write_text(const vector<char> &block);
+      void write_block(uint32_t kind, const char *b, size_t n, size_t raw);
     public:
-      Writer_Priv(const string &filename);
+      Writer_Priv(const string &filename, Format format);
+      ~Writer_Priv();
       size_t elapsed();
+      void push(Type type, size_t timestamp, const char *b, size_t n);
+      void finish();
   };
-  Writer_Priv::Writer_Priv(const string &filename)
+  Writer_Priv::Writer_Priv(const string &filename, Format format)
+    :
+      format_(format)
   {
     file_.exceptions(ofstream::failbit | ofstream::badbit );
     file_.open(filename, ofstream::out | ofstream::binary);
-    unique_ptr<boost::archive::text_oarchive> a(new boost::archive::text_oarchive(file_));
-    oarchive_ = std::move(a);
+    if (format_ == Format::TEXT) {
+      unique_ptr<boost::archive::text_oarchive> a(
+          new boost::archive::text_oarchive(file_));
+      oarchive_ = std::move(a);
+    } else {
+      file_.write(MAGIC, MAGIC_SIZE);
+    }
+    block_.reserve(BLOCK_SIZE);
     start_ = chrono::steady_clock::now();
+    thread_ = thread(&Writer_Priv::run, this);
+  }
+  Writer_Priv::~Writer_Priv()
+  {
+    if (thread_.joinable()) {
+      {
+        lock_guard<mutex> lock(m_);
+        done_ = true;
+      }
+      filled_.notify_one();
+      thread_.join();
+    }
   }
   size_t Writer_Priv::elapsed()
   {
@@ -101,14 +226,153 @@ namespace Trace {
     start_ = chrono::steady_clock::now();
     return s;
   }
+  void Writer_Priv::push(Type type, size_t timestamp, const char *b, size_t n)
+  {
+    // start_ is the time of the last elapsed() call, i.e. no extra
+    // clock read per record
+    if (block_.empty())
+      block_start_ = start_;
+    size_t off = block_.size();
+    block_.resize(off + RECORD_HEADER_SIZE + n);
+    char *p = block_.data() + off;
+    *p = char(type);
+    put_u64(p + 1, timestamp);
+    put_u32(p + 9, n);
+    if (n)
+      memcpy(p + RECORD_HEADER_SIZE, b, n);
+    if (block_.size() >= BLOCK_SIZE || type == Type::DISCONNECT
+        || start_ - block_start_ >= HAND_OFF_AGE)
+      hand_off();
+  }
+  void Writer_Priv::hand_off()
+  {
+    if (block_.empty())
+      return;
+    unique_lock<mutex> lock(m_);
+    drained_.wait(lock, [this]{ return full_.size() < MAX_BLOCKS; });
+    full_.push_back(std::move(block_));
+    if (free_.empty()) {
+      block_ = vector<char>();
+      block_.reserve(BLOCK_SIZE);
+    } else {
+      block_ = std::move(free_.back());
+      free_.pop_back();
+    }
+    lock.unlock();
+    filled_.notify_one();
+  }
+  void Writer_Priv::run()
+  {
+    for (;;) {
+      vector<char> block;
+      bool idle = false;
+      {
+        unique_lock<mutex> lock(m_);
+        filled_.wait(lock, [this]{ return done_ || !full_.empty(); });
+        if (full_.empty())
+          break;
+        block = std::move(full_.front());
+        full_.pop_front();
+      }
+      // after an error the remaining blocks are discarded such
+      // that the caller doesn't block
+      if (!error_) {
+        try {
+          write(block);
+        } catch (...) {
+          error_ = current_exception();
+        }
+      }
+      block.clear();
+      {
+        lock_guard<mutex> lock(m_);
+        if (free_.size() < MAX_BLOCKS)
+          free_.push_back(std::move(block));
+        idle = full_.empty();
+      }
+      drained_.notify_one();
+      // a partial block has to reach the file, not only the stream buffer
+      if (idle && !error_) {
+        try {
+          file_.flush();
+        } catch (...) {
+          error_ = current_exception();
+        }
+      }
+    }
+    if (!error_) {
+      try {
+        file_.flush();
+      } catch (...) {
+        error_ = current_exception();
+      }
+    }
+  }
+  void Writer_Priv::write(const vector<char> &block)
+  {
+    switch (format_) {
+      case Format::TEXT:
+        write_text(block);
+        break;
+      case Format::BINARY:
+        write_block(RAW_BLOCK, block.data(), block.size(), block.size());
+        break;
+      case Format::DEFLATE:
+        {
+          uLongf n = compressBound(block.size());
+          compressed_.resize(n);
+          int r = compress2(reinterpret_cast<Bytef*>(compressed_.data()), &n,
+              reinterpret_cast<const Bytef*>(block.data()), block.size(),
+              Z_BEST_SPEED);
+          if (r != Z_OK)
+            throw runtime_error("Trace Writer: deflate failed");
+          write_block(DEFLATE_BLOCK, compressed_.data(), n, block.size());
+        }
+        break;
+    }
+  }
+  void Writer_Priv::write_text(const vector<char> &block)
+  {
+    const char *p = block.data();
+    const char *e = p + block.size();
+    while (p < e) {
+      size_t n = get_u32(p + 9);
+      Trace::Record r(Type(*p), get_u64(p + 1), p + RECORD_HEADER_SIZE, n);
+      *oarchive_ << r;
+      p += RECORD_HEADER_SIZE + n;
+    }
+  }
+  void Writer_Priv::write_block(uint32_t kind, const char *b, size_t n,
+      size_t raw)
+  {
+    char header[BLOCK_HEADER_SIZE];
+    put_u32(header, kind);
+    put_u32(header + 4, n);
+    put_u32(header + 8, raw);
+    file_.write(header, sizeof header);
+    file_.write(b, n);
+  }
+  void Writer_Priv::finish()
+  {
+    push(Type::END_OF_FILE, 0, nullptr, 0);
+    hand_off();
+    {
+      lock_guard<mutex> lock(m_);
+      done_ = true;
+    }
+    filled_.notify_one();
+    thread_.join();
+    if (error_)
+      rethrow_exception(error_);
+  }
 
   Writer::Writer()
   {
   }
-  Writer::Writer(const std::string &filename)
+  Writer::Writer(const std::string &filename, Format format)
   {
     if (!filename.empty())
-      start(filename);
+      start(filename, format);
   }
   Writer::~Writer()
   {
@@ -118,32 +382,167 @@ namespace Trace {
       // don't throw exceptions from destructor ...
     }
   }
-  void Writer::start(const std::string &filename)
+  void Writer::start(const std::string &filename, Format format)
   {
     if (d)
       throw logic_error("Trace Writer already started");
-    d = unique_ptr<Writer_Priv>(new Writer_Priv(filename));
+    d = unique_ptr<Writer_Priv>(new Writer_Priv(filename, format));
   }
   void Writer::push(Type type)
   {
     if (!d)
       return;
-    Trace::Record r(type, d->elapsed());
-    *d->oarchive_ << r;
+    d->push(type, d->elapsed(), nullptr, 0);
   }
   void Writer::push(Type type, const std::vector<char> &v, size_t size)
   {
     if (!d)
       return;
-    Trace::Record r(type, d->elapsed(), v.data(), std::min(v.size(), size));
-    *d->oarchive_ << r;
+    d->push(type, d->elapsed(), v.data(), std::min(v.size(), size));
+  }
+  void Writer::push(const Record &r)
+  {
+    if (!d)
+      return;
+    d->push(r.type, r.timestamp, r.message.data(), r.message.size());
   }
   void Writer::finish()
   {
     if (!d)
       return;
-    Trace::Record r(Trace::Type::END_OF_FILE);
-    *d->oarchive_ << r;
+    unique_ptr<Writer_Priv> t(std::move(d));
+    t->finish();
+  }
+
+  class Reader_Priv {
+    private:
+      ifstream file_;
+      Format format_ {Format::TEXT};
+      unique_ptr<boost::archive::text_iarchive> iarchive_;
+      vector<char> block_;
+      vector<char> compressed_;
+      size_t pos_ {0};
+      bool eof_ {false};
+
+      bool read_block();
+    public:
+      Reader_Priv(const string &filename);
+      Format format() const { return format_; }
+      void read(Record &r);
+  };
+  Reader_Priv::Reader_Priv(const string &filename)
+  {
+    file_.exceptions(ifstream::badbit);
+    file_.open(filename, ifstream::in | ifstream::binary);
+    if (!file_)
+      throw runtime_error("Could not open trace file: " + filename);
+    char magic[MAGIC_SIZE] = {0};
+    file_.read(magic, MAGIC_SIZE);
+    if (size_t(file_.gcount()) == MAGIC_SIZE
+        && !memcmp(magic, MAGIC, MAGIC_SIZE)) {
+      format_ = Format::BINARY;
+      // the first block tells whether it is compressed
+      eof_ = !read_block();
+      return;
+    }
+    file_.clear();
+    file_.seekg(0);
+    file_.exceptions(ifstream::failbit | ifstream::badbit);
+    unique_ptr<boost::archive::text_iarchive> a(
+        new boost::archive::text_iarchive(file_));
+    iarchive_ = std::move(a);
+  }
+  bool Reader_Priv::read_block()
+  {
+    char header[BLOCK_HEADER_SIZE];
+    file_.read(header, sizeof header);
+    if (size_t(file_.gcount()) != sizeof header)
+      return false;
+    uint32_t kind = get_u32(header);
+    size_t n = get_u32(header + 4);
+    size_t raw = get_u32(header + 8);
+    vector<char> &v = kind == DEFLATE_BLOCK ? compressed_ : block_;
+    v.resize(n);
+    file_.read(v.data(), n);
+    if (size_t(file_.gcount()) != n)
+      return false;
+    if (kind == DEFLATE_BLOCK) {
+      format_ = Format::DEFLATE;
+      block_.resize(raw);
+      uLongf m = raw;
+      int r = uncompress(reinterpret_cast<Bytef*>(block_.data()), &m,
+          reinterpret_cast<const Bytef*>(compressed_.data()), n);
+      if (r != Z_OK || m != raw)
+        return false;
+    } else if (kind != RAW_BLOCK) {
+      return false;
+    }
+    pos_ = 0;
+    return true;
+  }
+  void Reader_Priv::read(Record &r)
+  {
+    if (iarchive_) {
+      *iarchive_ >> r;
+      return;
+    }
+    r = Record();
+    if (eof_)
+      return;
+    while (pos_ == block_.size()) {
+      if (!read_block()) {
+        eof_ = true;
+        return;
+      }
+    }
+    if (block_.size() - pos_ < RECORD_HEADER_SIZE) {
+      eof_ = true;
+      return;
+    }
+    const char *p = block_.data() + pos_;
+    size_t n = get_u32(p + 9);
+    if (block_.size() - pos_ - RECORD_HEADER_SIZE < n) {
+      eof_ = true;
+      return;
+    }
+    r.type = Type(*p);
+    r.timestamp = get_u64(p + 1);
+    r.message.assign(p + RECORD_HEADER_SIZE, n);
+    pos_ += RECORD_HEADER_SIZE + n;
+    if (r.type == Type::END_OF_FILE)
+      eof_ = true;
+  }
+
+  Reader::Reader(const std::string &filename)
+    :
+      d(new Reader_Priv(filename))
+  {
+  }
+  Reader::~Reader()
+  {
+  }
+  Format Reader::format() const
+  {
+    return d->format();
+  }
+  Reader &Reader::operator>>(Record &r)
+  {
+    d->read(r);
+    return *this;
+  }
+
+  void convert(const std::string &in, const std::string &out, Format format)
+  {
+    Reader reader(in);
+    Writer writer(out, format);
+    for (;;) {
+      Record r;
+      reader >> r;
+      if (r.type == Type::END_OF_FILE)
+        break;
+      writer.push(r);
+    }
+    writer.finish();
   }
 
 }
@@ -23,6 +23,7 @@
 
 #include <string>
 #include <vector>
+#include <istream>
 #include <ostream>
 #include <memory>
 #include <limits>
@@ -36,6 +37,17 @@
 #include <boost/serialization/tracking.hpp>
 
 namespace Trace {
+  // TEXT    - boost text archive (human readable, the original format)
+  // BINARY  - length-prefixed records, grouped into blocks
+  // DEFLATE - as BINARY, but each block is deflate-compressed
+  enum class Format {
+    TEXT,
+    BINARY,
+    DEFLATE
+  };
+  std::istream &operator>>(std::istream &i, Format &f);
+  std::ostream &operator<<(std::ostream &o, Format f);
+
   enum class Type {
     SENT,
     RECEIVED,
@@ -83,6 +95,11 @@ namespace Trace {
   };
   std::ostream &operator<<(std::ostream &o, const Record &r);
 
+  // Records are serialized into blocks which are written by a
+  // background thread - push() only blocks when the bounded
+  // queue of full blocks is exhausted. A block is written when it
+  // is full, after a DISCONNECT record and when it is older than
+  // a second, i.e. the trace of a hanging process isn't lost.
   class Writer_Priv;
   class Writer {
     private:
@@ -90,13 +107,32 @@ namespace Trace {
     public:
       Writer();
       ~Writer();
-      Writer(const std::string &filename);
-      void start(const std::string &filename);
+      Writer(const std::string &filename, Format format = Format::TEXT);
+      void start(const std::string &filename, Format format = Format::TEXT);
       void push(Type type);
       void push(Type type, const std::vector<char> &v,
           size_t size = std::numeric_limits<size_t>::max());
+      // keeps the timestamp of the record, e.g. when converting
+      void push(const Record &r);
+      // writes the END_OF_FILE record and waits for the writer thread,
+      // rethrows a write error of the writer thread
       void finish();
   };
+
+  // detects the format of the file - at the end of a truncated binary
+  // trace END_OF_FILE records are returned
+  class Reader_Priv;
+  class Reader {
+    private:
+      std::unique_ptr<Reader_Priv> d;
+    public:
+      Reader(const std::string &filename);
+      ~Reader();
+      Format format() const;
+      Reader &operator>>(Record &r);
+  };
+
+  void convert(const std::string &in, const std::string &out, Format format);
 }
 BOOST_CLASS_VERSION(Trace::Record, 1)
 BOOST_CLASS_TRACKING(Trace::Record, boost::serialization::track_never)
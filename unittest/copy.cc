@@ -26,6 +26,7 @@ namespace fs = boost::filesystem;
 #include <copy/client.h>
 #include <copy/options.h>
 #include <copy/journal.h>
+#include <copy/tmp_file.h>
 #include <example/server.h>
 #include <net/ssl_util.h>
 using namespace Net::SSL;
@@ -42,6 +43,9 @@ using namespace ixxx;
 #include <chrono>
 #include <memory>
 #include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <iterator>
 
 #include "config.h"
 #if defined(IMAPDL_USE_BOTAN)
@@ -148,6 +152,43 @@ void Replay_Server::operator()()
   }
 }
 
+// example/server.cc in synthetic mode - in contrast to a replay, it
+// serves any number of sessions until it is destructed
+class Synthetic_Server {
+  private:
+    ofstream out_;
+    Server::Options opts_;
+    boost::asio::io_service io_service_;
+    unique_ptr<Server::Main> main_;
+    thread thread_;
+  public:
+    Synthetic_Server(const Synthetic::Options &synthetic,
+        const string &log_filename, unsigned port = 6666);
+    ~Synthetic_Server();
+};
+Synthetic_Server::Synthetic_Server(const Synthetic::Options &synthetic,
+    const string &log_filename, unsigned port)
+  :
+    out_(log_filename),
+    opts_(out_)
+{
+  string prefix(ut_prefix());
+  prefix += '/';
+  opts_.key = prefix + "server.key";
+  opts_.cert =  prefix + "server.crt";
+  opts_.dhparam = prefix + "dh2048.pem";
+  opts_.use_synthetic = true;
+  opts_.synthetic = synthetic;
+  opts_.port = port;
+  main_.reset(new Server::Main(io_service_, opts_, out_));
+  thread_ = thread([this]() { io_service_.run(); });
+}
+Synthetic_Server::~Synthetic_Server()
+{
+  io_service_.stop();
+  thread_.join();
+}
+
 class Client_Frontend {
   private:
     IMAP::Copy::Options opts;
@@ -166,7 +207,7 @@ class Client_Frontend {
                 opts.logfile)),
         context(boost::asio::ssl::context::sslv23),
         net_client(use_ssl?
-            (static_cast<Net::Client::Base*>(new Net::TCP::SSL::Client::Base(io_service, context, opts, lg)))
+            (static_cast<Net::Client::Base*>(new Net::TCP::SSL::Client::Base(io_service, opts.apply(context), opts, lg)))
             :
             (static_cast<Net::Client::Base*>(new Net::TCP::Client::Base(io_service, opts, lg)))
             ),
@@ -179,6 +220,12 @@ class Client_Frontend {
     {
       io_service.run();
     }
+    // e.g. for interrupting a download at a certain point
+    void run_until(const function<bool()> &pred)
+    {
+      while (!pred() && io_service.run_one())
+        ;
+    }
 };
 
 static void test_basic(bool use_ssl)
@@ -373,6 +420,119 @@ static void test_partial_2(bool use_ssl)
   BOOST_CHECK_EQUAL(fs::exists(journal), false);
 }
 
+static string read_file(const string &filename)
+{
+  ifstream f(filename, ifstream::in | ifstream::binary);
+  return string((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+}
+
+static string crlf_to_lf(const string &s)
+{
+  string r;
+  for (size_t i = 0; i < s.size(); ++i)
+    if (!(s[i] == '\r' && i + 1 < s.size() && s[i+1] == '\n'))
+      r += s[i];
+  return r;
+}
+
+// A chunked download is interrupted after a few chunks, the tmp file
+// gets some garbage appended (i.e. data that was written after the
+// last partial journal record) and a second run resumes it.
+static void test_partial_resume()
+{
+  string maildir{"tmp/cp/resume"};
+  string journal{"tmp/resume.journal"};
+  string partial{journal + ".partial"};
+  fs::remove_all(maildir);
+  fs::remove(journal);
+  fs::remove(partial);
+
+  // UID 2 is large
+  Synthetic::Options synthetic;
+  synthetic.messages = 2;
+  synthetic.mean_size = 512;
+  synthetic.large_every = 2;
+  synthetic.large_size = 16 * 1024;
+  Synthetic::Mailbox mailbox(synthetic);
+  string message(mailbox.message(2));
+  // the first chunk ends inside a CRLF
+  size_t chunk = 1024;
+  while (message[chunk - 1] != '\r')
+    ++chunk;
+  BOOST_REQUIRE_EQUAL(message[chunk], '\n');
+
+  Synthetic_Server server(synthetic, "ut_resume_server.log");
+
+  string prefix(ut_prefix());
+  prefix += '/';
+  string configfile{prefix+"cp.conf"};
+  char cconfigfile[128] = {0};
+  strncpy(cconfigfile, configfile.c_str(), sizeof(cconfigfile)-1);
+  string chunk_str(to_string(chunk));
+  char *argv[] = {
+    (char*)"imapcp",
+    (char*)"--account", (char*)"fake",
+    (char*)"--log", (char*)"ut_resume.log", (char*)"--log_v",
+    (char*)"--maildir", (char*)maildir.c_str(),
+    (char*)"-v6",
+    (char*)"--config", cconfigfile,
+    (char*)"--ssl", (char*)"no",
+    (char*)"--journal", (char*)journal.c_str(),
+    (char*)"--partial_threshold", (char*)"4096",
+    (char*)"--partial_chunk", (char*)chunk_str.c_str(),
+    0
+  };
+  int argc = sizeof(argv)/sizeof(char*)-1;
+
+  IMAP::Copy::Partial_Journal j;
+  {
+    Client_Frontend client(argc, argv, false);
+    client.run_until([&]() {
+        if (!fs::exists(partial))
+          return false;
+        j.read(partial);
+        return j.offset_ > 3 * chunk;
+      });
+  }
+  BOOST_REQUIRE(fs::exists(partial));
+  j.read(partial);
+  BOOST_CHECK_EQUAL(j.mailbox_, "INBOX");
+  BOOST_CHECK_EQUAL(j.uidvalidity_, 1413619200u);
+  BOOST_CHECK_EQUAL(j.uid_, 2u);
+  string tmp_path(maildir + "/tmp/" + j.tmp_name_);
+  string data(read_file(tmp_path));
+  BOOST_CHECK_EQUAL(data.size(), j.size_);
+  // each LF was a CRLF on the server
+  BOOST_CHECK_EQUAL(j.offset_, data.size() + count(data.begin(), data.end(), '\n'));
+  // the CR at the end of the first chunk was dropped and fetched again
+  // with the second one, i.e. the CRLF was converted
+  BOOST_CHECK(data.find('\r') == string::npos);
+  BOOST_CHECK_EQUAL(data, crlf_to_lf(message.substr(0, j.offset_)));
+
+  {
+    ofstream f(tmp_path, ofstream::out | ofstream::binary | ofstream::app);
+    f << "garbage that never made it into the partial journal";
+  }
+
+  {
+    Client_Frontend client(argc, argv, false);
+    client.run();
+  }
+  BOOST_CHECK(!fs::exists(partial));
+  BOOST_CHECK(!fs::exists(tmp_path));
+
+  set<string> messages;
+  for (const char *sub : { "/new", "/cur" }) {
+    fs::directory_iterator begin(maildir + sub);
+    fs::directory_iterator end;
+    for (auto i = begin; i != end; ++i)
+      messages.insert(read_file((*i).path().generic_string()));
+  }
+  BOOST_CHECK_EQUAL(messages.size(), 2u);
+  BOOST_CHECK(messages.count(crlf_to_lf(mailbox.message(1))));
+  BOOST_CHECK(messages.count(crlf_to_lf(mailbox.message(2))));
+}
+
 static void test_fetch_header()
 {
   bool use_ssl = false;
@@ -534,6 +694,11 @@ BOOST_AUTO_TEST_SUITE( copy )
     boost::log::core::get()->remove_all_sinks();
     test_partial_2(true);
   }
+  BOOST_AUTO_TEST_CASE(partial_resume)
+  {
+    boost::log::core::get()->remove_all_sinks();
+    test_partial_resume();
+  }
   BOOST_AUTO_TEST_CASE(fetch_header)
   {
     boost::log::core::get()->remove_all_sinks();
@@ -576,4 +741,104 @@ BOOST_AUTO_TEST_SUITE( copy )
       BOOST_CHECK(j.uidvalidity_ == 23);
   }
 
+  BOOST_AUTO_TEST_CASE(append_journal)
+  {
+      string filename{"tmp/append.journal"};
+      fs::create_directory("tmp");
+      fs::remove(filename);
+      {
+          IMAP::Copy::Journal j;
+          j.mailbox_     = "INBOX";
+          j.uidvalidity_ = 42;
+          j.uids_        = { { 1, 10 } };
+          IMAP::Copy::Journal_Writer w;
+          w.open(filename, j);
+          w.append({ { 11, 11 }, { 13, 20 } });
+          w.append({ { 21, 30 } });
+      }
+      {
+          // simulate a torn write
+          ofstream f(filename, ofstream::app | ofstream::binary);
+          f.write("\x1f\0\0\0\x20", 5);
+      }
+      IMAP::Copy::Journal j;
+      j.read(filename);
+      BOOST_CHECK_EQUAL(j.mailbox_, "INBOX");
+      BOOST_CHECK_EQUAL(j.uidvalidity_, 42);
+      vector<pair<uint32_t, uint32_t> > ref = {
+        { 1, 10 }, { 11, 11 }, { 13, 20 }, { 21, 30 } };
+      BOOST_REQUIRE_EQUAL(j.uids_.size(), ref.size());
+      for (size_t i = 0; i < ref.size(); ++i) {
+        BOOST_CHECK_EQUAL(j.uids_[i].first, ref[i].first);
+        BOOST_CHECK_EQUAL(j.uids_[i].second, ref[i].second);
+      }
+      {
+          IMAP::Copy::Journal_Writer w;
+          w.open(filename, j);
+          w.remove();
+      }
+      BOOST_CHECK_EQUAL(fs::exists(filename), false);
+  }
+
+  // group commit: the tmp file is only synced by the maildir commit
+  BOOST_AUTO_TEST_CASE(tmp_file)
+  {
+      const char path[] = "tmp/mdirtmpfile";
+      fs::create_directory("tmp");
+      fs::remove_all(path);
+      Maildir m(path);
+      m.set_batch_size(8);
+      string name;
+      m.create_tmp_name(name);
+      const char msg[] = "Subject: foo\n\nhello world\n";
+      {
+          IMAP::Copy::Tmp_File f(m.tmp_dir_fd(), name);
+          // the parser hands spans over like this when a read
+          // ends inside the body
+          f.start(msg);
+          f.stop(msg + 10);
+          f.cont(msg + 10);
+          f.finish(msg + sizeof msg - 1);
+          f.close();
+      }
+      BOOST_CHECK_THROW(IMAP::Copy::Tmp_File(m.tmp_dir_fd(), name),
+          std::exception);
+      m.move_to_new();
+      BOOST_CHECK_EQUAL(m.uncommitted(), 1u);
+      // only visible to mail readers once the data is durable
+      BOOST_CHECK(!fs::exists(string(path) + "/new/" + name));
+      BOOST_CHECK(fs::is_empty(string(path) + "/new"));
+      m.commit();
+      BOOST_CHECK_EQUAL(m.uncommitted(), 0u);
+      ifstream in(string(path) + "/new/" + name, ifstream::binary);
+      string s((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+      BOOST_CHECK_EQUAL(s, msg);
+      BOOST_CHECK(!fs::exists(string(path) + "/tmp/" + name));
+  }
+
+  // the context is shared between the clients of several threads,
+  // thus, creating a client mustn't configure it again
+  BOOST_AUTO_TEST_CASE(ssl_context_configured_once)
+  {
+      boost::log::sources::severity_logger<Log::Severity> lg;
+      boost::asio::io_service io_service;
+      boost::asio::ssl::context context(boost::asio::ssl::context::sslv23);
+      Net::TCP::SSL::Client::Options opts;
+      opts.host = "localhost";
+      opts.service = "993";
+      opts.ca_file = ut_prefix() + "/server.crt";
+      opts.apply(context);
+      long options = SSL_CTX_get_options(context.native_handle());
+
+      // applying these would throw/change the options
+      opts.ca_file = "tmp/no/such/ca.pem";
+      opts.tls1 = false;
+      unique_ptr<Net::Client::Base> a, b;
+      BOOST_CHECK_NO_THROW(a.reset(new Net::TCP::SSL::Client::Base(
+              io_service, context, opts, lg)));
+      BOOST_CHECK_NO_THROW(b.reset(new Net::TCP::SSL::Client::Base(
+              io_service, context, opts, lg)));
+      BOOST_CHECK_EQUAL(SSL_CTX_get_options(context.native_handle()), options);
+  }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,198 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <net/deflate.h>
+#include <net/client.h>
+#include <imap/client_parser.h>
+
+#include <boost/asio/io_service.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace {
+
+  // hands out canned reads
+  class Fake_Transport : public Net::Client::Base {
+    private:
+      deque<string> reads_;
+    public:
+      Fake_Transport(boost::asio::io_service &io_service,
+          const Net::Client::Options &opts,
+          boost::log::sources::severity_logger<Log::Severity> &lg)
+        : Net::Client::Base(io_service, opts, lg)
+      {
+      }
+      void push(const string &s) { reads_.push_back(s); }
+      bool empty() const { return reads_.empty(); }
+
+      void async_resolve(Resolve_Fn) override {}
+      void async_resolve(const boost::asio::ip::tcp::resolver::query &,
+          Resolve_Fn) override {}
+      void async_connect(boost::asio::ip::tcp::resolver::iterator,
+          Connect_Fn) override {}
+      void async_handshake(Handshake_Fn) override {}
+      void async_read_some(Read_Fn fn) override
+      {
+        if (post_pending_read(fn))
+          return;
+        vector<char> &b = read_buffer();
+        string s(std::move(reads_.front()));
+        reads_.pop_front();
+        BOOST_REQUIRE(s.size() <= b.size());
+        std::copy(s.begin(), s.end(), b.begin());
+        size_t n = s.size();
+        io_service_.post([this, fn, n]() {
+            boost::system::error_code ec;
+            handle_read(ec, n, fn);
+          });
+      }
+      void async_write(const char *, size_t, Write_Fn) override {}
+      void async_write(const std::vector<char> &, Write_Fn) override {}
+      void async_shutdown(Shutdown_Fn) override {}
+      void cancel() override {}
+      void close() override {}
+      bool is_open() const override { return true; }
+  };
+
+  class Compress_Callback : public IMAP::Client::Callback::Null {
+    public:
+      Net::Client::Base *transport {nullptr};
+      IMAP::Client::Parser *parser {nullptr};
+      vector<uint32_t> exists;
+    protected:
+      void imap_tagged_status_end(IMAP::Server::Response::Status) override
+      {
+        parser->stop();
+        transport->enable_compression();
+      }
+      void imap_data_exists(uint32_t number) override
+      {
+        exists.push_back(number);
+      }
+  };
+
+}
+
+
+BOOST_AUTO_TEST_SUITE( net_deflate )
+
+  BOOST_AUTO_TEST_CASE( roundtrip )
+  {
+    Net::Deflate a;
+    Net::Deflate b;
+    string s;
+    for (unsigned i = 0; i < 1000; ++i)
+      s += "* 23 FETCH (UID 42 FLAGS (\\Seen))\r\n";
+    vector<char> in(s.begin(), s.end());
+    vector<char> out;
+    a.deflate(in, out);
+    BOOST_CHECK(out.size() < in.size() / 10);
+
+    // small output buffer to exercise the pending input handling
+    b.set_input(out.data(), out.size());
+    string r;
+    vector<char> buffer(100);
+    do {
+      size_t n = b.inflate(buffer.data(), buffer.size());
+      r.append(buffer.data(), n);
+    } while (b.pending());
+    BOOST_CHECK_EQUAL(r, s);
+  }
+
+  BOOST_AUTO_TEST_CASE( sync_flush )
+  {
+    Net::Deflate a;
+    Net::Deflate b;
+    // each command must be decodable without waiting for the next one
+    const char *cmds[] = { "A001 NOOP\r\n", "A002 LOGOUT\r\n" };
+    for (auto c : cmds) {
+      string s(c);
+      vector<char> in(s.begin(), s.end());
+      vector<char> out;
+      a.deflate(in, out);
+      b.set_input(out.data(), out.size());
+      vector<char> buffer(4096);
+      size_t n = b.inflate(buffer.data(), buffer.size());
+      BOOST_CHECK_EQUAL(string(buffer.data(), n), s);
+      BOOST_CHECK(!b.pending());
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( corrupt )
+  {
+    Net::Deflate b;
+    const char garbage[] = "\xff\xff\xff\xff";
+    b.set_input(garbage, sizeof garbage - 1);
+    vector<char> buffer(100);
+    BOOST_CHECK_THROW(b.inflate(buffer.data(), buffer.size()),
+        std::runtime_error);
+  }
+
+  // RFC4978: the server compresses right after the CRLF of the tagged
+  // OK - which may arrive in the same read as the first compressed data
+  BOOST_AUTO_TEST_CASE( compress_after_tagged_ok )
+  {
+    boost::asio::io_service io_service;
+    Net::Client::Options opts;
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    Fake_Transport t(io_service, opts, lg);
+
+    Net::Deflate server;
+    auto compress = [&server](const string &s) {
+      vector<char> in(s.begin(), s.end()), out;
+      server.deflate(in, out);
+      return string(out.begin(), out.end());
+    };
+    t.push("A001 OK DEFLATE active\r\n" + compress("* 23 EXISTS\r\n"));
+    t.push(compress("* 42 EXISTS\r\n"));
+
+    Memory::Buffer::Vector buffer;
+    Memory::Buffer::Vector tag_buffer;
+    Compress_Callback cb;
+    IMAP::Client::Parser parser(buffer, tag_buffer, cb);
+    cb.transport = &t;
+    cb.parser = &parser;
+
+    std::function<void(const boost::system::error_code&, size_t)> fn;
+    fn = [&](const boost::system::error_code &ec, size_t size) {
+      BOOST_REQUIRE(!ec);
+      const char *b = t.input().data();
+      const char *rest = parser.read(b, b + size);
+      if (rest != b + size)
+        t.set_compressed_input(rest, b + size);
+      if (cb.exists.size() < 2)
+        t.async_read_some(fn);
+    };
+    t.async_read_some(fn);
+    io_service.run();
+
+    BOOST_CHECK(t.compression_enabled());
+    BOOST_CHECK(t.empty());
+    BOOST_REQUIRE_EQUAL(cb.exists.size(), 2u);
+    BOOST_CHECK_EQUAL(cb.exists[0], 23u);
+    BOOST_CHECK_EQUAL(cb.exists[1], 42u);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -198,6 +198,40 @@ BOOST_AUTO_TEST_SUITE( imap_client_parser )
         BOOST_CHECK_EQUAL(cb.a[i], 1);
     }
 
+    BOOST_AUTO_TEST_CASE( tag_number )
+    {
+      using namespace IMAP::Server::Response;
+      const char response[] =
+        "A0042 OK done\r\n"
+        "x7y19 OK done\r\n"
+        "abc OK done\r\n";
+      const char *begin = response;
+      const char *end = begin + strlen(begin);
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        vector<uint64_t> numbers;
+        unsigned begins {0};
+        void imap_tag_number(uint64_t n) override
+        {
+          BOOST_CHECK_EQUAL(begins, numbers.size());
+          numbers.push_back(n);
+        }
+        void imap_tagged_status_begin() override
+        {
+          ++begins;
+        }
+      };
+      CB cb;
+      IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+      p.read(begin, end);
+      vector<uint64_t> ref = { 42, 19, 0 };
+      BOOST_CHECK_EQUAL_COLLECTIONS(cb.numbers.begin(), cb.numbers.end(),
+          ref.begin(), ref.end());
+      BOOST_CHECK_EQUAL(cb.begins, 3u);
+    }
+
   BOOST_AUTO_TEST_SUITE_END();
 
 
@@ -398,6 +432,91 @@ BOOST_AUTO_TEST_SUITE( imap_client_parser )
         BOOST_CHECK_EQUAL(code[static_cast<unsigned>(i)], 0);
     }
 
+    BOOST_AUTO_TEST_CASE( modseq )
+    {
+      using namespace IMAP::Server::Response;
+      const char response[] =
+        "* OK [HIGHESTMODSEQ 715194045007] Highest\r\n"
+        "* 1 FETCH (UID 4 MODSEQ (65402) FLAGS ())\r\n"
+        "* OK [NOMODSEQ] Sorry, this mailbox format doesn't support modsequences\r\n"
+        ;
+      const char *begin = response;
+      const char *end = begin + strlen(begin);
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        uint64_t highest {0};
+        uint64_t modseq {0};
+        unsigned nomodseq {0};
+        void imap_status_code(Status_Code c) override
+        {
+          if (c == Status_Code::NOMODSEQ)
+            ++nomodseq;
+        }
+        void imap_status_code_highestmodseq(uint64_t n) override
+        {
+          highest = n;
+        }
+        void imap_modseq(uint64_t n) override
+        {
+          modseq = n;
+        }
+      };
+      CB cb;
+      IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+      p.read(begin, end);
+      BOOST_CHECK_EQUAL(cb.highest, 715194045007ull);
+      BOOST_CHECK_EQUAL(cb.modseq, 65402u);
+      BOOST_CHECK_EQUAL(cb.nomodseq, 1u);
+    }
+
+    // numbers are accumulated across read() calls
+    BOOST_AUTO_TEST_CASE( split_numbers )
+    {
+      using namespace IMAP::Server::Response;
+      const char response[] =
+        "* 4294967295 EXISTS\r\n"
+        "* OK [HIGHESTMODSEQ 9223372036854775807] Highest\r\n"
+        "* 12 FETCH (UID 123456 RFC822.SIZE 70000 BODY[] {10}\r\n"
+        "0123456789)\r\n"
+        ;
+      const char *begin = response;
+      const char *end = begin + strlen(begin);
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        vector<uint64_t> v;
+        void imap_data_exists(uint32_t n) override { v.push_back(n); }
+        void imap_status_code_highestmodseq(uint64_t n) override
+        {
+          v.push_back(n);
+        }
+        void imap_data_fetch_begin(uint32_t n) override { v.push_back(n); }
+        void imap_uid(uint32_t n) override { v.push_back(n); }
+        void imap_rfc822_size(uint32_t n) override { v.push_back(n); }
+        void imap_body_section_end() override
+        {
+          v.push_back(buffer.end() - buffer.begin());
+        }
+      };
+      const vector<uint64_t> ref = { 4294967295u, 9223372036854775807ull,
+        12u, 123456u, 70000u, 10u };
+      for (size_t chunk : { 1, 2, 3, 7 }) {
+        CB cb;
+        IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+        for (const char *a = begin; a != end; ) {
+          const char *b = a + min(chunk, size_t(end - a));
+          p.read(a, b);
+          a = b;
+        }
+        BOOST_CHECK(p.finished());
+        BOOST_CHECK_EQUAL_COLLECTIONS(cb.v.begin(), cb.v.end(),
+            ref.begin(), ref.end());
+      }
+    }
+
     BOOST_AUTO_TEST_CASE( nz_underflow )
     {
       using namespace IMAP::Server::Response;
@@ -524,6 +643,70 @@ BOOST_AUTO_TEST_SUITE( imap_client_parser )
       BOOST_CHECK_EQUAL(cb.number_, 11810);
     }
 
+    BOOST_AUTO_TEST_CASE( rfc822_size )
+    {
+      using namespace IMAP::Server::Response;
+      const char response[] =
+        "* 12 FETCH (UID 4711 RFC822.SIZE 73400320)\r\n"
+        ;
+      const char *begin = response;
+      const char *end = begin + sizeof(response)-1;
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        uint32_t uid  {0};
+        uint32_t size {0};
+        void imap_uid(uint32_t number) override
+        {
+          uid = number;
+        }
+        void imap_rfc822_size(uint32_t number) override
+        {
+          size = number;
+        }
+      };
+      CB cb;
+      IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+      p.read(begin, end);
+      BOOST_CHECK_EQUAL(cb.uid, 4711u);
+      BOOST_CHECK_EQUAL(cb.size, 73400320u);
+    }
+
+    BOOST_AUTO_TEST_CASE( idle )
+    {
+      using namespace IMAP::Server::Response;
+      const char response[] =
+        "+ idling\r\n"
+        "* 23 EXISTS\r\n"
+        "* 3 FETCH (FLAGS (\\Seen))\r\n"
+        "A005 OK IDLE terminated\r\n"
+        ;
+      const char *begin = response;
+      const char *end = begin + sizeof(response)-1;
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        unsigned continuations {0};
+        uint32_t exists        {0};
+        void imap_continue_req() override
+        {
+          ++continuations;
+        }
+        void imap_data_exists(uint32_t number) override
+        {
+          exists = number;
+        }
+      };
+      CB cb;
+      IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+      p.read(begin, end);
+      BOOST_CHECK_EQUAL(cb.continuations, 1u);
+      BOOST_CHECK_EQUAL(cb.exists, 23u);
+      BOOST_CHECK_EQUAL(p.in_start(), true);
+    }
+
     BOOST_AUTO_TEST_CASE( quote )
     {
       using namespace IMAP::Server::Response;
@@ -638,6 +821,117 @@ BOOST_AUTO_TEST_SUITE( imap_client_parser )
       BOOST_CHECK_EQUAL(s, ref);
     }
 
+    BOOST_AUTO_TEST_CASE( literal_split )
+    {
+      using namespace IMAP::Server::Response;
+      const char response[] =
+"* 12 FETCH (BODY[HEADER] {16}\r\n"
+"ab\r\ncd\ref\r\n\r\n\r\r\n"
+")\r\n"
+"a004 OK FETCH completed\r\n"
+        ;
+      const char *begin = response;
+      const char *end = begin + sizeof(response)-1;
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Proxy  proxy;
+        Memory::Buffer::Vector tag_buffer;
+        void imap_body_section_inner() override
+        {
+          proxy.set(&buffer);
+        }
+        void imap_body_section_end() override
+        {
+          proxy.set(nullptr);
+        }
+      };
+      // the literal is copied in bulk - thus, check that the CRLF
+      // conversion is independent of where the reads are split
+      for (size_t k = 1; k < size_t(end - begin); ++k) {
+        CB cb;
+        IMAP::Client::Parser p(cb.proxy, cb.tag_buffer, cb);
+        for (const char *i = begin; i < end; i += k)
+          p.read(i, std::min(i + k, end));
+        string s(cb.buffer.begin(), cb.buffer.end());
+        BOOST_CHECK_EQUAL(s, "ab\ncd\ref\n\n\r\n");
+        BOOST_CHECK(p.finished());
+      }
+    }
+
+    // a read that ends with a CR inside the literal - the CR is carried
+    // over to the next read where it is either dropped (LF follows),
+    // kept (anything else follows) or kept because the literal ends
+    BOOST_AUTO_TEST_CASE( literal_cr_read_end )
+    {
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Proxy  proxy;
+        Memory::Buffer::Vector tag_buffer;
+        void imap_body_section_inner() override
+        {
+          proxy.set(&buffer);
+        }
+        void imap_body_section_end() override
+        {
+          proxy.set(nullptr);
+        }
+      };
+      const char head[] = "* 12 FETCH (BODY[HEADER] {";
+      const char tail[] = ")\r\na004 OK FETCH completed\r\n";
+      // literal, split position inside the literal, converted, verbatim
+      const array<array<const char*, 3>, 5> cases = {{
+        {{ "ab\r|\ncd",   "ab\ncd",   "ab\r\ncd"   }},
+        {{ "ab\r|xcd",    "ab\rxcd",  "ab\rxcd"    }},
+        {{ "ab\r|\r\ncd", "ab\r\ncd", "ab\r\r\ncd" }},
+        {{ "abc\r|",      "abc\r",    "abc\r"      }},
+        {{ "\r|\n",       "\n",       "\r\n"       }}
+      }};
+      for (auto &c : cases) {
+        string literal(c[0]);
+        size_t k = literal.find('|');
+        literal.erase(k, 1);
+        string response(head + to_string(literal.size()) + "}\r\n"
+            + literal + tail);
+        size_t split = response.find('{') + to_string(literal.size()).size()
+          + 4 + k;
+        for (bool convert : { true, false }) {
+          CB cb;
+          IMAP::Client::Parser p(cb.proxy, cb.tag_buffer, cb);
+          p.set_convert_crlf(convert);
+          const char *begin = response.data();
+          p.read(begin, begin + split);
+          p.read(begin + split, begin + response.size());
+          string s(cb.buffer.begin(), cb.buffer.end());
+          BOOST_CHECK_EQUAL(s, convert ? c[1] : c[2]);
+          BOOST_CHECK(p.finished());
+        }
+      }
+    }
+
+    BOOST_AUTO_TEST_CASE( literal_lf_read_start )
+    {
+      const char response[] =
+"* 12 FETCH (BODY[HEADER] {5}\r\n"
+"ab\ncd"
+")\r\n"
+"a004 OK FETCH completed\r\n"
+        ;
+      const char *begin = response;
+      const char *end = begin + sizeof(response)-1;
+      const char *split = strchr(begin, '\n') + 3;
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Proxy  proxy;
+        Memory::Buffer::Vector tag_buffer;
+      };
+      CB cb;
+      IMAP::Client::Parser p(cb.proxy, cb.tag_buffer, cb);
+      p.read(begin, split);
+      // LF without CR, at the start of a read
+      BOOST_CHECK_THROW(p.read(split, end), std::runtime_error);
+    }
+
     BOOST_AUTO_TEST_CASE( header )
     {
       static const char filename[] = "tmp/fetch_header";
@@ -1442,6 +1736,51 @@ BOOST_AUTO_TEST_SUITE( imap_client_parser )
       BOOST_CHECK_EQUAL(cb.list_mailbox, 1);
     }
 
+    BOOST_AUTO_TEST_CASE(list_status)
+    {
+      const char response[] =
+        "* LIST () \".\" INBOX.Sent\r\n"
+        "* STATUS INBOX.Sent (MESSAGES 231 UIDNEXT 44292 UIDVALIDITY 7)\r\n"
+        "* STATUS \"a b\" ()\r\n"
+        ;
+      const char *begin = response;
+      const char *end = begin + sizeof(response)-1;
+
+      struct CB : public IMAP::Client::Callback::Null {
+        Memory::Buffer::Vector buffer;
+        Memory::Buffer::Vector tag_buffer;
+        char delimiter {0};
+        vector<pair<IMAP::Status_Attribute, uint32_t> > atts;
+        vector<string> mailboxes;
+        void imap_list_delimiter(char c) override
+        {
+          delimiter = c;
+        }
+        void imap_status_att(IMAP::Status_Attribute a, uint32_t n) override
+        {
+          atts.emplace_back(a, n);
+        }
+        void imap_status_end() override
+        {
+          mailboxes.emplace_back(buffer.begin(), buffer.end());
+        }
+      };
+      CB cb;
+      IMAP::Client::Parser p(cb.buffer, cb.tag_buffer, cb);
+      p.read(begin, end);
+      BOOST_CHECK_EQUAL(cb.delimiter, '.');
+      BOOST_REQUIRE_EQUAL(cb.atts.size(), 3u);
+      BOOST_CHECK(cb.atts[0].first == IMAP::Status_Attribute::MESSAGES);
+      BOOST_CHECK_EQUAL(cb.atts[0].second, 231u);
+      BOOST_CHECK(cb.atts[1].first == IMAP::Status_Attribute::UIDNEXT);
+      BOOST_CHECK_EQUAL(cb.atts[1].second, 44292u);
+      BOOST_CHECK(cb.atts[2].first == IMAP::Status_Attribute::UIDVALIDITY);
+      BOOST_CHECK_EQUAL(cb.atts[2].second, 7u);
+      BOOST_REQUIRE_EQUAL(cb.mailboxes.size(), 2u);
+      BOOST_CHECK_EQUAL(cb.mailboxes[0], "INBOX.Sent");
+      BOOST_CHECK_EQUAL(cb.mailboxes[1], "a b");
+    }
+
   BOOST_AUTO_TEST_SUITE_END();
 
 BOOST_AUTO_TEST_SUITE_END();
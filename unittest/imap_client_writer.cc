@@ -22,11 +22,61 @@
 
 #include <imap/imap.h>
 #include <imap/client_writer.h>
+#include <imap/client_base.h>
+#include <imap/client_parser.h>
 
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <set>
 #include <sstream>
+#include <string>
+#include <vector>
 using namespace std;
 
+namespace {
+
+  // issues NOOPs via IMAP::Client::Base and feeds it the tagged
+  // responses, i.e. the tag number dispatch of the parser callbacks
+  class Pipelined_Client : public IMAP::Client::Base {
+    private:
+      IMAP::Client::Parser parser_;
+      unsigned             issued_ {0};
+    public:
+      // tag numbers of the written commands, in order
+      vector<unsigned> written;
+      // tag numbers of the called continuations, in order
+      vector<unsigned> done;
+
+      Pipelined_Client(
+          boost::log::sources::severity_logger<Log::Severity> &lg,
+          unsigned depth)
+        :
+          IMAP::Client::Base([this](vector<char> &v) {
+              written.push_back(stoul(string(v.begin() + 1,
+                      find(v.begin(), v.end(), ' '))));
+            }, lg),
+          parser_(buffer_, tag_buffer_, *this)
+      {
+        set_pipeline_depth(depth);
+      }
+      void noop()
+      {
+        unsigned n = issued_++;
+        async_noop([this, n]() { done.push_back(n); });
+      }
+      void respond(unsigned n)
+      {
+        ostringstream o;
+        o << 'A' << setw(3) << setfill('0') << n << " OK done\r\n";
+        string s(o.str());
+        parser_.read(s.data(), s.data() + s.size());
+      }
+  };
+
+}
+
 
 
 BOOST_AUTO_TEST_SUITE( imap_client_writer )
@@ -76,6 +126,21 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
           std::logic_error);
     }
 
+    BOOST_AUTO_TEST_CASE( active_non_exclusive )
+    {
+      IMAP::Client::Tag tag;
+      tag.set_exclusive(false);
+
+      string t, u;
+      tag.next(t, IMAP::Client::Command::NOOP);
+      tag.next(u, IMAP::Client::Command::NOOP);
+      BOOST_CHECK_EQUAL(t, "A000");
+      BOOST_CHECK_EQUAL(u, "A001");
+      tag.pop(u);
+      tag.pop(t);
+      BOOST_CHECK_THROW(tag.pop(t), std::logic_error);
+    }
+
     BOOST_AUTO_TEST_CASE( pop )
     {
       IMAP::Client::Tag tag;
@@ -106,6 +171,127 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
       BOOST_CHECK_THROW(tag.pop(t), std::logic_error);
 
     }
+    BOOST_AUTO_TEST_CASE( own )
+    {
+      IMAP::Client::Tag tag;
+      const char *tags[] = { "A000", "A1234", "a000", "A00", "A00x", "B000",
+        "A12345678901234567890" };
+      bool own[] = { true, true, false, false, false, false, false };
+      for (unsigned i = 0; i < sizeof(own)/sizeof(own[0]); ++i)
+        BOOST_CHECK_EQUAL(tag.own(tags[i], tags[i] + strlen(tags[i])), own[i]);
+    }
+    BOOST_AUTO_TEST_CASE( ring )
+    {
+      IMAP::Client::Tag tag;
+      tag.set_exclusive(false);
+      vector<unsigned> done;
+      string t;
+      // more active tags than initial slots
+      for (unsigned i = 0; i < 100; ++i) {
+        BOOST_CHECK_EQUAL(tag.next(t, IMAP::Client::Command::NOOP), i);
+        tag.set_continuation([&done, i]() { done.push_back(i); });
+      }
+      BOOST_CHECK_EQUAL(t, "A099");
+      tag.next(t, IMAP::Client::Command::NOOP);
+      BOOST_CHECK_EQUAL(t, "A100");
+      BOOST_CHECK(!tag.pop(100));
+      for (unsigned i = 0; i < 100; i += 2)
+        tag.pop(i)();
+      BOOST_CHECK(tag.active(1));
+      BOOST_CHECK(!tag.active(2));
+      for (unsigned i = 1; i < 100; i += 2)
+        tag.pop(i)();
+      BOOST_CHECK_EQUAL(done.size(), 100u);
+      BOOST_CHECK_EQUAL(done[1], 2u);
+      BOOST_CHECK_EQUAL(done[50], 1u);
+      BOOST_CHECK_THROW(tag.pop(3), std::logic_error);
+      tag.next(t, IMAP::Client::Command::NOOP);
+      BOOST_CHECK_EQUAL(t, "A101");
+      tag.pop(t);
+    }
+
+  BOOST_AUTO_TEST_SUITE_END()
+
+  BOOST_AUTO_TEST_SUITE( base )
+
+    // the tag numbers wrap around the initial 16 slots several times
+    // while the oldest commands are still active - and the newest
+    // command in flight is always completed first
+    BOOST_AUTO_TEST_CASE( wrap_out_of_order )
+    {
+      boost::log::sources::severity_logger<Log::Severity> lg;
+      const unsigned n = 40;
+      for (unsigned depth : { 4u, 32u }) {
+        Pipelined_Client c(lg, depth);
+        for (unsigned i = 0; i < n; ++i)
+          c.noop();
+        BOOST_CHECK_EQUAL(c.written.size(), depth);
+        set<unsigned> in_flight(c.written.begin(), c.written.end());
+        size_t seen = c.written.size();
+        vector<unsigned> order;
+        while (!in_flight.empty()) {
+          unsigned t = *in_flight.rbegin();
+          in_flight.erase(t);
+          order.push_back(t);
+          c.respond(t);
+          in_flight.insert(c.written.begin() + seen, c.written.end());
+          seen = c.written.size();
+          BOOST_CHECK(in_flight.size() <= depth);
+        }
+        BOOST_REQUIRE_EQUAL(c.written.size(), n);
+        // queued commands are written in the order they were issued
+        for (unsigned i = 0; i < n; ++i)
+          BOOST_CHECK_EQUAL(c.written[i], i);
+        BOOST_CHECK_EQUAL_COLLECTIONS(c.done.begin(), c.done.end(),
+            order.begin(), order.end());
+        BOOST_CHECK_EQUAL(order.front(), depth - 1);
+        BOOST_CHECK_EQUAL(order.back(), 0u);
+      }
+    }
+    // A024 hits the slot of the still active A008 when A021 .. A023
+    // are in flight, i.e. the ring grows with wrapped tags in it
+    BOOST_AUTO_TEST_CASE( grow_wrapped )
+    {
+      boost::log::sources::severity_logger<Log::Severity> lg;
+      Pipelined_Client c(lg, 4);
+      for (unsigned i = 0; i < 4; ++i)
+        c.noop();
+      for (unsigned i = 0; i < 21; ++i) {
+        if (i == 8)
+          continue;
+        c.respond(i);
+        c.noop();
+      }
+      BOOST_CHECK_EQUAL(c.written.size(), 24u);
+      c.noop();
+      BOOST_CHECK_EQUAL(c.written.size(), 24u);
+      vector<unsigned> order = { 23, 21, 8, 24, 22 };
+      for (unsigned t : order)
+        c.respond(t);
+      BOOST_CHECK_EQUAL(c.written.size(), 25u);
+      BOOST_REQUIRE_EQUAL(c.done.size(), 25u);
+      BOOST_CHECK_EQUAL_COLLECTIONS(c.done.end() - order.size(), c.done.end(),
+          order.begin(), order.end());
+    }
+    // without growing the ring: A016 occupies the slot of A000
+    BOOST_AUTO_TEST_CASE( wrap_stale_tag )
+    {
+      boost::log::sources::severity_logger<Log::Severity> lg;
+      Pipelined_Client c(lg, 2);
+      c.noop();
+      c.noop();
+      for (unsigned i = 0; i < 16; ++i) {
+        c.respond(i);
+        c.noop();
+      }
+      BOOST_CHECK_EQUAL(c.written.size(), 18u);
+      BOOST_CHECK_EQUAL(c.written.back(), 17u);
+      c.respond(17);
+      BOOST_CHECK_EQUAL(c.done.size(), 17u);
+      BOOST_CHECK_EQUAL(c.done.back(), 17u);
+      BOOST_CHECK_THROW(c.respond(0), std::runtime_error);
+      BOOST_CHECK_EQUAL(c.done.size(), 17u);
+    }
 
   BOOST_AUTO_TEST_SUITE_END()
 
@@ -239,6 +425,86 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
       }
     BOOST_AUTO_TEST_SUITE_END()
 
+    BOOST_AUTO_TEST_SUITE( verification )
+
+      BOOST_AUTO_TEST_CASE( never )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);},
+            Writer::Verification::NEVER);
+        string t;
+        // wrong state isn't detected
+        writer.expunge(t);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(), "A000 EXPUNGE\r\n");
+        BOOST_CHECK_EQUAL(writer.verified(), 0u);
+      }
+      BOOST_AUTO_TEST_CASE( always )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        // the NOOPs are pipelined
+        tag.set_exclusive(false);
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);},
+            Writer::Verification::ALWAYS);
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        for (unsigned i = 0; i < 4; ++i)
+          writer.noop(t);
+        BOOST_CHECK_EQUAL(writer.verified(), 6u);
+      }
+      BOOST_AUTO_TEST_CASE( sampled )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        tag.set_exclusive(false);
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);},
+            Writer::Verification::SAMPLED, 2);
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.examine("INBOX", t);
+        for (unsigned i = 0; i < 4; ++i)
+          writer.noop(t);
+        BOOST_CHECK_EQUAL(writer.verified(), 4u);
+        // the parser still knows the state
+        BOOST_CHECK_THROW(writer.expunge(t), std::runtime_error);
+      }
+      BOOST_AUTO_TEST_CASE( enable_late )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);},
+            Writer::Verification::NEVER);
+        string t;
+        writer.noop(t);
+        BOOST_CHECK_THROW(writer.set_verification(
+              Writer::Verification::ALWAYS), std::logic_error);
+        writer.set_verification(Writer::Verification::NEVER);
+      }
+      BOOST_AUTO_TEST_CASE( debug_only )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);},
+            Writer::Verification::DEBUG_ONLY);
+        string t;
+        writer.noop(t);
+#ifdef NDEBUG
+        BOOST_CHECK_EQUAL(writer.verified(), 0u);
+#else
+        BOOST_CHECK_EQUAL(writer.verified(), 1u);
+#endif
+      }
+
+    BOOST_AUTO_TEST_SUITE_END()
+
     BOOST_AUTO_TEST_SUITE( uid_expunge )
 
       BOOST_AUTO_TEST_CASE( single )
@@ -428,6 +694,105 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
         BOOST_CHECK_EQUAL(v.data(),"A002 FETCH 1 "
             "(UID BODY[HEADER.FIELDS (date from subject)] BODY[])\r\n");
       }
+      BOOST_AUTO_TEST_CASE( uid_range )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        vector<pair<uint32_t, uint32_t> > set;
+        set.emplace_back(501, 1000);
+        vector<Fetch_Attribute> atts;
+        atts.emplace_back(Fetch::UID);
+        atts.emplace_back(Fetch::BODY_PEEK);
+        writer.uid_fetch(set, atts, t);
+        BOOST_CHECK_EQUAL(t, "A002");
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),"A002 UID FETCH 501:1000 (UID BODY.PEEK[])\r\n");
+      }
+      BOOST_AUTO_TEST_CASE( compress )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.compress_deflate(t);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),"A001 COMPRESS DEFLATE\r\n");
+      }
+      BOOST_AUTO_TEST_CASE( idle )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        writer.idle(t);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(), "A002 IDLE\r\n");
+        writer.idle_done();
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(), "DONE\r\n");
+        writer.noop(t);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(), "A003 NOOP\r\n");
+      }
+      BOOST_AUTO_TEST_CASE( condstore )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t, true);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),"A001 SELECT INBOX (CONDSTORE)\r\n");
+        vector<pair<uint32_t, uint32_t> > set;
+        set.emplace_back(501, 1000);
+        vector<Fetch_Attribute> atts;
+        atts.emplace_back(Fetch::UID);
+        writer.uid_fetch(set, atts, t, 12345);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),
+            "A002 UID FETCH 501:1000 UID (CHANGEDSINCE 12345)\r\n");
+      }
+      BOOST_AUTO_TEST_CASE( partial )
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.select("INBOX", t);
+        vector<pair<uint32_t, uint32_t> > set;
+        set.emplace_back(42, 42);
+        vector<Fetch_Attribute> atts;
+        atts.emplace_back(Fetch::UID);
+        atts.emplace_back(Fetch::RFC822_SIZE);
+        writer.uid_fetch(set, atts, t);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(), "A002 UID FETCH 42 (UID RFC822.SIZE)\r\n");
+        tag.pop(t);
+        atts.clear();
+        atts.emplace_back(Fetch::UID);
+        atts.emplace_back(Fetch::BODY_PEEK, IMAP::Section_Attribute(),
+            8388608, 4194304);
+        writer.uid_fetch(set, atts, t);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(),
+            "A003 UID FETCH 42 (UID BODY.PEEK[]<8388608.4194304>)\r\n");
+        BOOST_CHECK_THROW(Fetch_Attribute(Fetch::BODY_PEEK,
+              IMAP::Section_Attribute(), 0, 0), std::logic_error);
+      }
       BOOST_AUTO_TEST_CASE( empty_atts )
       {
         vector<char> v;
@@ -551,6 +916,39 @@ BOOST_AUTO_TEST_SUITE( imap_client_writer )
         v.push_back('\0');
         BOOST_CHECK_EQUAL(v.data(), "A002 LIST {7}\r\n~/Mail/ {1}\r\n%\r\n");
       }
+      BOOST_AUTO_TEST_CASE(list_status)
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.list("", "*", { IMAP::Status_Attribute::MESSAGES,
+            IMAP::Status_Attribute::UIDNEXT }, t);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(), "A001 LIST {0}\r\n {1}\r\n* "
+            "RETURN (STATUS (MESSAGES UIDNEXT))\r\n");
+      }
+      BOOST_AUTO_TEST_CASE(status)
+      {
+        vector<char> v;
+        using namespace IMAP::Client;
+        Tag tag;
+        Writer writer(tag, [&v](vector<char> &x){ swap(v, x);});
+        string t;
+        writer.login("juser", "secretvery", t);
+        writer.status("INBOX", { IMAP::Status_Attribute::UIDVALIDITY }, t);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(), "A001 STATUS INBOX (UIDVALIDITY)\r\n");
+        tag.pop(t);
+        writer.status("Sent \"Items\"", { IMAP::Status_Attribute::MESSAGES,
+            IMAP::Status_Attribute::UIDNEXT,
+            IMAP::Status_Attribute::UIDVALIDITY }, t);
+        v.push_back('\0');
+        BOOST_CHECK_EQUAL(v.data(), "A002 STATUS \"Sent \\\"Items\\\"\" "
+            "(MESSAGES UIDNEXT UIDVALIDITY)\r\n");
+      }
 
     BOOST_AUTO_TEST_SUITE_END()
 
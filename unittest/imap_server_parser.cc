@@ -23,6 +23,9 @@
 #include <imap/server_parser.h>
 #include <imap/imap.h>
 
+#include <algorithm>
+#include <stdexcept>
+
 using namespace std;
 
 using namespace Memory;
@@ -257,6 +260,58 @@ BOOST_AUTO_TEST_SUITE( imap_server_parser )
       BOOST_CHECK_EQUAL(p.finished(), true);
     }
 
+    // the literal lengths are accumulated across read() calls -
+    // a wrong length would misplace the end of the literal
+    BOOST_AUTO_TEST_CASE( split_numbers )
+    {
+      const char inp[] =
+        "a1 login juser {10}\r\n"
+        "geheimvery\r\n"
+        "a3 select INBOX\r\n"
+        "A003 UID EXPUNGE 3000:4294967295\r\n"
+        "a8 logout\r\n"
+        ;
+      const char *begin = inp;
+      const char *end   = inp + sizeof(inp)-1;
+      using namespace IMAP::Server;
+      for (size_t chunk : { 1, 2, 3, 7 }) {
+        Buffer::Vector buffer;
+        Buffer::Vector tag_buffer;
+        Callback::Null cb;
+        Parser p(buffer, tag_buffer, cb);
+        for (const char *a = begin; a != end; ) {
+          const char *b = a + min(chunk, size_t(end - a));
+          p.read(a, b);
+          a = b;
+        }
+        BOOST_CHECK_EQUAL(p.finished(), true);
+      }
+    }
+
+    BOOST_AUTO_TEST_CASE( number_overflow )
+    {
+      const char inp[] =
+        "a1 login juser {4294967296}\r\n"
+        ;
+      const char *begin = inp;
+      const char *end   = inp + sizeof(inp)-1;
+      using namespace IMAP::Server;
+      for (size_t chunk : { 1, 4, 100 }) {
+        Buffer::Vector buffer;
+        Buffer::Vector tag_buffer;
+        Callback::Null cb;
+        Parser p(buffer, tag_buffer, cb);
+        auto feed = [&]() {
+          for (const char *a = begin; a != end; ) {
+            const char *b = a + min(chunk, size_t(end - a));
+            p.read(a, b);
+            a = b;
+          }
+        };
+        BOOST_CHECK_THROW(feed(), std::overflow_error);
+      }
+    }
+
   BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,95 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <log/ring.h>
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE( logging )
+
+  BOOST_AUTO_TEST_SUITE( ring )
+
+    BOOST_AUTO_TEST_CASE( fifo )
+    {
+      Log::Ring<string> r(4);
+      BOOST_CHECK_EQUAL(r.capacity(), 4u);
+      string s;
+      BOOST_CHECK(!r.try_pop(s));
+      // wraps around a few times
+      for (unsigned k = 0; k < 3; ++k) {
+        for (unsigned i = 0; i < 4; ++i)
+          BOOST_CHECK(r.try_push(to_string(i)));
+        BOOST_CHECK(!r.try_push("full"));
+        BOOST_CHECK_EQUAL(r.size(), 4u);
+        for (unsigned i = 0; i < 4; ++i) {
+          BOOST_CHECK(r.try_pop(s));
+          BOOST_CHECK_EQUAL(s, to_string(i));
+        }
+        BOOST_CHECK(!r.try_pop(s));
+        BOOST_CHECK_EQUAL(r.size(), 0u);
+      }
+    }
+
+    BOOST_AUTO_TEST_CASE( capacity )
+    {
+      BOOST_CHECK_THROW(Log::Ring<int> r(3), std::invalid_argument);
+      BOOST_CHECK_THROW(Log::Ring<int> r(1), std::invalid_argument);
+    }
+
+    BOOST_AUTO_TEST_CASE( producers )
+    {
+      const unsigned n = 100000;
+      const unsigned producers = 3;
+      Log::Ring<unsigned> r(64);
+      vector<thread> threads;
+      for (unsigned p = 0; p < producers; ++p)
+        threads.emplace_back([&r, p, n]() {
+            for (unsigned i = 0; i < n; ++i)
+              while (!r.try_push(p * n + i))
+                this_thread::yield();
+            });
+      // the values of each producer arrive in order
+      vector<unsigned> next(producers);
+      unsigned v = 0;
+      for (unsigned i = 0; i < producers * n; ) {
+        if (!r.try_pop(v)) {
+          this_thread::yield();
+          continue;
+        }
+        unsigned p = v / n;
+        BOOST_REQUIRE(p < producers);
+        BOOST_REQUIRE_EQUAL(v % n, next[p]);
+        ++next[p];
+        ++i;
+      }
+      for (auto &t : threads)
+        t.join();
+      BOOST_CHECK(!r.try_pop(v));
+    }
+
+  BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -87,6 +87,85 @@ BOOST_AUTO_TEST_SUITE( maildir )
       BOOST_CHECK_EQUAL(sub_count, count[i]);
     }
   }
+  BOOST_AUTO_TEST_CASE( batch )
+  {
+    const char path[] = "tmp/mdirbatch";
+    fs::create_directory("tmp");
+    fs::remove_all(path);
+    Maildir m(path);
+    m.set_batch_size(8);
+    for (unsigned i = 0; i<3; ++i) {
+      string f(m.create_tmp_name());
+      touch(f);
+      m.move_to_new();
+    }
+    string f(m.create_tmp_name());
+    touch(f);
+    m.move_to_cur("S");
+    BOOST_CHECK_EQUAL(m.uncommitted(), 4);
+    string p(path);
+    // not linked before the tmp files are synced by the commit
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/new"),
+          fs::directory_iterator()), 0);
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/cur"),
+          fs::directory_iterator()), 0);
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/tmp"),
+          fs::directory_iterator()), 4);
+    m.commit();
+    BOOST_CHECK_EQUAL(m.uncommitted(), 0);
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/new"),
+          fs::directory_iterator()), 3);
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/cur"),
+          fs::directory_iterator()), 1);
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/tmp"),
+          fs::directory_iterator()), 0);
+  }
+  BOOST_AUTO_TEST_CASE( folder )
+  {
+    const char path[] = "tmp/mdirfolder";
+    fs::create_directory("tmp");
+    fs::remove_all(path);
+    Maildir m(path);
+    m.select_folder("foo.bar");
+    string f(m.create_tmp_name());
+    touch(f);
+    m.move_to_new();
+    string p(path);
+    BOOST_CHECK_EQUAL(fs::exists(p + "/.foo.bar/maildirfolder"), true);
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/.foo.bar/new"),
+          fs::directory_iterator()), 1);
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/new"),
+          fs::directory_iterator()), 0);
+    m.select_folder("");
+    f = m.create_tmp_name();
+    touch(f);
+    m.move_to_cur("S");
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/cur"),
+          fs::directory_iterator()), 1);
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/tmp"),
+          fs::directory_iterator()), 0);
+  }
+  BOOST_AUTO_TEST_CASE( resume )
+  {
+    const char path[] = "tmp/mdirresume";
+    fs::create_directory("tmp");
+    fs::remove_all(path);
+    string name;
+    {
+      Maildir m(path);
+      m.create_tmp_name(name);
+      touch(m.tmp_path(name));
+      // interrupted ...
+    }
+    Maildir m(path);
+    BOOST_CHECK_EQUAL(fs::exists(m.tmp_path(name)), true);
+    m.resume_tmp_name(name);
+    m.move_to_new();
+    string p(path);
+    BOOST_CHECK_EQUAL(fs::exists(p + "/new/" + name), true);
+    BOOST_CHECK_EQUAL(distance(fs::directory_iterator(p + "/tmp"),
+          fs::directory_iterator()), 0);
+  }
   BOOST_AUTO_TEST_CASE( except )
   {
     const char path[] = "tmp/mdirexcept";
@@ -0,0 +1,151 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <metrics/metrics.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+using namespace std;
+namespace fs = boost::filesystem;
+
+BOOST_AUTO_TEST_SUITE( metrics )
+
+  BOOST_AUTO_TEST_SUITE( histogram )
+
+    BOOST_AUTO_TEST_CASE( buckets )
+    {
+      Metrics::Histogram h;
+      BOOST_CHECK_EQUAL(h.count(), 0u);
+      BOOST_CHECK_EQUAL(h.quantile(0.5), 0u);
+      h.add(0);
+      h.add(1);
+      h.add(2);
+      h.add(3);
+      h.add(4);
+      h.add(UINT64_MAX);
+      BOOST_CHECK_EQUAL(h.buckets()[0], 1u);
+      BOOST_CHECK_EQUAL(h.buckets()[1], 1u);
+      BOOST_CHECK_EQUAL(h.buckets()[2], 2u);
+      BOOST_CHECK_EQUAL(h.buckets()[3], 1u);
+      BOOST_CHECK_EQUAL(h.buckets()[64], 1u);
+      BOOST_CHECK_EQUAL(h.count(), 6u);
+      BOOST_CHECK_EQUAL(h.min(), 0u);
+      BOOST_CHECK_EQUAL(h.max(), UINT64_MAX);
+      BOOST_CHECK_EQUAL(Metrics::Histogram::upper(0), 1u);
+      BOOST_CHECK_EQUAL(Metrics::Histogram::upper(3), 8u);
+      BOOST_CHECK_EQUAL(Metrics::Histogram::upper(64), UINT64_MAX);
+    }
+
+    BOOST_AUTO_TEST_CASE( quantile )
+    {
+      Metrics::Histogram h;
+      for (unsigned i = 1; i <= 100; ++i)
+        h.add(i);
+      BOOST_CHECK_EQUAL(h.sum(), 5050u);
+      // 50 lies in [32, 64)
+      BOOST_CHECK_EQUAL(h.quantile(0.5), 64u);
+      // capped by the maximum
+      BOOST_CHECK_EQUAL(h.quantile(0.99), 100u);
+      BOOST_CHECK_EQUAL(h.quantile(0), 2u);
+    }
+
+    BOOST_AUTO_TEST_CASE( merge )
+    {
+      Metrics::Histogram a, b;
+      a.add(10);
+      a.add(20);
+      b.merge(a);
+      BOOST_CHECK_EQUAL(b.min(), 10u);
+      b.add(5);
+      b.add(1000);
+      a.merge(b);
+      BOOST_CHECK_EQUAL(a.count(), 6u);
+      BOOST_CHECK_EQUAL(a.sum(), 1065u);
+      BOOST_CHECK_EQUAL(a.min(), 5u);
+      BOOST_CHECK_EQUAL(a.max(), 1000u);
+      Metrics::Histogram empty;
+      a.merge(empty);
+      BOOST_CHECK_EQUAL(a.min(), 5u);
+    }
+
+  BOOST_AUTO_TEST_SUITE_END()
+
+  BOOST_AUTO_TEST_CASE( registry )
+  {
+    Metrics::Registry a, b;
+    a.phase(Metrics::Phase::LOGIN).add(100);
+    a.messages = 2;
+    a.bytes_read = 1000;
+    b.phase(Metrics::Phase::LOGIN).add(300);
+    b.fsync.add(7);
+    b.messages = 3;
+    b.bytes_read = 500;
+    a.merge(b);
+    BOOST_CHECK_EQUAL(a.phase(Metrics::Phase::LOGIN).count(), 2u);
+    BOOST_CHECK_EQUAL(a.phase(Metrics::Phase::LOGIN).sum(), 400u);
+    BOOST_CHECK_EQUAL(a.phase(Metrics::Phase::FETCH).count(), 0u);
+    BOOST_CHECK_EQUAL(a.fsync.count(), 1u);
+    BOOST_CHECK_EQUAL(a.messages, 5u);
+    BOOST_CHECK_EQUAL(a.bytes_read, 1500u);
+  }
+
+  BOOST_AUTO_TEST_CASE( json )
+  {
+    Metrics::Histogram h;
+    h.add(3);
+    h.add(3);
+    h.add(9);
+    ostringstream o;
+    Metrics::write_json(o, h);
+    BOOST_CHECK_EQUAL(o.str(), "{\"count\": 3, \"sum\": 15, \"min\": 3, "
+        "\"max\": 9, \"p50\": 4, \"p90\": 9, \"p99\": 9, "
+        "\"buckets\": [[4, 2], [16, 1]]}");
+  }
+
+  BOOST_AUTO_TEST_CASE( exporter )
+  {
+    fs::create_directory("tmp");
+    string filename("tmp/ut_metrics.json");
+    Metrics::Exporter e(filename);
+    Metrics::Registry r;
+    r.phase(Metrics::Phase::CONNECT).add(42);
+    r.messages = 1;
+    e.update("foo", r);
+    r.messages = 2;
+    e.update("b\"ar", r);
+    e.update("foo", r);
+    e.write();
+    BOOST_CHECK(!fs::exists(filename + ".tmp"));
+    ifstream f(filename);
+    string s((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+    BOOST_CHECK(s.find("\"total\": {\"messages\": 4,") != string::npos);
+    BOOST_CHECK(s.find("\"foo\": {\"messages\": 2,") != string::npos);
+    BOOST_CHECK(s.find("\"b\\\"ar\": {\"messages\": 2,") != string::npos);
+    BOOST_CHECK(s.find("\"connect\": {\"count\": 1, \"sum\": 42,")
+        != string::npos);
+    BOOST_CHECK(s.find("\"expunge\": {\"count\": 0,") != string::npos);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
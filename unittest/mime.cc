@@ -24,12 +24,28 @@
 #include <mime/base64_decoder.h>
 #include <mime/q_decoder.h>
 #include <mime/header_decoder.h>
+#include <mime/charset.h>
+#include <mime/decode_kernel.h>
 
+#include <cstring>
+#include <functional>
+#include <random>
 #include <string>
 #include <vector>
 using namespace std;
 using namespace Memory;
 
+// the message of the lex error f throws
+static string error_message(const function<void()> &f)
+{
+  try {
+    f();
+  } catch (const runtime_error &e) {
+    return e.what();
+  }
+  return string();
+}
+
 BOOST_AUTO_TEST_SUITE(mime)
 
   BOOST_AUTO_TEST_SUITE(base64)
@@ -142,6 +158,152 @@ BOOST_AUTO_TEST_SUITE(mime)
         BOOST_CHECK_THROW(d.read(inp, inp + sizeof(inp) - 1), std::runtime_error);
       }
 
+      static string encode(const string &s)
+      {
+        static const char alphabet[] =
+          "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        string r;
+        for (size_t i = 0; i < s.size(); i += 3) {
+          uint32_t x = uint32_t(uint8_t(s[i])) << 16;
+          if (i + 1 < s.size()) x |= uint32_t(uint8_t(s[i+1])) << 8;
+          if (i + 2 < s.size()) x |= uint8_t(s[i+2]);
+          r += alphabet[x >> 18];
+          r += alphabet[(x >> 12) & 63];
+          r += i + 1 < s.size() ? alphabet[(x >> 6) & 63] : '=';
+          r += i + 2 < s.size() ? alphabet[x & 63] : '=';
+        }
+        return r;
+      }
+
+      // the bulk decoding must not depend on where the input is split
+      BOOST_AUTO_TEST_CASE(chunked)
+      {
+        using namespace MIME::Base64;
+        using MIME::Kernel::Isa;
+        mt19937 g(42);
+        string plain;
+        for (unsigned i = 0; i < 3001; ++i)
+          plain += char(g());
+        string inp(encode(plain));
+        for (auto isa : { Isa::SCALAR, Isa::SSE4_1, Isa::AVX2 }) {
+          if (isa > MIME::Kernel::best())
+            continue;
+          MIME::Kernel::select(isa);
+          for (size_t chunk : { 1, 3, 5, 31, 33, 64, 5000 }) {
+            Buffer::Vector v;
+            Decoder d(v);
+            for (size_t i = 0; i < inp.size(); i += chunk) {
+              size_t n = min(chunk, inp.size() - i);
+              d.read(inp.data() + i, inp.data() + i + n);
+            }
+            BOOST_CHECK(d.in_final());
+            BOOST_CHECK(string(v.begin(), v.end()) == plain);
+          }
+        }
+        MIME::Kernel::select(MIME::Kernel::best());
+      }
+
+      // the kernel is called for at most 4 KiB - groups split there or
+      // by read() continue in the state after a complete group
+      BOOST_AUTO_TEST_CASE(kernel_boundary)
+      {
+        using namespace MIME::Base64;
+        mt19937 g(23);
+        for (size_t rest : { 0, 1, 2 }) {
+          string plain;
+          for (unsigned i = 0; i < 2 * 3 * 1024 + rest; ++i)
+            plain += char(g());
+          string inp(encode(plain));
+          for (size_t split : { size_t(0), size_t(1), size_t(3), size_t(4094),
+                size_t(4095), size_t(4096), size_t(4097), size_t(4099),
+                size_t(8191), inp.size() - 2, inp.size() - 1 }) {
+            Buffer::Vector v;
+            Decoder d(v);
+            d.read(inp.data(), inp.data() + split);
+            d.read(inp.data() + split, inp.data() + inp.size());
+            BOOST_CHECK(string(v.begin(), v.end()) == plain);
+            BOOST_CHECK_EQUAL(d.in_final(), rest != 0);
+          }
+        }
+      }
+
+      BOOST_AUTO_TEST_CASE(padding)
+      {
+        using namespace MIME::Base64;
+        const char *inps[] = { "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy" };
+        const char *outs[] = { "foob", "fooba", "foobar" };
+        for (unsigned i = 0; i < 3; ++i) {
+          string inp(inps[i]);
+          for (size_t split = 0; split <= inp.size(); ++split) {
+            Buffer::Vector v;
+            Decoder d(v);
+            d.read(inp.data(), inp.data() + split);
+            d.read(inp.data() + split, inp.data() + inp.size());
+            BOOST_CHECK_EQUAL(string(v.begin(), v.end()), outs[i]);
+            BOOST_CHECK_EQUAL(d.in_final(), i < 2);
+          }
+        }
+        // nothing may follow the padding, and it only ends a group
+        for (const char *inp : { "Zm9vYg==Zm9v", "Zm9vYg=A", "Zm9vY===",
+              "Zm9v=" }) {
+          Buffer::Vector v;
+          Decoder d(v);
+          BOOST_CHECK_THROW(d.read(inp, inp + strlen(inp)), std::runtime_error);
+        }
+      }
+
+      // the sentinel ends the word after a kernel run, a partial group
+      // and padding - also when it starts a new read()
+      BOOST_AUTO_TEST_CASE(sentinel)
+      {
+        using namespace MIME::Base64;
+        string plain(3 * 1024, 'x');
+        for (size_t rest : { 0, 1, 2 }) {
+          string p(plain + string(rest, 'y'));
+          string inp(encode(p));
+          string s(inp + "?= =?utf-8?B?eHh4?=");
+          {
+            Buffer::Vector v;
+            Decoder d(v, "?=");
+            d.read(s.data(), s.data() + s.size());
+            BOOST_CHECK(string(v.begin(), v.end()) == p);
+            BOOST_CHECK(d.next() == s.data() + inp.size());
+            BOOST_CHECK(d.in_start());
+          }
+          {
+            Buffer::Vector v;
+            Decoder d(v, "?=");
+            d.read(s.data(), s.data() + inp.size());
+            d.read(s.data() + inp.size(), s.data() + s.size());
+            BOOST_CHECK(string(v.begin(), v.end()) == p);
+            BOOST_CHECK(d.next() == s.data() + inp.size());
+          }
+        }
+      }
+
+      // the error is reported at the first invalid character, after the
+      // complete groups before it are decoded
+      BOOST_AUTO_TEST_CASE(error_position)
+      {
+        using namespace MIME::Base64;
+        mt19937 g(5);
+        string plain;
+        for (unsigned i = 0; i < 2 * 3 * 1024; ++i)
+          plain += char(g());
+        string inp(encode(plain));
+        for (size_t k : { 0, 1, 3, 4, 4094, 4095, 4096, 4097, 8191 }) {
+          string s(inp);
+          s[k] = '_';
+          Buffer::Vector v;
+          Decoder d(v);
+          string msg(error_message([&]() { d.read(s.data(), s.data() + s.size()); }));
+          BOOST_CHECK_MESSAGE(msg.find("|" + s.substr(k, 20) + "|")
+              != string::npos, k << ": " << msg);
+          BOOST_CHECK_EQUAL(v.size(), k / 4 * 3);
+          BOOST_CHECK(string(v.begin(), v.end()) == plain.substr(0, k / 4 * 3));
+        }
+      }
+
     BOOST_AUTO_TEST_SUITE_END()
 
   BOOST_AUTO_TEST_SUITE_END()
@@ -220,6 +382,111 @@ BOOST_AUTO_TEST_SUITE(mime)
         BOOST_CHECK_THROW(d.read(inp, inp + sizeof(inp) - 1), std::runtime_error);
       }
 
+      BOOST_AUTO_TEST_CASE(chunked)
+      {
+        using namespace MIME::Q;
+        using MIME::Kernel::Isa;
+        string inp, expected;
+        for (unsigned i = 0; i < 200; ++i) {
+          inp += "Reiseabbruchschutz=3a_M=FCnchen_";
+          expected += "Reiseabbruchschutz: M\xfcnchen ";
+        }
+        for (auto isa : { Isa::SCALAR, Isa::SSE4_1, Isa::AVX2 }) {
+          if (isa > MIME::Kernel::best())
+            continue;
+          MIME::Kernel::select(isa);
+          for (size_t chunk : { 1, 2, 3, 17, 33, 64, 10000 }) {
+            Buffer::Vector v;
+            Decoder d(v);
+            for (size_t i = 0; i < inp.size(); i += chunk) {
+              size_t n = min(chunk, inp.size() - i);
+              d.read(inp.data() + i, inp.data() + i + n);
+            }
+            BOOST_CHECK_EQUAL(string(v.begin(), v.end()), expected);
+          }
+        }
+        MIME::Kernel::select(MIME::Kernel::best());
+      }
+
+      // a read() that ends after the first character of a word - or
+      // inside a run - leaves the machine inside the word
+      BOOST_AUTO_TEST_CASE(word_split)
+      {
+        using namespace MIME::Q;
+        string word;
+        for (unsigned i = 0; i < 5000; ++i)
+          word += char('a' + i % 26);
+        string inp("=3A" + word + "_" + word + "=3a");
+        string expected(":" + word + " " + word + ":");
+        for (size_t split : { 0, 3, 4, 5, 4096, 5003, 5004, 5005, 5006,
+              10004 }) {
+          Buffer::Vector v;
+          Decoder d(v);
+          d.read(inp.data(), inp.data() + split);
+          d.read(inp.data() + split, inp.data() + inp.size());
+          BOOST_CHECK(string(v.begin(), v.end()) == expected);
+          BOOST_CHECK(d.finished());
+        }
+      }
+
+      // the sentinel ends the word after a run, a quoted character and
+      // an underscore - also when it starts a new read()
+      BOOST_AUTO_TEST_CASE(sentinel)
+      {
+        using namespace MIME::Q;
+        string word(5000, 'x');
+        for (const char *end : { "", "=3F", "_" }) {
+          string inp(word + end);
+          string expected(word + (*end ? (end[1] ? "?" : " ") : ""));
+          string s(inp + "?= =?utf-8?Q?x?=");
+          {
+            Buffer::Vector v;
+            Decoder d(v, "?=");
+            d.read(s.data(), s.data() + s.size());
+            BOOST_CHECK(string(v.begin(), v.end()) == expected);
+            BOOST_CHECK(d.next() == s.data() + inp.size());
+            BOOST_CHECK(d.in_start());
+          }
+          {
+            Buffer::Vector v;
+            Decoder d(v, "?=");
+            d.read(s.data(), s.data() + inp.size());
+            d.read(s.data() + inp.size(), s.data() + s.size());
+            BOOST_CHECK(string(v.begin(), v.end()) == expected);
+            BOOST_CHECK(d.next() == s.data() + inp.size());
+          }
+        }
+      }
+
+      // a run is only copied up to the invalid character
+      BOOST_AUTO_TEST_CASE(error_position)
+      {
+        using namespace MIME::Q;
+        string word;
+        for (unsigned i = 0; i < 5000; ++i)
+          word += char('a' + i % 26);
+        for (size_t k : { 0, 1, 2, 4095, 4096, 4998 }) {
+          // an invalid character and an invalid quoted one
+          for (unsigned quoted = 0; quoted < 2; ++quoted) {
+            string s(word);
+            if (quoted) {
+              s[k] = '=';
+              s[k + 1] = 'G';
+            } else {
+              s[k] = '?';
+            }
+            size_t e = k + quoted;
+            Buffer::Vector v;
+            Decoder d(v);
+            string msg(error_message([&]() { d.read(s.data(), s.data() + s.size()); }));
+            BOOST_CHECK_MESSAGE(msg.find("|" + s.substr(e, 20) + "|")
+                != string::npos, e << ": " << msg);
+            BOOST_CHECK_MESSAGE(msg.find(" - " + to_string(min(e, size_t(20)))
+                  + " bytes before") != string::npos || !e, e << ": " << msg);
+          }
+        }
+      }
+
     BOOST_AUTO_TEST_SUITE_END()
 
   BOOST_AUTO_TEST_SUITE_END()
@@ -730,4 +997,114 @@ BOOST_AUTO_TEST_SUITE(mime)
 
   BOOST_AUTO_TEST_SUITE_END()
 
+  BOOST_AUTO_TEST_SUITE(kernel)
+
+    // all implementations the CPU supports yield the scalar results
+    BOOST_AUTO_TEST_CASE(isa)
+    {
+      using namespace MIME::Kernel;
+      static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+      mt19937 g(23);
+      for (unsigned k = 0; k < 2000; ++k) {
+        string s;
+        size_t n = g() % 300;
+        for (size_t i = 0; i < n; ++i)
+          s += alphabet[g() % 64];
+        // an invalid character somewhere (also a quoted one for Q)
+        if (k % 2 && n)
+          s[g() % n] = char(g());
+        vector<size_t> consumed, span;
+        vector<string> out;
+        for (auto isa : { Isa::SCALAR, Isa::SSE4_1, Isa::AVX2 }) {
+          if (isa > best())
+            continue;
+          select(isa);
+          vector<char> o(n / 4 * 3 + BASE64_SLACK);
+          size_t c = base64_decode(s.data(), s.data() + s.size(), o.data());
+          BOOST_REQUIRE_EQUAL(c % 4, 0u);
+          consumed.push_back(c);
+          out.push_back(string(o.data(), c / 4 * 3));
+          span.push_back(q_span(s.data(), s.data() + s.size()));
+        }
+        for (size_t i = 1; i < out.size(); ++i) {
+          BOOST_CHECK_EQUAL(consumed[i], consumed[0]);
+          BOOST_CHECK(out[i] == out[0]);
+          BOOST_CHECK_EQUAL(span[i], span[0]);
+        }
+      }
+      select(best());
+    }
+
+    BOOST_AUTO_TEST_CASE(base64)
+    {
+      using namespace MIME::Kernel;
+      string s("aGVsbG8gd29ybGQKaGVsbG8gd29ybGQKaGVsbG8gd29ybGQK"
+          "aGVsbG8gd29ybGQK?=");
+      vector<char> o(s.size() + BASE64_SLACK);
+      size_t n = base64_decode(s.data(), s.data() + s.size(), o.data());
+      BOOST_CHECK_EQUAL(n, s.size() - 2);
+      BOOST_CHECK_EQUAL(string(o.data(), n / 4 * 3),
+          "hello world\nhello world\nhello world\nhello world\n");
+    }
+
+    BOOST_AUTO_TEST_CASE(q)
+    {
+      using namespace MIME::Kernel;
+      string s("Reiseabbruchschutz-fuer-Reisende-mit-Reiseruecktritt=3a");
+      BOOST_CHECK_EQUAL(q_span(s.data(), s.data() + s.size()), s.size() - 3);
+      string t("abc_def");
+      BOOST_CHECK_EQUAL(q_span(t.data(), t.data() + t.size()), 3u);
+    }
+
+  BOOST_AUTO_TEST_SUITE_END()
+
+  BOOST_AUTO_TEST_SUITE(charset)
+
+    static string to_utf8(const string &charset, const string &inp)
+    {
+      // the result is appended
+      string r("x");
+      MIME::Charset::to_utf8(make_pair(charset.data(),
+            charset.data() + charset.size()),
+          inp.data(), inp.data() + inp.size(), r);
+      return r.substr(1);
+    }
+
+    BOOST_AUTO_TEST_CASE(fast_paths)
+    {
+      BOOST_CHECK_EQUAL(to_utf8("UTF-8", "Gr\xc3\xbc\xc3\x9f" "e"), "Grüße");
+      BOOST_CHECK_EQUAL(to_utf8("us-ascii", "Hello"), "Hello");
+      BOOST_CHECK_EQUAL(to_utf8("ISO-8859-1", "Gr\xfc\xdf" "e"), "Grüße");
+      BOOST_CHECK_EQUAL(to_utf8("latin1", "\xfc"), "ü");
+      BOOST_CHECK_EQUAL(to_utf8("utf-8", ""), "");
+    }
+    BOOST_AUTO_TEST_CASE(invalid)
+    {
+      // invalid sequences are skipped
+      BOOST_CHECK_EQUAL(to_utf8("utf8", "a\xff" "b\xc3"), "ab");
+      BOOST_CHECK_EQUAL(to_utf8("US-ASCII", "a\xe4" "b"), "ab");
+      BOOST_CHECK_THROW(to_utf8("no-such-charset", "a"), std::runtime_error);
+      // also when cached
+      BOOST_CHECK_THROW(to_utf8("no-such-charset", "a"), std::runtime_error);
+    }
+    BOOST_AUTO_TEST_CASE(cached)
+    {
+      for (unsigned i = 0; i < 3; ++i) {
+        BOOST_CHECK_EQUAL(to_utf8("ISO-8859-15", "\xa4"), "€");
+        BOOST_CHECK_EQUAL(to_utf8("iso_8859-15", "\xa4"), "€");
+        BOOST_CHECK_EQUAL(to_utf8("KOI8-R", "\xf0\xd2\xc9\xd7\xc5\xd4"),
+            "Привет");
+      }
+    }
+    BOOST_AUTO_TEST_CASE(normalize)
+    {
+      string s("ISO_8859-1");
+      string r;
+      MIME::Charset::normalize(make_pair(s.data(), s.data() + s.size()), r);
+      BOOST_CHECK_EQUAL(r, "iso88591");
+    }
+
+  BOOST_AUTO_TEST_SUITE_END()
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -72,5 +72,79 @@ BOOST_AUTO_TEST_SUITE( sequence_set )
     BOOST_CHECK_EQUAL(v[0].second, 14);
   }
 
+  static string str(const Sequence_Set &set)
+  {
+    ostringstream o;
+    o << set;
+    return o.str();
+  }
+
+  BOOST_AUTO_TEST_CASE( unordered )
+  {
+    Sequence_Set set;
+    for (uint32_t i : { 20, 10, 12, 11, 30, 9, 21, 25, 1, 24, 23, 22 })
+      set.push(i);
+    BOOST_CHECK_EQUAL(str(set), "1,9:12,20:25,30");
+    BOOST_CHECK_EQUAL(set.count(), 12u);
+    set.push(13, 19);
+    BOOST_CHECK_EQUAL(str(set), "1,9:25,30");
+    set.push(2, 40);
+    BOOST_CHECK_EQUAL(str(set), "1:40");
+    set.push(41);
+    BOOST_CHECK_EQUAL(set.size(), 1u);
+    BOOST_CHECK(set.contains(1));
+    BOOST_CHECK(set.contains(41));
+    BOOST_CHECK(!set.contains(42));
+    BOOST_CHECK(!set.contains(0));
+  }
+
+  BOOST_AUTO_TEST_CASE( limits )
+  {
+    Sequence_Set set;
+    set.push(4294967294u);
+    set.push(4294967295u);
+    set.push(1);
+    BOOST_CHECK_EQUAL(str(set), "1,4294967294:4294967295");
+    set.push(4294967295u);
+    BOOST_CHECK_EQUAL(set.count(), 3u);
+  }
+
+  BOOST_AUTO_TEST_CASE( algebra )
+  {
+    Sequence_Set a;
+    a.push(1, 10);
+    a.push(20, 30);
+    a.push(40);
+    Sequence_Set b;
+    b.push(5, 25);
+    b.push(30, 40);
+
+    Sequence_Set u;
+    u |= a;
+    BOOST_CHECK_EQUAL(str(u), "1:10,20:30,40");
+    u |= b;
+    BOOST_CHECK_EQUAL(str(u), "1:40");
+
+    Sequence_Set d;
+    d |= a;
+    d -= b;
+    BOOST_CHECK_EQUAL(str(d), "1:4,26:29");
+    Sequence_Set e;
+    e |= b;
+    e -= a;
+    BOOST_CHECK_EQUAL(str(e), "11:19,31:39");
+
+    Sequence_Set i;
+    i |= a;
+    i &= b;
+    BOOST_CHECK_EQUAL(str(i), "5:10,20:25,30,40");
+
+    Sequence_Set empty;
+    i -= empty;
+    BOOST_CHECK_EQUAL(str(i), "5:10,20:25,30,40");
+    i &= empty;
+    BOOST_CHECK(i.empty());
+  }
+
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,314 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+#include <net/ssl_session.h>
+#include <net/tcp_client.h>
+#include <net/ssl_util.h>
+
+#include <ixxx/ixxx.h>
+using namespace ixxx;
+
+#include <boost/asio/ssl.hpp>
+
+#include <openssl/ssl.h>
+
+#include <array>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+using namespace std;
+
+static string ut_prefix()
+{
+  string prefix("../unittest");
+  try {
+    prefix = ansi::getenv("UT_PREFIX");
+  } catch (const ixxx::runtime_error &) {
+  }
+  return prefix;
+}
+
+static const char fingerprint[] = "ED77CA3CE8B917C3F081FEC35C316E17E7879D35";
+
+namespace {
+
+  struct SSL_CTX_Free { void operator()(SSL_CTX *c) const { SSL_CTX_free(c); } };
+  struct SSL_Free     { void operator()(::SSL *s) const   { SSL_free(s);     } };
+  using Context = unique_ptr<SSL_CTX, SSL_CTX_Free>;
+  using Connection = unique_ptr<::SSL, SSL_Free>;
+
+  Context server_context()
+  {
+    string prefix(ut_prefix() + '/');
+    Context c(SSL_CTX_new(TLS_server_method()));
+    BOOST_REQUIRE(c);
+    BOOST_REQUIRE_EQUAL(SSL_CTX_use_certificate_chain_file(c.get(),
+          (prefix + "server.crt").c_str()), 1);
+    BOOST_REQUIRE_EQUAL(SSL_CTX_use_PrivateKey_file(c.get(),
+          (prefix + "server.key").c_str(), SSL_FILETYPE_PEM), 1);
+    return c;
+  }
+
+  // the server side of a handshake in memory, true if it succeeded
+  bool handshake(SSL_CTX *server_context, ::SSL *client)
+  {
+    Connection server(SSL_new(server_context));
+    BIO *c = nullptr, *s = nullptr;
+    BIO_new_bio_pair(&c, 0, &s, 0);
+    SSL_set_bio(client, c, c);
+    SSL_set_bio(server.get(), s, s);
+    SSL_set_connect_state(client);
+    SSL_set_accept_state(server.get());
+    bool client_done = false, server_done = false;
+    for (unsigned i = 0; i < 100 && !(client_done && server_done); ++i) {
+      if (!client_done)
+        client_done = SSL_do_handshake(client) == 1;
+      if (!server_done)
+        server_done = SSL_do_handshake(server.get()) == 1;
+    }
+    // TLSv1.3 session tickets are only received after the handshake
+    char x = 'x';
+    SSL_write(server.get(), &x, 1);
+    SSL_read(client, &x, 1);
+    return client_done && server_done;
+  }
+
+  string read_file(const string &filename)
+  {
+    ifstream f(filename, ifstream::binary);
+    return string((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+  }
+
+  struct Fixture {
+    boost::log::sources::severity_logger<Log::Severity> lg;
+    string dir {"tmp/ssl_session"};
+    string filename {dir + "/cache"};
+    Context server {server_context()};
+    Context client {SSL_CTX_new(TLS_client_method())};
+
+    Fixture()
+    {
+      fs::remove_all(dir);
+      fs::create_directories(dir);
+    }
+  };
+
+}
+
+BOOST_AUTO_TEST_SUITE( ssl_session )
+
+  BOOST_FIXTURE_TEST_CASE( store_load, Fixture )
+  {
+    Net::SSL::Session_Cache cache(lg, filename, "localhost", "993",
+        fingerprint);
+    {
+      Connection c(SSL_new(client.get()));
+      BOOST_CHECK(!cache.load(c.get()));
+      BOOST_REQUIRE(handshake(server.get(), c.get()));
+      BOOST_CHECK(!SSL_session_reused(c.get()));
+      cache.store(c.get());
+    }
+    BOOST_REQUIRE(fs::exists(filename));
+    BOOST_CHECK(!fs::exists(filename + ".tmp"));
+    BOOST_CHECK_EQUAL(fs::status(filename).permissions(),
+        fs::owner_read | fs::owner_write);
+
+    ifstream f(filename);
+    string magic, key, hex;
+    getline(f, magic);
+    getline(f, key);
+    getline(f, hex);
+    BOOST_CHECK_EQUAL(magic, "imapdl-tls-session 1");
+    BOOST_CHECK_EQUAL(key, string("localhost 993 ") + fingerprint);
+    BOOST_CHECK(!hex.empty());
+    BOOST_CHECK_EQUAL(hex.find_first_not_of("0123456789ABCDEF"), string::npos);
+
+    {
+      Connection c(SSL_new(client.get()));
+      BOOST_CHECK(cache.load(c.get()));
+      BOOST_REQUIRE(handshake(server.get(), c.get()));
+      BOOST_CHECK(SSL_session_reused(c.get()));
+    }
+  }
+
+  BOOST_FIXTURE_TEST_CASE( key_mismatch, Fixture )
+  {
+    {
+      Net::SSL::Session_Cache cache(lg, filename, "localhost", "993",
+          fingerprint);
+      Connection c(SSL_new(client.get()));
+      BOOST_REQUIRE(handshake(server.get(), c.get()));
+      cache.store(c.get());
+    }
+    BOOST_REQUIRE(fs::exists(filename));
+    string before(read_file(filename));
+    {
+      Net::SSL::Session_Cache cache(lg, filename, "example.org", "993",
+          fingerprint);
+      Connection c(SSL_new(client.get()));
+      BOOST_CHECK(!cache.load(c.get()));
+    }
+    {
+      Net::SSL::Session_Cache cache(lg, filename, "localhost", "6666",
+          fingerprint);
+      Connection c(SSL_new(client.get()));
+      BOOST_CHECK(!cache.load(c.get()));
+    }
+    {
+      Net::SSL::Session_Cache cache(lg, filename, "localhost", "993",
+          "0000000000000000000000000000000000000000");
+      Connection c(SSL_new(client.get()));
+      BOOST_CHECK(!cache.load(c.get()));
+      BOOST_REQUIRE(handshake(server.get(), c.get()));
+      BOOST_CHECK(!SSL_session_reused(c.get()));
+    }
+    // a rejected cache file isn't touched by a load
+    BOOST_CHECK_EQUAL(read_file(filename), before);
+  }
+
+  BOOST_FIXTURE_TEST_CASE( corrupt, Fixture )
+  {
+    Net::SSL::Session_Cache cache(lg, filename, "localhost", "993",
+        fingerprint);
+    {
+      ofstream f(filename);
+      f << "imapdl-tls-session 1\nlocalhost 993 " << fingerprint
+        << "\nXYZ\n";
+    }
+    Connection c(SSL_new(client.get()));
+    BOOST_CHECK(!cache.load(c.get()));
+    {
+      ofstream f(filename);
+      f << "imapdl-tls-session 1\nlocalhost 993 " << fingerprint
+        << "\n0011\n";
+    }
+    BOOST_CHECK(!cache.load(c.get()));
+  }
+
+  BOOST_FIXTURE_TEST_CASE( planted_tmp_symlink, Fixture )
+  {
+    string victim(dir + "/victim");
+    {
+      ofstream f(victim);
+      f << "precious";
+    }
+    fs::create_symlink("victim", filename + ".tmp");
+
+    Net::SSL::Session_Cache cache(lg, filename, "localhost", "993",
+        fingerprint);
+    Connection c(SSL_new(client.get()));
+    BOOST_REQUIRE(handshake(server.get(), c.get()));
+    cache.store(c.get());
+
+    BOOST_CHECK_EQUAL(read_file(victim), "precious");
+    BOOST_CHECK(!fs::exists(fs::symlink_status(filename + ".tmp")));
+    BOOST_REQUIRE(fs::exists(filename));
+    BOOST_CHECK(!fs::is_symlink(filename));
+    BOOST_CHECK_EQUAL(fs::status(filename).permissions(),
+        fs::owner_read | fs::owner_write);
+  }
+
+  // connects Net::TCP::SSL::Client::Base twice to a local server,
+  // the second handshake resumes the session of the first one
+  BOOST_FIXTURE_TEST_CASE( counters, Fixture )
+  {
+    namespace asio = boost::asio;
+    using namespace Net::TCP::SSL;
+    asio::io_service io_service;
+
+    string prefix(ut_prefix() + '/');
+    asio::ssl::context server_context(asio::ssl::context::sslv23);
+    Net::SSL::Context::set_defaults(server_context);
+    server_context.use_certificate_chain_file(prefix + "server.crt");
+    server_context.use_private_key_file(prefix + "server.key",
+        asio::ssl::context::pem);
+    asio::ip::tcp::acceptor acceptor(io_service,
+        asio::ip::tcp::endpoint(asio::ip::address::from_string("127.0.0.1"),
+          0));
+
+    using Stream = asio::ssl::stream<asio::ip::tcp::socket>;
+    static const char greeting[] = "* OK\r\n";
+    function<void()> accept = [&]() {
+      auto s = make_shared<Stream>(io_service, server_context);
+      acceptor.async_accept(s->lowest_layer(),
+          [&, s](const boost::system::error_code &ec) {
+        if (ec)
+          return;
+        s->async_handshake(asio::ssl::stream_base::server,
+            [s](const boost::system::error_code &ec) {
+          if (ec)
+            return;
+          asio::async_write(*s, asio::buffer(greeting, sizeof greeting - 1),
+              [s](const boost::system::error_code &, size_t) {
+            auto b = make_shared<array<char, 16> >();
+            s->async_read_some(asio::buffer(*b),
+                [s, b](const boost::system::error_code &, size_t) {
+              s->lowest_layer().close();
+            });
+          });
+        });
+      });
+    };
+
+    Client::Options opts;
+    opts.host = "127.0.0.1";
+    opts.service = to_string(acceptor.local_endpoint().port());
+    opts.fingerprint = fingerprint;
+    opts.session_cache = filename;
+    asio::ssl::context context(asio::ssl::context::sslv23);
+    opts.apply(context);
+
+    size_t resumed = Client::resumed_handshakes();
+    size_t full = Client::full_handshakes();
+    for (unsigned i = 0; i < 2; ++i) {
+      accept();
+      Client::Base c(io_service, context, opts, lg);
+      string received;
+      c.async_resolve([&](const boost::system::error_code &ec,
+            asio::ip::tcp::resolver::iterator it) {
+        BOOST_REQUIRE(!ec);
+        c.async_connect(it, [&](const boost::system::error_code &ec) {
+          BOOST_REQUIRE(!ec);
+          c.async_handshake([&](const boost::system::error_code &ec) {
+            BOOST_REQUIRE(!ec);
+            c.async_read_some([&](const boost::system::error_code &ec,
+                  size_t size) {
+              BOOST_REQUIRE(!ec);
+              received.assign(c.input().data(), size);
+              c.async_shutdown([](const boost::system::error_code &) {});
+            });
+          });
+        });
+      });
+      io_service.run();
+      io_service.reset();
+      BOOST_CHECK_EQUAL(received, greeting);
+      BOOST_CHECK(fs::exists(filename));
+    }
+    BOOST_CHECK_EQUAL(Client::full_handshakes() - full, 1u);
+    BOOST_CHECK_EQUAL(Client::resumed_handshakes() - resumed, 1u);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,179 @@
+// Copyright 2014, Georg Sauthoff <mail@georg.so>
+
+/* {{{ GPLv3
+
+    This file is part of imapdl.
+
+    imapdl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    imapdl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with imapdl.  If not, see <http://www.gnu.org/licenses/>.
+
+}}} */
+#include <boost/test/unit_test.hpp>
+
+#include <trace/trace.h>
+
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+namespace fs = boost::filesystem;
+
+static vector<Trace::Record> read_all(const string &filename)
+{
+  vector<Trace::Record> r;
+  Trace::Reader reader(filename);
+  for (;;) {
+    Trace::Record x;
+    reader >> x;
+    r.push_back(x);
+    if (x.type == Trace::Type::END_OF_FILE)
+      break;
+  }
+  return r;
+}
+
+BOOST_AUTO_TEST_SUITE( trace )
+
+  BOOST_AUTO_TEST_CASE( roundtrip )
+  {
+    fs::create_directory("tmp");
+    for (auto f : { Trace::Format::TEXT, Trace::Format::BINARY,
+        Trace::Format::DEFLATE }) {
+      string filename("tmp/ut_trace.trace");
+      vector<char> v(1000);
+      {
+        Trace::Writer w(filename, f);
+        // spans several blocks
+        for (unsigned i = 0; i < 500; ++i) {
+          v[0] = char(i);
+          w.push(i % 2 ? Trace::Type::SENT : Trace::Type::RECEIVED, v, i);
+        }
+        w.push(Trace::Type::DISCONNECT);
+        w.finish();
+      }
+      Trace::Reader reader(filename);
+      BOOST_CHECK_EQUAL(reader.format(), f);
+      for (unsigned i = 0; i < 500; ++i) {
+        Trace::Record r;
+        reader >> r;
+        BOOST_REQUIRE(r.type
+            == (i % 2 ? Trace::Type::SENT : Trace::Type::RECEIVED));
+        BOOST_REQUIRE_EQUAL(r.message.size(), i);
+        if (i)
+          BOOST_CHECK_EQUAL(r.message[0], char(i));
+      }
+      Trace::Record r;
+      reader >> r;
+      BOOST_CHECK(r.type == Trace::Type::DISCONNECT);
+      reader >> r;
+      BOOST_CHECK(r.type == Trace::Type::END_OF_FILE);
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( convert )
+  {
+    fs::create_directory("tmp");
+    string in("../unittest/cp_basic.trace");
+    Trace::convert(in, "tmp/ut_trace.deflate", Trace::Format::DEFLATE);
+    Trace::convert("tmp/ut_trace.deflate", "tmp/ut_trace.text",
+        Trace::Format::TEXT);
+    auto a = read_all(in);
+    auto b = read_all("tmp/ut_trace.deflate");
+    auto c = read_all("tmp/ut_trace.text");
+    BOOST_REQUIRE_EQUAL(a.size(), b.size());
+    BOOST_REQUIRE_EQUAL(a.size(), c.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+      BOOST_CHECK(a[i].type == b[i].type);
+      BOOST_CHECK_EQUAL(a[i].timestamp, b[i].timestamp);
+      BOOST_CHECK_EQUAL(a[i].message, b[i].message);
+      BOOST_CHECK(a[i].type == c[i].type);
+      BOOST_CHECK_EQUAL(a[i].timestamp, c[i].timestamp);
+      BOOST_CHECK_EQUAL(a[i].message, c[i].message);
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( truncated )
+  {
+    fs::create_directory("tmp");
+    string filename("tmp/ut_trace.binary");
+    {
+      Trace::Writer w(filename, Trace::Format::BINARY);
+      vector<char> v(100 * 1024, 'x');
+      w.push(Trace::Type::RECEIVED, v);
+      w.push(Trace::Type::SENT, v);
+    }
+    fs::resize_file(filename, fs::file_size(filename) - 1000);
+    auto r = read_all(filename);
+    BOOST_REQUIRE_EQUAL(r.size(), 2u);
+    BOOST_CHECK(r[0].type == Trace::Type::RECEIVED);
+    BOOST_CHECK_EQUAL(r[0].message.size(), 100u * 1024);
+    BOOST_CHECK(r[1].type == Trace::Type::END_OF_FILE);
+  }
+
+  // the trace of a connection is on disk before finish()
+  BOOST_AUTO_TEST_CASE( disconnect )
+  {
+    fs::create_directory("tmp");
+    for (auto f : { Trace::Format::TEXT, Trace::Format::BINARY,
+        Trace::Format::DEFLATE }) {
+      string filename("tmp/ut_trace.disconnect");
+      Trace::Writer w(filename, f);
+      vector<char> v(10, 'x');
+      w.push(Trace::Type::SENT, v);
+      w.push(Trace::Type::RECEIVED, v, 5);
+      w.push(Trace::Type::DISCONNECT);
+      // the writer thread may still be busy with it - it writes
+      // the few records with one flush
+      for (unsigned i = 0; i < 100 && !fs::file_size(filename); ++i)
+        this_thread::sleep_for(chrono::milliseconds(10));
+      Trace::Reader reader(filename);
+      BOOST_CHECK_EQUAL(reader.format(), f);
+      Trace::Record r;
+      reader >> r;
+      BOOST_CHECK(r.type == Trace::Type::SENT);
+      BOOST_CHECK_EQUAL(r.message, string(10, 'x'));
+      reader >> r;
+      BOOST_CHECK(r.type == Trace::Type::RECEIVED);
+      BOOST_CHECK_EQUAL(r.message, string(5, 'x'));
+      reader >> r;
+      BOOST_CHECK(r.type == Trace::Type::DISCONNECT);
+      if (f != Trace::Format::TEXT) {
+        // i.e. truncated
+        reader >> r;
+        BOOST_CHECK(r.type == Trace::Type::END_OF_FILE);
+      }
+    }
+  }
+
+  BOOST_AUTO_TEST_CASE( old_block )
+  {
+    fs::create_directory("tmp");
+    string filename("tmp/ut_trace.old");
+    Trace::Writer w(filename, Trace::Format::BINARY);
+    vector<char> v(10, 'x');
+    w.push(Trace::Type::SENT, v);
+    this_thread::sleep_for(chrono::milliseconds(1100));
+    w.push(Trace::Type::RECEIVED, v);
+    for (unsigned i = 0; i < 100 && !fs::file_size(filename); ++i)
+      this_thread::sleep_for(chrono::milliseconds(10));
+    auto r = read_all(filename);
+    BOOST_REQUIRE_EQUAL(r.size(), 3u);
+    BOOST_CHECK(r[0].type == Trace::Type::SENT);
+    BOOST_CHECK(r[1].type == Trace::Type::RECEIVED);
+    BOOST_CHECK(r[2].type == Trace::Type::END_OF_FILE);
+  }
+
+BOOST_AUTO_TEST_SUITE_END()